@@ -0,0 +1,64 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_CHASE_H
+#define NPT_CHASE_H
+
+#include <stddef.h>	// size_t
+#include <stdio.h>	// FILE
+
+/**
+ * Size of the elements of the pointer chain: one per cache line
+ */
+#define NPT_CHASE_LINE	64
+
+/**
+ * Default number of elements of the chain walked in each loop
+ */
+#define NPT_DEFAULT_CHASE_HOPS	1
+
+/**
+ * An element of the pointer chain
+ */
+struct npt_chase_line {
+	struct npt_chase_line *next;
+	char padding[NPT_CHASE_LINE - sizeof(struct npt_chase_line *)];
+};
+
+/**
+ * Current position in the chain, NULL when the pointer chase mode is
+ * not in use, and number of elements walked in each loop
+ */
+extern struct npt_chase_line *chaseCursor;
+extern unsigned int chaseHops;
+
+/**
+ * Walk the chain: each load depends on the previous one, so that the
+ * latency of the memory holding the working set is not hidden
+ */
+static __inline__ struct npt_chase_line *npt_chase_walk(struct npt_chase_line *p,
+		unsigned int hops) {
+	while (hops-- > 0) p = p->next;
+	return p;
+}
+
+int npt_chase_init();
+void npt_chase_free();
+void npt_chase_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_CHASE_H */
@@ -0,0 +1,57 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_CONVERGE_H
+#define NPT_CONVERGE_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Value of --nocountloop for the adaptive warm-up
+ */
+#define NPT_NOCOUNTLOOP_AUTO	-1
+
+/**
+ * The adaptive warm-up compares the median and the 99th percentile of
+ * successive windows of loops: it ends when they moved by less than the
+ * tolerance (plus one tick) for some windows in a row, or after a time
+ * limit (seconds)
+ */
+#define NPT_WARMUP_WINDOW	10000
+#define NPT_WARMUP_TOLERANCE	0.05
+#define NPT_WARMUP_STABLE	3
+#define NPT_WARMUP_MAX_TIME	10
+
+/**
+ * Default precision of the early stop: relative half-width of the 95%
+ * confidence interval of the percentile (percent), and period of its
+ * check (microseconds)
+ */
+#define NPT_DEFAULT_CONVERGE_PRECISION	5.0
+#define NPT_CONVERGE_PERIOD		100000
+
+int npt_converge_init();
+void npt_converge_free();
+int npt_converge_start();
+void npt_converge_stop();
+int npt_warmup_account(double duration, uint64_t ticks);
+int npt_converge_interval(double percentile, uint64_t *low, uint64_t *value, uint64_t *high);
+void npt_converge_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_CONVERGE_H */
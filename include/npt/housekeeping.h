@@ -0,0 +1,71 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_HOUSEKEEPING_H
+#define NPT_HOUSEKEEPING_H
+
+#include <pthread.h>	// pthread_t
+#include <sched.h>	// cpu_set_t
+#include <stdint.h>	// uint64_t
+
+/**
+ * Start a housekeeping thread: it is run with the SCHED_OTHER policy
+ * and is allowed on every online CPU but the measured one, so that it
+ * never competes with the RT loop
+ */
+int npt_housekeeping_start(pthread_t *thread, const char *name,
+		void *(*routine)(void *), void *arg);
+
+/**
+ * Start a thread with the same scheduling as the housekeeping ones, but
+ * on the given CPUs. Used by the load generators, which must run on a
+ * chosen neighbour of the measured CPU.
+ */
+int npt_housekeeping_start_on(pthread_t *thread, const char *name,
+		void *(*routine)(void *), void *arg, const cpu_set_t *cpus);
+
+/**
+ * Wait for the end of a thread started by npt_housekeeping_start, which
+ * is not re-pinned anymore
+ */
+void npt_housekeeping_join(pthread_t thread);
+
+/**
+ * Move the running housekeeping threads away from the measured CPU, once
+ * the loop moved to another one
+ */
+void npt_housekeeping_repin();
+
+/**
+ * Sleep for the given number of milliseconds in a housekeeping thread
+ */
+void npt_housekeeping_sleep(unsigned int ms);
+
+/**
+ * Read the raw monotonic clock, in nanoseconds, which the NTP does not
+ * adjust
+ */
+uint64_t npt_housekeeping_raw_ns();
+
+/**
+ * Call a function every interval (nanoseconds) of the raw monotonic
+ * clock in a housekeeping thread, until the stopping flag is set
+ */
+void npt_housekeeping_every(uint64_t interval, const int *stopping, void (*routine)());
+
+#endif /* NPT_HOUSEKEEPING_H */
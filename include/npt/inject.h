@@ -0,0 +1,50 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_INJECT_H
+#define NPT_INJECT_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Default rate of the injected disturbances (Hz), most sizes and most
+ * disturbances recorded in a run
+ */
+#define NPT_DEFAULT_INJECT_RATE	100
+#define NPT_INJECT_SIZES	16
+#define NPT_INJECT_MAX		262144
+
+/**
+ * A disturbance injected in a counted loop, in timestamp counter ticks
+ */
+struct npt_injection {
+	uint64_t start;
+	uint64_t end;
+	unsigned int size;
+};
+
+int npt_inject_parse(const char *list);
+int npt_inject_init();
+void npt_inject_free();
+int npt_inject_start();
+void npt_inject_record(uint64_t start, uint64_t end, unsigned int size);
+void npt_inject_stop();
+void npt_inject_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_INJECT_H */
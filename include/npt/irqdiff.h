@@ -0,0 +1,45 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_IRQDIFF_H
+#define NPT_IRQDIFF_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Maximum number of pairs of phases of the differential mode
+ */
+#define NPT_IRQDIFF_MAX_PAIRS	1024
+
+/**
+ * A phase of the differential mode, with the interrupts enabled or
+ * disabled, delimited in ticks elapsed since the start of the run
+ */
+struct npt_irqdiff_phase {
+	int irqOff;
+	uint64_t start;
+	uint64_t end;
+	uint64_t loops;
+	uint64_t spikes;
+};
+
+int npt_irqdiff_cycle();
+void npt_irqdiff_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_IRQDIFF_H */
@@ -0,0 +1,106 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_LOAD_H
+#define NPT_LOAD_H
+
+#include <pthread.h>	// pthread_t
+#include <sched.h>	// cpu_set_t
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+#include <npt/summary.h>
+
+/**
+ * Maximum number of load runs
+ */
+#define NPT_LOAD_MAX_RUNS	16
+
+/**
+ * Size of the buffer of the memory streaming load (bytes)
+ */
+#define NPT_LOAD_STREAM_SIZE	(96 << 20)
+
+/**
+ * Size of the last level cache when it cannot be read from sysfs
+ * (bytes), number of pages of each mapping of the TLB load and length
+ * of the sleeps of the timer load (nanoseconds)
+ */
+#define NPT_LOAD_LLC_SIZE	(32 << 20)
+#define NPT_LOAD_TLB_PAGES	64
+#define NPT_LOAD_TIMER_SLEEP	50000
+
+struct npt_load_worker;
+
+/**
+ * States of a worker: its profile is prepared in its own thread, so that
+ * its buffers are local to its CPU
+ */
+#define NPT_LOAD_PREPARING	0
+#define NPT_LOAD_READY		1
+#define NPT_LOAD_FAILED		2
+
+/**
+ * A load profile: the work is done by chunks of about a millisecond,
+ * until the load is stopped. A profile without work runs no thread.
+ */
+struct npt_load_profile {
+	const char *name;
+	const char *description;
+	int (*prepare)(struct npt_load_worker *w);
+	void (*work)(struct npt_load_worker *w);
+};
+
+/**
+ * A thread running a load profile on one CPU
+ */
+struct npt_load_worker {
+	pthread_t thread;
+	const struct npt_load_profile *profile;
+	void (*work)(struct npt_load_worker *w);
+	int cpu;
+	int state;
+	void *buffer;
+	size_t size;
+	uint64_t seed;
+	uint64_t chunks;
+};
+
+/**
+ * A run of the loop with a load profile, and its results
+ */
+struct npt_load_run {
+	const struct npt_load_profile *profile;
+	const char *placement;
+	cpu_set_t cpus;
+
+	struct npt_summary summary;
+	double chunksPerSecond;
+	int done;
+};
+
+int npt_parse_cpu_list(const char *list, cpu_set_t *set);
+int npt_load_init();
+int npt_load_runs();
+const char *npt_load_name(int run);
+int npt_load_start(int run);
+void npt_load_stop(int run);
+void npt_load_print(FILE *fd, const char *prefix);
+void npt_load_print_comparison(FILE *fd, const char *prefix);
+
+#endif /* NPT_LOAD_H */
@@ -0,0 +1,39 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_METRICS_H
+#define NPT_METRICS_H
+
+#include <stdio.h>	// FILE
+
+/**
+ * Default refresh interval of the exported metrics (microseconds)
+ */
+#define NPT_DEFAULT_METRICS_INTERVAL	1000000
+
+/**
+ * Content type of the OpenMetrics text format
+ */
+#define NPT_METRICS_CONTENT_TYPE \
+	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+int npt_metrics_start();
+void npt_metrics_stop();
+void npt_metrics_render(FILE *fd);
+
+#endif /* NPT_METRICS_H */
@@ -0,0 +1,72 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_MSR_H
+#define NPT_MSR_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * The MSRs read on the measured CPU: the counters of the cycles at the
+ * TSC frequency (MPERF) and at the actual frequency (APERF), which only
+ * count in C0, and the thermal status of the core and of the package
+ */
+#define NPT_MSR_MPERF			0xe7
+#define NPT_MSR_APERF			0xe8
+#define NPT_MSR_THERM_STATUS		0x19c
+#define NPT_MSR_PACKAGE_THERM_STATUS	0x1b1
+
+/**
+ * Bits of the thermal status: the throttling because of the temperature
+ * or of the power limit, at the time of the read. The log bits next to
+ * them stay set until software clears them, which npt does not do as it
+ * only reads the MSRs: they are ignored.
+ */
+#define NPT_MSR_THERMAL		(1ULL << 0)
+#define NPT_MSR_POWER		(1ULL << 10)
+
+/**
+ * Relative tolerance on the mean loop duration of an interval, over the
+ * fastest interval, and on its frequency, under the highest one, beyond
+ * which the interval is marked
+ */
+#define NPT_MSR_TOLERANCE	0.05
+
+/**
+ * A read of the MSRs, paired with the loops and ticks of the loop, and
+ * with its elapsed ticks to place the spikes
+ */
+struct npt_msr_sample {
+	uint64_t loops;
+	uint64_t ticks;
+	uint64_t ns;
+	uint64_t aperf;
+	uint64_t mperf;
+	uint64_t therm;
+	uint64_t packageTherm;
+	uint64_t at;
+};
+
+int npt_msr_start();
+void npt_msr_record(const struct npt_msr_sample *s);
+void npt_msr_stop();
+void npt_msr_free();
+void npt_msr_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_MSR_H */
@@ -17,6 +17,15 @@
  * or see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef NPT_H
+#define NPT_H
+
+#include <stdbool.h>	// bool
+#include <stddef.h>	// size_t
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// printf
+#include <time.h>	// CLOCK_MONOTONIC_RAW
+
 /**
  * Enable DEBUG messages
  */
@@ -34,7 +43,8 @@
 #define NPT_DEFAULT_LOOP_NUMBER 10000000ULL
 
 /**
- * Define the number of loops not to care at the start of the execution
+ * Define the number of loops not to care at the start of the execution,
+ * by default
  */
 #define NPT_NOCOUNTLOOP 5
 
@@ -43,7 +53,6 @@
  * Prepare the defines for tracing if necessary
  */
 #if defined(WITH_LTTNG_UST) && defined(HAVE_LIBLTTNG_UST)
-	#define TRACEPOINT_DEFINE
 	#include <npt/tracepoints.h>
 	#define UST_TRACE_START	tracepoint(npt, start);
 	#define UST_TRACE_LOOP	tracepoint(npt, loop, counter, t0-t1, duration);
@@ -59,14 +68,42 @@
 /**
  * Statistics variables
  */
-uint64_t counter;
-double multi;
-double minDuration, maxDuration, sumDuration, meanDuration;
-double variance_n, stdDeviation;
+extern uint64_t counter;
+extern uint64_t sumTicks;
+extern double multi;
+extern double minDuration, maxDuration, sumDuration, meanDuration;
+extern double meanSquared;
+extern double variance_n, stdDeviation;
 #if defined(WITH_LTTNG_UST) && defined(ENABLE_TRACEPOINT_FREQUENCY)
-	uint64_t tpnb;
+	extern uint64_t tpnb;
 #endif /* WITH_LTTNG_UST && ENABLE_TRACEPOINT_FREQUENCY */
 
+/**
+ * The histogram and the counter of values bigger than its size
+ */
+extern uint64_t *histogram;
+extern uint64_t histogramOverruns;
+
+/**
+ * Ticks elapsed in the counted loops, which only differ from the sum of
+ * their durations with a plugin workload, of which only the calls are
+ * timed: the periodic events and the spikes are placed with them
+ */
+extern uint64_t wallTicks;
+
+/**
+ * The measurement engine
+ */
+#define NPT_ACCOUNT_BLOCK 4096
+int npt_histogram_init();
+void npt_histogram_free();
+void reset_statistics();
+void finalize_statistics();
+uint64_t npt_elapsed_ticks();
+int cycle();
+void npt_account_block(const uint64_t *ticks, size_t n);
+void npt_histogram_percentiles(const double *fractions, double *values, int n);
+
 /**
  * Create a structure to store the variables
  */
@@ -96,13 +133,55 @@ struct globalArgs_t {
 	uint64_t window_wait;	/* long option */
 #endif /* WITH_LTTNG_UST && ENABLE_WINDOWS_MODE */
 
+	uint64_t soak_period;	/* long option */
+	char* checkpoint;	/* long option */
+	char* replay;		/* long option */
+	char* raw_dump;		/* long option */
+	uint64_t threshold;	/* long option */
+	uint64_t spike_bin;	/* long option */
+	uint64_t max_spikes;	/* long option */
+	char* metrics_file;	/* long option */
+	unsigned int metrics_port;	/* long option */
+	uint64_t metrics_interval;	/* long option */
+	char* smt_sibling;	/* long option */
+	char* stress;		/* long option */
+	char* stress_cpus;	/* long option */
+	uint64_t pointer_chase;	/* long option */
+	unsigned int chase_hops;	/* long option */
+	char* workload;		/* long option */
+	double converge;	/* long option */
+	double converge_precision;	/* long option */
+	int policy;		/* long option */
+	uint64_t dl_runtime;	/* long option */
+	uint64_t dl_deadline;	/* long option */
+	uint64_t dl_period;	/* long option */
+	char* sweep;		/* long option */
+	char* sweep_prios;	/* long option */
+	char* sweep_cpus;	/* long option */
+	uint64_t tsc_interval;	/* long option */
+	double tsc_tolerance;	/* long option */
+	char* sketch;		/* long option */
+	int sched_trace;	/* long option */
+	char* inject;		/* long option */
+	unsigned int inject_rate;	/* long option */
+	uint64_t stolen_interval;	/* long option */
+	char* scenario;		/* long option */
+	unsigned int irq_diff;	/* long option */
+	char* wait;		/* long option */
+	uint64_t wait_period;	/* long option */
+	uint64_t wait_spin;	/* long option */
+	uint64_t msr_interval;	/* long option */
+
 	int picoseconds;        /* flag */
 	int nanoseconds;        /* flag */
 	int evaluateSpeed;      /* flag */
+	int resume;		/* flag */
+	int shm;		/* flag */
 
 	unsigned long cpuHz;
 	double cpuPeriod;
-} globalArgs;
+};
+extern struct globalArgs_t globalArgs;
 
 /**
  * The function used to show verbose messages
@@ -294,6 +373,17 @@ struct globalArgs_t {
 	}
 #endif
 
+/**
+ * Timestamp source of the loop, which can be replaced by a synthetic
+ * one to check the measurement engine against known distributions
+ */
+#ifdef NPT_SYNTHETIC_TIMESTAMP
+	extern uint64_t npt_synthetic_timestamp();
+	#define NPT_TIMESTAMP() npt_synthetic_timestamp()
+#else /* NPT_SYNTHETIC_TIMESTAMP */
+	#define NPT_TIMESTAMP() rdtsc()
+#endif /* NPT_SYNTHETIC_TIMESTAMP */
+
 
 /**
  * Use CLOCK_MONOTONIC_RAW if available to avoid NTP adjustment
@@ -312,12 +402,18 @@ struct globalArgs_t {
  */
 #define UNITE(pico, nano) ((pico)?"ps":((nano)?"ns":"us"))
 
+/**
+ * Macro to get an index for the unit, as stored in binary files
+ */
+#define UNIT_INDEX(pico, nano) ((pico)?2:((nano)?1:0))
+
 
 /**
  * Declare or not the sti() and cli() inline functions
  * depending on the configure option
  */
 #ifdef ENABLE_CLI_STI
+	#include <sys/io.h>	// iopl
 	#define BUILD_OPTIONS_CLI_STI	" --enable-cli-sti"
 	/**
 	 * Enable local IRQs
@@ -376,3 +472,5 @@ struct globalArgs_t {
 #else /* ENABLE_CLI_STI || ENABLE_VERBOSE || WITH_LTTNG_UST */
 	#define BUILD_OPTIONS
 #endif /* ENABLE_CLI_STI || ENABLE_VERBOSE || WITH_LTTNG_UST */
+
+#endif /* NPT_H */
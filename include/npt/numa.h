@@ -0,0 +1,43 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_NUMA_H
+#define NPT_NUMA_H
+
+#include <stddef.h>	// size_t
+#include <stdio.h>	// FILE
+
+/**
+ * Maximum number of buffers tracked, and of NUMA nodes reported
+ */
+#define NPT_NUMA_MAX_BUFFERS	64
+#define NPT_NUMA_MAX_NODES	64
+
+/**
+ * Number of pages of a buffer whose node is checked for the report
+ */
+#define NPT_NUMA_SAMPLE_PAGES	1024
+
+void *npt_alloc_local(size_t size, const char *name);
+void npt_free_local(void *ptr);
+void npt_move_local(void *ptr);
+void npt_numa_start();
+void npt_numa_stop();
+void npt_numa_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_NUMA_H */
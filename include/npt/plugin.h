@@ -0,0 +1,54 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_PLUGIN_H
+#define NPT_PLUGIN_H
+
+/**
+ * Interface of the workload plugins, loaded with --workload=LIB:SYMBOL.
+ *
+ * The plugin is a shared object which exports the measured function
+ * SYMBOL, called once in each loop:
+ *
+ *	void SYMBOL(void *ctx);
+ *
+ * and, optionally, hooks named after it, which all run outside of the
+ * timed region:
+ *
+ *	int SYMBOL_init(void **ctx);
+ *		called before entering RT mode, ctx is passed to the other
+ *		functions; a non-zero return value aborts the run
+ *	void SYMBOL_warmup(void *ctx);
+ *		called once pinned on the measured CPU, before each run of
+ *		the loop
+ *	void SYMBOL_teardown(void *ctx);
+ *		called after the last run of the loop
+ */
+
+typedef void (*npt_plugin_workload_t)(void *ctx);
+typedef int (*npt_plugin_init_t)(void **ctx);
+typedef void (*npt_plugin_hook_t)(void *ctx);
+
+/**
+ * Suffixes of the hooks
+ */
+#define NPT_PLUGIN_INIT_SUFFIX		"_init"
+#define NPT_PLUGIN_WARMUP_SUFFIX	"_warmup"
+#define NPT_PLUGIN_TEARDOWN_SUFFIX	"_teardown"
+
+#endif /* NPT_PLUGIN_H */
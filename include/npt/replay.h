@@ -0,0 +1,59 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_REPLAY_H
+#define NPT_REPLAY_H
+
+#include <stdint.h>	// uint64_t
+
+/**
+ * Magic string and version of the raw dump files
+ */
+#define NPT_RAW_MAGIC		"NPTRAW"
+#define NPT_RAW_VERSION		1
+
+/**
+ * Header of a raw dump file, followed by the duration of each counted
+ * loop in ticks, as 64 bits integers in the host byte order
+ */
+struct npt_raw_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t cpuHz;
+	uint64_t loops;
+};
+
+/**
+ * The raw dump buffer, NULL when not in use, and its capacity
+ */
+extern uint64_t *rawDump;
+extern uint64_t rawDumpSize;
+
+/**
+ * Store the duration of a counted loop in the raw dump
+ */
+static __inline__ void npt_raw_dump_account(uint64_t ticks) {
+	if (counter <= rawDumpSize) rawDump[counter-1] = ticks;
+}
+
+int npt_raw_dump_init();
+int npt_raw_dump_write();
+int npt_replay(const char *filename);
+
+#endif /* NPT_REPLAY_H */
@@ -0,0 +1,59 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SCENARIO_H
+#define NPT_SCENARIO_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+#include <npt/npt.h>
+#include <npt/summary.h>
+
+/**
+ * Maximum number of runs of a scenario, and options of a run
+ */
+#define NPT_SCENARIO_MAX_RUNS	64
+#define NPT_SCENARIO_MAX_ARGS	64
+
+/**
+ * A run of a scenario: its options on top of the command line ones, and
+ * its results
+ */
+struct npt_scenario_run {
+	char name[32];
+	char *options;
+	struct globalArgs_t args;
+
+	int error;
+	struct npt_summary summary;
+	int done;
+};
+
+int npt_scenario_init(int (*parse)(int argc, char **argv));
+void npt_scenario_free();
+int npt_scenario_runs();
+const char *npt_scenario_name(int run);
+int npt_scenario_start(int run);
+void npt_scenario_stop(int run);
+void npt_scenario_fail(int run);
+void npt_scenario_print(FILE *fd, const char *prefix);
+void npt_scenario_print_comparison(FILE *fd, const char *prefix);
+int npt_scenario_write();
+
+#endif /* NPT_SCENARIO_H */
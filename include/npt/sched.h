@@ -0,0 +1,75 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SCHED_H
+#define NPT_SCHED_H
+
+#include <sched.h>	// SCHED_*
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+#include <npt/summary.h>
+
+/**
+ * SCHED_DEADLINE and its flag, which the C library may not define
+ */
+#ifndef SCHED_DEADLINE
+	#define SCHED_DEADLINE	6
+#endif /* SCHED_DEADLINE */
+#define NPT_SCHED_FLAG_RESET_ON_FORK	0x01
+
+/**
+ * Default runtime, deadline and period of SCHED_DEADLINE (nanoseconds)
+ */
+#define NPT_DEFAULT_DL_RUNTIME	900000
+#define NPT_DEFAULT_DL_DEADLINE	1000000
+#define NPT_DEFAULT_DL_PERIOD	1000000
+
+/**
+ * Maximum number of runs of the sweep mode
+ */
+#define NPT_SCHED_MAX_RUNS	64
+
+/**
+ * A run of the sweep mode, and its results
+ */
+struct npt_sched_run {
+	int policy;
+	int priority;
+	unsigned int cpu;
+	char name[32];
+
+	int error;
+	uint64_t preempted;
+	struct npt_summary summary;
+	int done;
+};
+
+int npt_sched_parse_policy(const char *name);
+const char *npt_sched_policy_name(int policy);
+int npt_sched_set(int policy, int priority);
+void npt_sched_describe(FILE *fd, int policy, int priority);
+int npt_sched_init();
+int npt_sched_runs();
+const char *npt_sched_name(int run);
+int npt_sched_start(int run);
+void npt_sched_stop(int run);
+void npt_sched_print(FILE *fd, const char *prefix);
+void npt_sched_print_comparison(FILE *fd, const char *prefix);
+
+#endif /* NPT_SCHED_H */
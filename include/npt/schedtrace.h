@@ -0,0 +1,74 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SCHEDTRACE_H
+#define NPT_SCHEDTRACE_H
+
+#include <stdint.h>	// uint16_t, int32_t, uint64_t
+#include <stdio.h>	// FILE
+#include <sys/types.h>	// pid_t
+
+/**
+ * Pages of the perf ring buffer shared by the tracepoints, a power of
+ * two, and number of the slices of time taken from the loop that are
+ * kept to be matched with the spikes
+ */
+#define NPT_SCHEDTRACE_PAGES	128
+#define NPT_SCHEDTRACE_SLICES	65536
+
+/**
+ * Most tasks and interrupts told apart in the report, the other ones
+ * being accounted together
+ */
+#define NPT_SCHEDTRACE_CULPRITS	128
+
+/**
+ * The tracepoints
+ */
+#define NPT_TRACE_SWITCH	0
+#define NPT_TRACE_IRQ_ENTRY	1
+#define NPT_TRACE_IRQ_EXIT	2
+#define NPT_TRACE_SOFTIRQ_ENTRY	3
+#define NPT_TRACE_SOFTIRQ_EXIT	4
+#define NPT_TRACE_TIMER_ENTRY	5
+#define NPT_TRACE_TIMER_EXIT	6
+#define NPT_TRACE_EVENTS	7
+
+int npt_schedtrace_start();
+void npt_schedtrace_stop();
+void npt_schedtrace_print(FILE *fd, const char *prefix);
+
+#ifdef NPT_SYNTHETIC_TIMESTAMP
+/**
+ * A synthetic record of a tracepoint, for the checks: its type is the
+ * tracepoint plus one, its fields are the ones of the tracepoint in
+ * order (prev_pid and next_pid, irq and the location of its name in
+ * data, or vec), then next_comm
+ */
+struct npt_schedtrace_record {
+	uint16_t type;
+	int32_t fields[2];
+	char comm[16];
+	char data[16];
+	uint64_t time;
+};
+
+int npt_schedtrace_replay(pid_t tid, const struct npt_schedtrace_record *records, size_t count);
+#endif /* NPT_SYNTHETIC_TIMESTAMP */
+
+#endif /* NPT_SCHEDTRACE_H */
@@ -0,0 +1,133 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SHM_H
+#define NPT_SHM_H
+
+#include <stdint.h>	// uint64_t, int32_t, uint32_t
+#include <string.h>	// memcpy
+
+/**
+ * Name prefix of the segments, in /dev/shm, followed by the pid of the
+ * instance, magic string and version of their layout
+ */
+#define NPT_SHM_PREFIX	"npt."
+#define NPT_SHM_MAGIC	"NPTSHM"
+#define NPT_SHM_VERSION	1
+
+/**
+ * Interval at which the loop publishes its statistics (microseconds)
+ */
+#define NPT_SHM_INTERVAL	100000
+
+/**
+ * The live histogram counts loop durations in ticks: each power of two
+ * is split in 2^NPT_SHM_SUBBITS linear buckets, so that a bucket is at
+ * most 1/8 of its value wide and the whole range fits in a few pages
+ */
+#define NPT_SHM_SUBBITS	3
+#define NPT_SHM_BUCKETS	(64 << NPT_SHM_SUBBITS)
+
+/**
+ * States of an instance
+ */
+#define NPT_SHM_IDLE	0
+#define NPT_SHM_RUNNING	1
+
+/**
+ * The segment of an instance. The loop writes it as a seqlock: seq is
+ * odd while the values are being published, so that a reader keeps a
+ * copy taken between two equal even values of seq.
+ */
+struct npt_shm {
+	char magic[8];
+	uint32_t version;
+	int32_t pid;
+	uint64_t seq;
+
+	uint32_t cpu;
+	uint32_t state;
+	uint64_t cpuHz;
+	uint64_t loops;
+	uint64_t ticks;
+	uint64_t maxTicks;
+	uint64_t buckets[NPT_SHM_BUCKETS];
+};
+
+/**
+ * Buckets of the loop, published in the segment, NULL when not in use
+ */
+extern uint64_t *shmBuckets;
+
+/**
+ * Return the bucket of a duration in ticks
+ */
+static __inline__ unsigned int npt_shm_index(uint64_t ticks) {
+	int msb;
+
+	if (ticks < (1 << NPT_SHM_SUBBITS)) return (unsigned int)ticks;
+	msb = 63 - __builtin_clzll(ticks);
+	return ((msb - NPT_SHM_SUBBITS + 1) << NPT_SHM_SUBBITS)
+		+ ((ticks >> (msb - NPT_SHM_SUBBITS)) & ((1 << NPT_SHM_SUBBITS) - 1));
+}
+
+/**
+ * Return the longest duration in ticks of a bucket
+ */
+static __inline__ uint64_t npt_shm_bound(unsigned int index) {
+	int shift;
+
+	if (index < (1 << NPT_SHM_SUBBITS)) return index;
+	shift = (int)(index >> NPT_SHM_SUBBITS) - 1;
+	return ((uint64_t)((index & ((1 << NPT_SHM_SUBBITS) - 1)) | (1 << NPT_SHM_SUBBITS)) << shift)
+		+ ((1ULL << shift) - 1);
+}
+
+/**
+ * Account a loop duration in the live histogram
+ */
+static __inline__ void npt_shm_account(uint64_t ticks) {
+	shmBuckets[npt_shm_index(ticks)]++;
+}
+
+/**
+ * Copy a segment consistently, retrying while the loop publishes.
+ * Return -1 if no consistent copy could be taken, as when the instance
+ * died while publishing.
+ */
+static __inline__ int npt_shm_snapshot(const struct npt_shm *shm, struct npt_shm *copy) {
+	uint64_t seq;
+	int tries;
+
+	for (tries = 0; tries < 100000; tries++) {
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) continue;
+		memcpy(copy, (const void *)shm, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq) return 0;
+	}
+	return -1;
+}
+
+int npt_shm_start();
+void npt_shm_stop();
+void npt_shm_reset();
+void npt_shm_publish(uint32_t state);
+uint64_t npt_shm_event(uint64_t now);
+
+#endif /* NPT_SHM_H */
@@ -0,0 +1,47 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SIGNALS_H
+#define NPT_SIGNALS_H
+
+#include <stdbool.h>	// bool
+
+/**
+ * Requests of the housekeeping threads to the loop: a snapshot or a stop
+ * from the signal thread, the end of the run from the early stop
+ */
+#define NPT_SIGNAL_SNAPSHOT	1
+#define NPT_SIGNAL_STOP		2
+#define NPT_SIGNAL_CONVERGED	4
+
+/**
+ * Requests not handled by the loop yet, checked with a single load in
+ * each counted loop
+ */
+extern int signalPending;
+
+/**
+ * Signal which stopped the run, 0 if it went to its end
+ */
+extern int signalStopped;
+
+int npt_signals_start();
+void npt_signals_stop();
+bool npt_signal_handle();
+
+#endif /* NPT_SIGNALS_H */
@@ -0,0 +1,120 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SKETCH_H
+#define NPT_SKETCH_H
+
+#include <math.h>	// ldexp
+#include <stdint.h>	// uint64_t, int64_t
+#include <string.h>	// memcpy
+
+/**
+ * Magic string and version of the sketch files
+ */
+#define NPT_SKETCH_MAGIC	"NPTSKCH"
+#define NPT_SKETCH_VERSION	1
+
+/**
+ * The sketch maps durations in nanoseconds to logarithmic buckets, in
+ * the way of DDSketch: each power of two from 2^NPT_SKETCH_MIN_EXPONENT
+ * to 2^(NPT_SKETCH_MAX_EXPONENT+1) is split in 2^NPT_SKETCH_SUBBITS
+ * linear buckets, read from the bits of the double, so that any value
+ * of a bucket is within NPT_SKETCH_ERROR of its representative value.
+ * The mapping does not depend on the host, so sketches are merged by
+ * adding their buckets.
+ */
+#define NPT_SKETCH_SUBBITS	7
+#define NPT_SKETCH_MIN_EXPONENT	-8
+#define NPT_SKETCH_MAX_EXPONENT	40
+#define NPT_SKETCH_BUCKETS	((NPT_SKETCH_MAX_EXPONENT - NPT_SKETCH_MIN_EXPONENT + 1) << NPT_SKETCH_SUBBITS)
+#define NPT_SKETCH_OFFSET	((int64_t)(1023 + NPT_SKETCH_MIN_EXPONENT) << NPT_SKETCH_SUBBITS)
+#define NPT_SKETCH_ERROR	(1.0 / ((2 << NPT_SKETCH_SUBBITS) + 1))
+
+/**
+ * Header of a sketch file, followed by the non-empty buckets and by a
+ * FNV-1a checksum of everything before it. The durations are in
+ * nanoseconds, and the count includes the overflows, the loops longer
+ * than the last bucket. Values are stored in the host byte order.
+ */
+struct npt_sketch_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t subBits;
+	int32_t minExponent;
+	int32_t maxExponent;
+	uint64_t cpuHz;
+	uint64_t count;
+	uint64_t overflows;
+	double min, max, sum;
+	uint64_t buckets;
+};
+
+struct npt_sketch_bucket {
+	uint32_t index;
+	uint64_t count;
+} __attribute__((packed));
+
+/**
+ * The buckets of the sketch, NULL when not in use, the overflows and
+ * the multiplier from the unit of the durations to nanoseconds
+ */
+extern uint64_t *sketch;
+extern uint64_t sketchOverflows;
+extern double sketchScale;
+
+/**
+ * Return the bucket of a duration in nanoseconds, or a negative value
+ * if it is under the first bucket, which only happens to null durations
+ */
+static __inline__ int64_t npt_sketch_index(double ns) {
+	uint64_t bits;
+	memcpy(&bits, &ns, sizeof(bits));
+	return (int64_t)(bits >> (52 - NPT_SKETCH_SUBBITS)) - NPT_SKETCH_OFFSET;
+}
+
+/**
+ * Return the value of a bucket with the lowest relative error on its
+ * bounds: their harmonic mean
+ */
+static __inline__ double npt_sketch_value(int64_t index) {
+	int exponent = (int)(index >> NPT_SKETCH_SUBBITS) + NPT_SKETCH_MIN_EXPONENT;
+	double sub = (double)(index & ((1 << NPT_SKETCH_SUBBITS) - 1));
+	double low = ldexp(1.0 + sub / (1 << NPT_SKETCH_SUBBITS), exponent);
+	double high = ldexp(1.0 + (sub + 1.0) / (1 << NPT_SKETCH_SUBBITS), exponent);
+	return 2.0 * low * high / (low + high);
+}
+
+/**
+ * Account a loop duration in the sketch
+ */
+static __inline__ void npt_sketch_account(double duration) {
+	int64_t index = npt_sketch_index(duration * sketchScale);
+
+	if (index < 0) index = 0;
+	if (index < NPT_SKETCH_BUCKETS) sketch[index]++;
+	else sketchOverflows++;
+}
+
+int npt_sketch_init();
+void npt_sketch_reset();
+int npt_sketch_write(const char *filename);
+int npt_sketch_write_buckets(const char *filename, const uint64_t *counts, uint64_t overflows,
+		double min, double max, double sum, uint64_t cpuHz);
+void npt_sketch_free();
+
+#endif /* NPT_SKETCH_H */
@@ -0,0 +1,128 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SOAK_H
+#define NPT_SOAK_H
+
+#include <stddef.h>	// size_t
+#include <stdint.h>	// uint64_t, int64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Magic string and version of the checkpoint files
+ */
+#define NPT_CHECKPOINT_MAGIC	"NPTCKPT"
+#define NPT_CHECKPOINT_VERSION	1
+
+/**
+ * States of a soak period slot: the RT loop fills one slot while the
+ * checkpoint thread writes and clears the other one
+ */
+#define NPT_PERIOD_FREE		0
+#define NPT_PERIOD_FILLING	1
+#define NPT_PERIOD_CLOSED	2
+
+/**
+ * Statistics of a soak period, followed by the cumulative statistics
+ * of the run at the moment the period was closed. Only 64 bits fields
+ * so that the structure can be written as is in the checkpoint files.
+ */
+struct npt_period_stats {
+	uint64_t index;
+	int64_t closedAt;
+	uint64_t loops;
+	uint64_t sumTicks;
+	uint64_t overruns;
+	double min, max;
+
+	uint64_t totalLoops;
+	uint64_t totalSumTicks;
+	uint64_t totalOverruns;
+	double totalMin, totalMax;
+	double totalMean, totalMeanSquared;
+};
+
+/**
+ * Header of a checkpoint file, followed by the non-empty buckets of
+ * the period histogram and by a FNV-1a checksum of everything before
+ * it. Values are stored in the host byte order.
+ */
+struct npt_checkpoint_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t unit;
+	uint64_t cpuHz;
+	struct npt_period_stats stats;
+	uint64_t buckets;
+};
+
+struct npt_checkpoint_bucket {
+	uint32_t index;
+	uint64_t count;
+} __attribute__((packed));
+
+/**
+ * FNV-1a hash, used as checksum of the checkpoint files
+ */
+#define NPT_FNV1A_INIT 14695981039346656037ULL
+static __inline__ uint64_t npt_fnv1a(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *p = data;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * A soak period slot
+ */
+struct npt_period {
+	struct npt_period_stats stats;
+	uint64_t *histogram;
+	int state;
+};
+
+/**
+ * The period currently filled by the loop, NULL when the soak mode
+ * is not in use
+ */
+extern struct npt_period *soakPeriod;
+
+/**
+ * Account a loop duration in the current soak period
+ */
+static __inline__ void npt_soak_account(double duration, uint64_t ticks) {
+	struct npt_period *p = soakPeriod;
+
+	p->stats.loops++;
+	p->stats.sumTicks += ticks;
+	if (duration < p->stats.min) p->stats.min = duration;
+	if (duration > p->stats.max) p->stats.max = duration;
+	if (duration < NPT_HISTOGRAM_SIZE)
+		p->histogram[(int)duration]++;
+	else p->stats.overruns++;
+}
+
+int npt_soak_init();
+uint64_t npt_soak_rotate(uint64_t now);
+void npt_soak_stop();
+void npt_soak_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_SOAK_H */
@@ -0,0 +1,81 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SPIKES_H
+#define NPT_SPIKES_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Default number of spikes kept for the analysis
+ */
+#define NPT_DEFAULT_MAX_SPIKES	262144
+
+/**
+ * Default width of the bins of the spike series (microseconds)
+ */
+#define NPT_DEFAULT_SPIKE_BIN	100
+
+/**
+ * Number of bins of each segment of the spike series whose spectra
+ * are averaged, and number of periods to report
+ */
+#define NPT_PERIODICITY_SEGMENT	(1 << 20)
+#define NPT_PERIODICITY_TOP	5
+
+/**
+ * A loop that took longer than the threshold
+ */
+struct npt_spike {
+	uint64_t tsc;		/* timestamp at the end of the loop */
+	uint64_t at;		/* ticks elapsed since the start of the run */
+	uint64_t ticks;		/* duration of the loop */
+};
+
+/**
+ * The spikes buffer, its capacity and the number of spikes seen, which
+ * can be greater than the capacity
+ */
+extern struct npt_spike *spikes;
+extern uint64_t spikesSize;
+extern uint64_t spikesCount;
+
+/**
+ * Threshold in ticks, UINT64_MAX when not in use
+ */
+extern uint64_t spikeTicks;
+
+/**
+ * Record a loop that took longer than the threshold
+ */
+static __inline__ void npt_spike_record(uint64_t tsc, uint64_t at, uint64_t ticks) {
+	if (spikesCount < spikesSize) {
+		struct npt_spike *s = &spikes[spikesCount];
+		s->tsc = tsc;
+		s->at = at;
+		s->ticks = ticks;
+	}
+	__atomic_store_n(&spikesCount, spikesCount + 1, __ATOMIC_RELEASE);
+}
+
+int npt_spikes_init();
+void npt_spikes_free();
+void npt_periodicity_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_SPIKES_H */
@@ -0,0 +1,62 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_STOLEN_H
+#define NPT_STOLEN_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Default interval of the stolen time accounting (microseconds), and
+ * how many times the baseline a loop must take to be a slow one when
+ * no threshold is given
+ */
+#define NPT_DEFAULT_STOLEN_INTERVAL	1000000
+#define NPT_STOLEN_FACTOR		2
+
+/**
+ * Bursts are binned by the power of two of their length in loops
+ */
+#define NPT_STOLEN_BURST_BINS		32
+
+/**
+ * Ticks over which a loop is slow, UINT64_MAX until the baseline is
+ * known, and length of the burst of slow loops in progress
+ */
+extern uint64_t stolenSlowTicks;
+extern uint64_t stolenBurstLoops;
+
+void npt_stolen_reset();
+void npt_stolen_baseline(uint64_t ticks);
+void npt_stolen_slow(uint64_t ticks);
+void npt_stolen_burst_end();
+uint64_t npt_stolen_event(uint64_t now);
+void npt_stolen_finish(uint64_t now);
+void npt_stolen_print(FILE *fd, const char *prefix);
+
+/**
+ * Account a loop duration: the time stolen from the loop is its excess
+ * over the baseline, the shortest loop, when it is a slow one
+ */
+static __inline__ void npt_stolen_account(uint64_t ticks) {
+	if (ticks > stolenSlowTicks) npt_stolen_slow(ticks);
+	else if (stolenBurstLoops > 0) npt_stolen_burst_end();
+}
+
+#endif /* NPT_STOLEN_H */
@@ -0,0 +1,45 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_SUMMARY_H
+#define NPT_SUMMARY_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Quantiles compared between the runs of the load, sweep and scenario
+ * modes
+ */
+#define NPT_SUMMARY_QUANTILES	3
+
+/**
+ * The results of a run compared with the other ones
+ */
+struct npt_summary {
+	uint64_t loops;
+	uint64_t overruns;
+	double min, mean, max, stdDeviation;
+	double quantiles[NPT_SUMMARY_QUANTILES];
+};
+
+void npt_summary_fill(struct npt_summary *s);
+void npt_summary_print_header(FILE *fd);
+void npt_summary_print(FILE *fd, const struct npt_summary *s);
+
+#endif /* NPT_SUMMARY_H */
@@ -0,0 +1,56 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_TSC_H
+#define NPT_TSC_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Default interval between two pairings of the loop ticks with
+ * CLOCK_MONOTONIC_RAW (microseconds), and default tolerance on the
+ * frequency measured in each interval (ppm)
+ */
+#define NPT_DEFAULT_TSC_INTERVAL	1000000
+#define NPT_DEFAULT_TSC_TOLERANCE	50.0
+
+/**
+ * A pairing of the ticks summed by the loop with the raw monotonic
+ * clock
+ */
+struct npt_tsc_sample {
+	uint64_t loops;
+	uint64_t ticks;
+	uint64_t ns;
+};
+
+/**
+ * Frequency of the TSC measured by npt_tsc_calibrate, 0 if it was not
+ */
+extern double tscHz;
+
+double npt_tsc_calibrate();
+int npt_tsc_start();
+void npt_tsc_record(const struct npt_tsc_sample *s);
+void npt_tsc_stop();
+double npt_tsc_scale(uint64_t at);
+void npt_tsc_free();
+void npt_tsc_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_TSC_H */
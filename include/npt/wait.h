@@ -0,0 +1,83 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_WAIT_H
+#define NPT_WAIT_H
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>	// FILE
+
+/**
+ * Default period of the event of the wait strategies mode, time spent
+ * polling before blocking by the spin strategy (microseconds) and number
+ * of events per strategy when no duration is given
+ */
+#define NPT_DEFAULT_WAIT_PERIOD	1000
+#define NPT_DEFAULT_WAIT_SPIN	50
+#define NPT_DEFAULT_WAIT_EVENTS	10000
+
+/**
+ * Number of wait strategies, and maximum number of runs of the mode
+ */
+#define NPT_WAIT_STRATEGIES	5
+#define NPT_WAIT_MAX_RUNS	16
+
+/**
+ * Number of quantiles of the response latency in the comparison
+ */
+#define NPT_WAIT_QUANTILES	4
+
+/**
+ * The wait strategies: poll the clock, poll it for a while then sleep
+ * up to the event, sleep up to it, block on a timerfd, or on an epoll
+ * set watching the timerfd
+ */
+enum npt_wait_strategy {
+	NPT_WAIT_BUSY,
+	NPT_WAIT_SPIN,
+	NPT_WAIT_SLEEP,
+	NPT_WAIT_TIMERFD,
+	NPT_WAIT_EPOLL,
+};
+
+/**
+ * A run of the wait strategies mode. The response latencies, from the
+ * event to the time the thread handles it, are in nanoseconds.
+ */
+struct npt_wait_run {
+	int strategy;
+	int done;
+	int error;
+	uint64_t events;
+	uint64_t missed;
+	uint64_t wakeups;
+	double wall;
+	double cpu;
+	double mean;
+	double max;
+	double quantiles[NPT_WAIT_QUANTILES];
+};
+
+int npt_wait_init();
+int npt_wait_runs();
+const char *npt_wait_name(int strategy);
+const struct npt_wait_run *npt_wait_result(int run);
+int npt_wait_cycle();
+void npt_wait_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_WAIT_H */
@@ -0,0 +1,38 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_WORKLOAD_H
+#define NPT_WORKLOAD_H
+
+#include <stdio.h>	// FILE
+
+#include <npt/plugin.h>
+
+/**
+ * The measured function of the workload plugin and its context, NULL
+ * when no plugin is loaded
+ */
+extern npt_plugin_workload_t workloadFunction;
+extern void *workloadContext;
+
+int npt_workload_init();
+void npt_workload_warmup();
+void npt_workload_free();
+void npt_workload_print(FILE *fd, const char *prefix);
+
+#endif /* NPT_WORKLOAD_H */
@@ -0,0 +1,111 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <npt/npt.h>
+#include <npt/chase.h>
+#include <npt/numa.h>
+
+/** Current position in the chain and elements walked in each loop */
+struct npt_chase_line *chaseCursor = NULL;
+unsigned int chaseHops = NPT_DEFAULT_CHASE_HOPS;
+
+/** The working set */
+static struct npt_chase_line *chaseLines = NULL;
+static size_t chaseSize = 0;
+
+/**
+ * Build the pointer chain over the working set. The lines are linked
+ * in the order of a random cyclic permutation (Sattolo's algorithm), so
+ * that the chain goes through every line before coming back and the
+ * prefetchers cannot guess the next one.
+ *
+ * Must be called once pinned on the measured CPU, so that the working
+ * set is allocated on its local NUMA node.
+ */
+int npt_chase_init() {
+	uint64_t i, j, n, seed = 88172645463325252ULL, tmp;
+	uint64_t *perm;
+
+	n = globalArgs.pointer_chase / NPT_CHASE_LINE;
+	if (n < 2) n = 2;
+
+	// Keep the chain of a previous run over the same working set
+	chaseHops = globalArgs.chase_hops;
+	if (chaseLines != NULL && chaseSize == n * NPT_CHASE_LINE) {
+		chaseCursor = &chaseLines[0];
+		return EXIT_SUCCESS;
+	}
+	npt_chase_free();
+	chaseSize = n * NPT_CHASE_LINE;
+
+	chaseLines = npt_alloc_local(chaseSize, "pointer chase working set");
+	if (chaseLines == NULL) return EXIT_FAILURE;
+
+	perm = malloc(n * sizeof(uint64_t));
+	if (perm == NULL) {
+		fprintf(stderr, "Error: unable to allocate the pointer chase permutation.\n");
+		npt_chase_free();
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < n; i++) perm[i] = i;
+	for (i = n - 1; i > 0; i--) {
+		// xorshift64*, j is drawn in [0, i[
+		seed ^= seed >> 12;
+		seed ^= seed << 25;
+		seed ^= seed >> 27;
+		j = ((seed * 2685821657736338717ULL) >> 11) % i;
+		tmp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = tmp;
+	}
+	for (i = 0; i < n; i++)
+		chaseLines[i].next = &chaseLines[perm[i]];
+	free(perm);
+
+	chaseCursor = &chaseLines[0];
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Release the working set
+ */
+void npt_chase_free() {
+	npt_free_local(chaseLines);
+	chaseLines = NULL;
+	chaseCursor = NULL;
+}
+
+/**
+ * Print the working set of the pointer chase mode
+ */
+void npt_chase_print(FILE *fd, const char *prefix) {
+	if (chaseLines == NULL) return;
+
+	if (chaseSize >= (1 << 20))
+		fprintf(fd, "%sPointer chase:	%.1f MiB", prefix, (double)chaseSize / (1 << 20));
+	else
+		fprintf(fd, "%sPointer chase:	%.1f KiB", prefix, (double)chaseSize / (1 << 10));
+	fprintf(fd, " (%zu lines), %u hop(s) per loop\n", chaseSize / NPT_CHASE_LINE, chaseHops);
+}
@@ -0,0 +1,279 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// sqrt, ceil, floor
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// qsort, EXIT_SUCCESS, EXIT_FAILURE
+
+#include <npt/npt.h>
+#include <npt/converge.h>
+#include <npt/housekeeping.h>
+#include <npt/numa.h>
+#include <npt/signals.h>
+
+/**
+ * Quantile of the normal distribution for the 95% confidence intervals
+ */
+#define NPT_CONVERGE_Z	1.96
+
+/**
+ * States of the warm-up and of the early stop during a run
+ */
+#define NPT_CONVERGE_OFF	0
+#define NPT_CONVERGE_RUNNING	1
+#define NPT_CONVERGE_REACHED	2
+#define NPT_CONVERGE_TIMEOUT	3
+
+/** The durations of the current warm-up window */
+static double *warmupWindow = NULL;
+static unsigned int warmupCount = 0;
+
+/** Progress of the warm-up */
+static int warmupState = NPT_CONVERGE_OFF;
+static uint64_t warmupLoops = 0, warmupTicks = 0, warmupWindows = 0;
+static unsigned int warmupStable = 0;
+static double warmupMedian = 0.0, warmupTail = 0.0;
+
+/** Progress of the early stop, and the thread which checks it */
+static int convergeState = NPT_CONVERGE_OFF;
+static pthread_t convergeThread;
+static int convergeStopping;
+static bool convergeStarted = false;
+
+/**
+ * Allocate the warm-up window if the warm-up is adaptive, once pinned
+ * on the measured CPU
+ */
+int npt_converge_init() {
+	if (globalArgs.nocountloop != NPT_NOCOUNTLOOP_AUTO || warmupWindow != NULL)
+		return EXIT_SUCCESS;
+
+	warmupWindow = npt_alloc_local(sizeof(double) * NPT_WARMUP_WINDOW, "warm-up window");
+	return (warmupWindow != NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Free the warm-up window
+ */
+void npt_converge_free() {
+	npt_free_local(warmupWindow);
+	warmupWindow = NULL;
+}
+
+/**
+ * The bounds of the confidence interval are bins of the histogram, which
+ * it spans whole: it is tight enough once their width is, which it never
+ * is for a percentile in the first bins, below the resolution
+ */
+static bool _converged(uint64_t low, uint64_t value, uint64_t high) {
+	return (double)(high + 1 - low) <= 2.0 * globalArgs.converge_precision / 100.0 * (double)value;
+}
+
+/**
+ * Check the early stop every NPT_CONVERGE_PERIOD, away from the loop so
+ * that the scan of the histogram is not timed. The loop is asked to stop
+ * through the requests it already polls, as for a signal.
+ */
+static void *_converge_thread(void *arg) {
+	uint64_t low, value, high;
+	unsigned int ms = 0;
+	(void)arg;
+
+	while (!__atomic_load_n(&convergeStopping, __ATOMIC_ACQUIRE)) {
+		// Wake up every 10ms to check if we must stop
+		npt_housekeeping_sleep(10);
+		ms += 10;
+		if (ms < NPT_CONVERGE_PERIOD / 1000) continue;
+		ms = 0;
+
+		if (npt_converge_interval(globalArgs.converge, &low, &value, &high) == EXIT_SUCCESS
+			&& _converged(low, value, high)) {
+			convergeState = NPT_CONVERGE_REACHED;
+			__atomic_or_fetch(&signalPending, NPT_SIGNAL_CONVERGED, __ATOMIC_RELEASE);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Reset the warm-up and start the check of the early stop before a run
+ */
+int npt_converge_start() {
+	warmupCount = 0;
+	warmupLoops = 0;
+	warmupTicks = 0;
+	warmupWindows = 0;
+	warmupStable = 0;
+	warmupState = (warmupWindow != NULL) ? NPT_CONVERGE_RUNNING : NPT_CONVERGE_OFF;
+
+	convergeState = (globalArgs.converge > 0) ? NPT_CONVERGE_RUNNING : NPT_CONVERGE_OFF;
+	if (convergeState == NPT_CONVERGE_OFF) return EXIT_SUCCESS;
+
+	convergeStopping = 0;
+	if (npt_housekeeping_start(&convergeThread, "npt-converge", _converge_thread, NULL)
+		!= EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	convergeStarted = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Stop the check of the early stop at the end of a run, dropping its
+ * request if the run ended first
+ */
+void npt_converge_stop() {
+	if (!convergeStarted) return;
+	__atomic_store_n(&convergeStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(convergeThread);
+	convergeStarted = false;
+	__atomic_and_fetch(&signalPending, ~NPT_SIGNAL_CONVERGED, __ATOMIC_RELEASE);
+}
+
+static int _compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * A window quantile is settled if it moved by less than the tolerance,
+ * or by one tick
+ */
+static int _settled(double value, double previous) {
+	return fabs(value - previous) <= NPT_WARMUP_TOLERANCE * previous + globalArgs.cpuPeriod;
+}
+
+/**
+ * Account a loop of the adaptive warm-up, called from the loop instead
+ * of counting it. Returns NPT_NOCOUNTLOOP_AUTO while the distribution of
+ * the windows has not settled, 0 once it has.
+ */
+int npt_warmup_account(double duration, uint64_t ticks) {
+	double median, tail;
+
+	if (warmupWindow == NULL) return 0;
+
+	warmupLoops++;
+	warmupTicks += ticks;
+	if (warmupTicks >= (uint64_t)NPT_WARMUP_MAX_TIME * globalArgs.cpuHz) {
+		warmupState = NPT_CONVERGE_TIMEOUT;
+		return 0;
+	}
+
+	warmupWindow[warmupCount++] = duration;
+	if (warmupCount < NPT_WARMUP_WINDOW) return NPT_NOCOUNTLOOP_AUTO;
+	warmupCount = 0;
+
+	// Sorting is fine here, the loops of the warm-up are not measured
+	qsort(warmupWindow, NPT_WARMUP_WINDOW, sizeof(double), _compare_double);
+	median = warmupWindow[NPT_WARMUP_WINDOW / 2];
+	tail = warmupWindow[NPT_WARMUP_WINDOW * 99 / 100];
+
+	if (warmupWindows > 0 && _settled(median, warmupMedian) && _settled(tail, warmupTail))
+		warmupStable++;
+	else warmupStable = 0;
+	warmupWindows++;
+	warmupMedian = median;
+	warmupTail = tail;
+
+	if (warmupStable < NPT_WARMUP_STABLE) return NPT_NOCOUNTLOOP_AUTO;
+	warmupState = NPT_CONVERGE_REACHED;
+	return 0;
+}
+
+/**
+ * Distribution-free 95% confidence interval of a percentile, from the
+ * histogram at its resolution: the bounds are the order statistics at
+ * the ranks n.q -/+ z.sqrt(n.p.q). The histogram is scanned down from
+ * the maximum, so that the cost is the width of the tail only.
+ */
+int npt_converge_interval(double percentile, uint64_t *low, uint64_t *value, uint64_t *high) {
+	double q = 1.0 - percentile / 100.0, tail, spread;
+	uint64_t ranks[3], cumulated = histogramOverruns;
+	uint64_t *bins[3] = { high, value, low };
+	int b, r = 0;
+
+	if (counter == 0) return EXIT_FAILURE;
+
+	// Ranks counted from the top, there must be enough loops in the tail
+	tail = (double)counter * q;
+	spread = NPT_CONVERGE_Z * sqrt((double)counter * q * (1.0 - q));
+	if (tail - spread < 1.0) return EXIT_FAILURE;
+	ranks[0] = (uint64_t)ceil(tail - spread);
+	ranks[1] = (uint64_t)ceil(tail);
+	ranks[2] = (uint64_t)floor(tail + spread) + 1;
+	if (ranks[2] > counter) ranks[2] = counter;
+
+	// The upper bound is in the overruns, there is no interval
+	if (cumulated >= ranks[0]) return EXIT_FAILURE;
+
+	b = (maxDuration < NPT_HISTOGRAM_SIZE) ? (int)maxDuration : NPT_HISTOGRAM_SIZE - 1;
+	for (; b >= 0 && r < 3; b--) {
+		cumulated += histogram[b];
+		while (r < 3 && cumulated >= ranks[r]) *bins[r++] = b;
+	}
+
+	return (r == 3) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Print the result of the warm-up and of the early stop
+ */
+void npt_converge_print(FILE *fd, const char *prefix) {
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	uint64_t low, value, high;
+	bool bounded;
+
+	if (warmupState == NPT_CONVERGE_REACHED)
+		fprintf(fd, "%sWarm-up:	%" PRIu64 " loops, settled at a median of %.6f %s"
+				" and a p99 of %.6f %s\n", prefix, warmupLoops,
+				warmupMedian, unit, warmupTail, unit);
+	else if (warmupState == NPT_CONVERGE_TIMEOUT)
+		fprintf(fd, "%sWarm-up:	%" PRIu64 " loops, not settled after %ds\n",
+				prefix, warmupLoops, NPT_WARMUP_MAX_TIME);
+
+	if (convergeState == NPT_CONVERGE_OFF) return;
+
+	fprintf(fd, "%sConvergence:	p%g", prefix, globalArgs.converge);
+	bounded = npt_converge_interval(globalArgs.converge, &low, &value, &high) == EXIT_SUCCESS;
+	if (!bounded)
+		fprintf(fd, " not bounded, too few loops in the tail");
+	else
+		fprintf(fd, " at %" PRIu64 " %s, 95%% CI [%" PRIu64 ", %" PRIu64 "]",
+				value, unit, low, high);
+
+	// One bin is already wider than the precision
+	if (bounded && !_converged(value, value, value)) {
+		fprintf(fd, ", %g%% below the resolution of the histogram", globalArgs.converge_precision);
+		if (!globalArgs.picoseconds)
+			fprintf(fd, " (see %s)", globalArgs.nanoseconds ? "--picoseconds" : "--nanoseconds");
+		fprintf(fd, "\n");
+	} else if (convergeState == NPT_CONVERGE_REACHED)
+		fprintf(fd, ", reached within %g%% after %" PRIu64 " loops\n",
+				globalArgs.converge_precision, counter);
+	else
+		fprintf(fd, ", %g%% not reached before the end of the run\n",
+				globalArgs.converge_precision);
+}
@@ -0,0 +1,430 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <math.h>	// sqrt, ceil
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t, UINT64_MAX
+#include <stdio.h>
+#include <stdlib.h>	// EXIT_SUCCESS, EXIT_FAILURE
+
+#if defined(WITH_LTTNG_UST) && defined(HAVE_LIBLTTNG_UST)
+	#define TRACEPOINT_DEFINE
+#endif /* WITH_LTTNG_UST && HAVE_LIBLTTNG_UST */
+#include <npt/npt.h>
+#include <npt/chase.h>
+#include <npt/converge.h>
+#include <npt/numa.h>
+#include <npt/replay.h>
+#include <npt/signals.h>
+#include <npt/shm.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+#include <npt/spikes.h>
+#include <npt/stolen.h>
+#include <npt/workload.h>
+
+/** Statistics variables */
+uint64_t counter;
+uint64_t sumTicks;
+double multi;
+double minDuration, maxDuration, sumDuration, meanDuration;
+double meanSquared;
+double variance_n, stdDeviation;
+#if defined(WITH_LTTNG_UST) && defined(ENABLE_TRACEPOINT_FREQUENCY)
+	uint64_t tpnb;
+#endif /* WITH_LTTNG_UST && ENABLE_TRACEPOINT_FREQUENCY */
+
+/** The array used to store the histogram, local to the measured CPU */
+uint64_t *histogram = NULL;
+
+/** counter for bigger values than histogram size */
+uint64_t histogramOverruns;
+
+/** Ticks elapsed in the counted loops with a plugin workload */
+uint64_t wallTicks;
+
+/**
+ * Allocate the histogram on the node of the measured CPU, so once pinned
+ */
+int npt_histogram_init() {
+	if (histogram != NULL) return EXIT_SUCCESS;
+	histogram = npt_alloc_local(sizeof(uint64_t) * NPT_HISTOGRAM_SIZE, "histogram");
+	return (histogram != NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Free the histogram
+ */
+void npt_histogram_free() {
+	npt_free_local(histogram);
+	histogram = NULL;
+}
+
+/**
+ * Reset the statistics before a run
+ */
+void reset_statistics() {
+	int i;
+
+	counter = 0;
+	sumTicks = 0;
+	wallTicks = 0;
+
+	// General statistics
+	minDuration = 99999.0;
+	maxDuration = 0.0;
+	sumDuration = 0.0;
+
+	// For variance and standard deviation
+	meanDuration = 0.0;
+	meanSquared = 0.0;
+	variance_n = 0.0;
+	stdDeviation = 0.0;
+
+	// Histogram
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++) histogram[i] = 0;
+	histogramOverruns = 0;
+
+	// Spikes
+	spikesCount = 0;
+
+	// Sketch
+	npt_sketch_reset();
+
+	// Stolen time
+	npt_stolen_reset();
+
+	// Live histogram
+	npt_shm_reset();
+}
+
+/**
+ * Return the ticks elapsed in the counted loops: the sum of their
+ * durations, unless only the calls of a plugin workload are timed
+ */
+uint64_t npt_elapsed_ticks() {
+	return __atomic_load_n((workloadFunction != NULL) ? &wallTicks : &sumTicks,
+			__ATOMIC_RELAXED);
+}
+
+/**
+ * Handle the periodic events of the loop, at the given elapsed ticks,
+ * and return the number of elapsed ticks at which the next one is due
+ */
+static uint64_t _cycle_event(uint64_t now) {
+	uint64_t next, due;
+
+	// Close the stolen time interval
+	next = npt_stolen_event(now);
+
+	// Rotate the soak period
+	if (soakPeriod != NULL) {
+		due = npt_soak_rotate(now);
+		if (due < next) next = due;
+	}
+
+	// Publish the live statistics
+	if (shmBuckets != NULL) {
+		due = npt_shm_event(now);
+		if (due < next) next = due;
+	}
+
+	return next;
+}
+
+/**
+ * Workloads of the loop
+ */
+#define NPT_WORKLOAD_NONE	0
+#define NPT_WORKLOAD_CHASE	1
+#define NPT_WORKLOAD_PLUGIN	2
+
+/**
+ * The loop, inlined with a constant workload so that each workload gets
+ * its own copy of the loop, and the empty one pays nothing for the others
+ */
+static __inline__ __attribute__((always_inline)) int _cycle_loop(const int workload) {
+	double duration = 0;
+	uint64_t ticks = 0, wall = 0;
+	uint64_t t0, t1;
+	int nocount = globalArgs.nocountloop;
+	struct npt_chase_line *chase = chaseCursor;
+	npt_plugin_workload_t plugin = workloadFunction;
+	void *pluginContext = workloadContext;
+
+	TPMAXFREQ_WORK_INIT
+
+	// For variance and standard deviation
+	double deltaDuration = 0.0;
+
+	// Windows mode
+	WINDOW_WORK_INIT
+
+	// Time declaration for the first loop
+	t0 = NPT_TIMESTAMP();
+	t1 = t0;
+
+	// The duration is compared in ticks, which are summed exactly
+	uint64_t compareMax;
+	uint64_t* compareMin;
+	if (globalArgs.duration > 0) {
+		compareMax = (uint64_t)((double)globalArgs.duration / globalArgs.cpuPeriod);
+		compareMin = &sumTicks;
+	} else {
+		compareMax = globalArgs.loops;
+		compareMin = &counter;
+	}
+
+	// The elapsed ticks are the summed ones, unless only the calls of
+	// the plugin are timed
+	uint64_t* elapsed = (workload == NPT_WORKLOAD_PLUGIN) ? &wallTicks : &sumTicks;
+
+	// Elapsed ticks at which the next periodic event is due
+	uint64_t nextEvent = _cycle_event(*elapsed);
+
+	UST_TRACE_START
+
+	// We are cycling --nocountloop more times to let the system
+	// enters in the loop period we want to analyze, or until the
+	// distribution settles with the adaptive warm-up
+	duration = 0;
+	while (*compareMin < compareMax) {
+		NPT_TRACE_LOOP
+
+		// Update stat variables
+		if (nocount != 0) {
+			if (nocount == NPT_NOCOUNTLOOP_AUTO)
+				nocount = npt_warmup_account(duration, ticks);
+			else nocount--;
+		} else {
+			// Increment counter as we have done one more loop
+			counter++;
+
+			// General statistics
+			if (duration < minDuration) {
+				minDuration = duration;
+				npt_stolen_baseline(ticks);
+			}
+			if (duration > maxDuration) maxDuration = duration;
+			sumTicks += ticks;
+			if (workload == NPT_WORKLOAD_PLUGIN) wallTicks += wall;
+
+			WINDOW_WORK_LOOP
+
+			// For variance and standard deviation
+			deltaDuration = duration - meanDuration;
+			meanDuration = meanDuration
+				+ deltaDuration / (double)counter;
+			meanSquared = meanSquared
+				+ deltaDuration * (duration - meanDuration);
+
+			// Store data in the histogram if duration < max size
+			if (duration < NPT_HISTOGRAM_SIZE)
+				histogram[(int)duration]++;
+			else histogramOverruns++;
+
+			// Loops over the threshold
+			if (ticks > spikeTicks) npt_spike_record(t0, *elapsed, ticks);
+
+			// Soak mode period histogram
+			if (soakPeriod != NULL) npt_soak_account(duration, ticks);
+
+			// Raw dump of the loop durations
+			if (rawDump != NULL) npt_raw_dump_account(ticks);
+
+			// Mergeable sketch of the durations
+			if (sketch != NULL) npt_sketch_account(duration);
+
+			// Time stolen from the loop
+			npt_stolen_account(ticks);
+
+			// Live histogram
+			if (shmBuckets != NULL) npt_shm_account(ticks);
+
+			// Periodic events
+			if (*elapsed >= nextEvent) nextEvent = _cycle_event(*elapsed);
+
+			// Snapshot or stop requested by a signal, or early stop
+			if (__atomic_load_n(&signalPending, __ATOMIC_RELAXED)
+				&& npt_signal_handle()) break;
+		}
+
+		// Walk the pointer chain
+		if (workload == NPT_WORKLOAD_CHASE)
+			chase = npt_chase_walk(chase, chaseHops);
+
+		if (workload == NPT_WORKLOAD_PLUGIN) {
+			// Only the call of the plugin function is timed, the
+			// loop elapsed from the end of the previous call
+			wall = t0;
+			t1 = NPT_TIMESTAMP();
+			plugin(pluginContext);
+			t0 = NPT_TIMESTAMP();
+			wall = t0 - wall;
+		} else {
+			// Get new t0 from the timestamp source
+			t1 = t0;
+			t0 = NPT_TIMESTAMP();
+		}
+
+		// Calculate diff between t0 and t1, the unsigned
+		// difference is right even if the counter wrapped
+		ticks = t0 - t1;
+		duration = (double)ticks * globalArgs.cpuPeriod;
+	}
+
+	UST_TRACE_STOP
+
+	if (workload == NPT_WORKLOAD_CHASE) chaseCursor = chase;
+
+	finalize_statistics();
+
+	return 0;
+}
+
+/**
+ * Run the loop with the chosen workload
+ */
+int cycle() {
+	int ret;
+
+	if (npt_converge_start() != EXIT_SUCCESS) return EXIT_FAILURE;
+	if (workloadFunction != NULL) {
+		npt_workload_warmup();
+		ret = _cycle_loop(NPT_WORKLOAD_PLUGIN);
+	} else if (chaseCursor != NULL) ret = _cycle_loop(NPT_WORKLOAD_CHASE);
+	else ret = _cycle_loop(NPT_WORKLOAD_NONE);
+	npt_converge_stop();
+	return ret;
+}
+
+/**
+ * Compute the sum, variance and standard deviation at the end of a run
+ */
+void finalize_statistics() {
+	sumDuration = (double)sumTicks * globalArgs.cpuPeriod;
+	variance_n = (counter > 0) ? meanSquared / (double)counter : 0.0;
+	stdDeviation = sqrt(variance_n);
+	npt_stolen_finish(npt_elapsed_ticks());
+	npt_shm_publish(NPT_SHM_IDLE);
+}
+
+/**
+ * Account a block of loop durations, given in ticks, as the loop would
+ * have done. The block statistics are computed first, in loops the
+ * compiler can vectorize, then merged in the running ones.
+ */
+void npt_account_block(const uint64_t *ticks, size_t n) {
+	double duration[NPT_ACCOUNT_BLOCK];
+	double blockMin, blockMax, blockSum = 0.0, blockMean, blockSquared = 0.0;
+	double deltaDuration, total;
+	uint64_t blockTicks = 0, blockMaxTicks = 0, at, now, next;
+	size_t i;
+
+	while (n > NPT_ACCOUNT_BLOCK) {
+		npt_account_block(ticks, NPT_ACCOUNT_BLOCK);
+		ticks += NPT_ACCOUNT_BLOCK;
+		n -= NPT_ACCOUNT_BLOCK;
+	}
+	if (n == 0) return;
+
+	// Durations and sums
+	for (i = 0; i < n; i++) {
+		duration[i] = (double)ticks[i] * globalArgs.cpuPeriod;
+		blockTicks += ticks[i];
+		blockMaxTicks = (ticks[i] > blockMaxTicks) ? ticks[i] : blockMaxTicks;
+		blockSum += duration[i];
+	}
+	blockMean = blockSum / (double)n;
+
+	// Extremes and squared differences to the block mean
+	blockMin = blockMax = duration[0];
+	for (i = 0; i < n; i++) {
+		double d = duration[i] - blockMean;
+		blockSquared += d * d;
+		blockMin = (duration[i] < blockMin) ? duration[i] : blockMin;
+		blockMax = (duration[i] > blockMax) ? duration[i] : blockMax;
+	}
+
+	// Merge with the running statistics (Chan et al.)
+	if (blockMin < minDuration) minDuration = blockMin;
+	if (blockMax > maxDuration) maxDuration = blockMax;
+	total = (double)(counter + n);
+	deltaDuration = blockMean - meanDuration;
+	meanDuration += deltaDuration * (double)n / total;
+	meanSquared += blockSquared
+		+ deltaDuration * deltaDuration * (double)counter * (double)n / total;
+	at = sumTicks;
+	counter += n;
+	sumTicks += blockTicks;
+
+	// Time stolen from the loop, with its intervals closed on time
+	now = at;
+	next = npt_stolen_event(now);
+	for (i = 0; i < n; i++) {
+		npt_stolen_baseline(ticks[i]);
+		npt_stolen_account(ticks[i]);
+		now += ticks[i];
+		if (now >= next) next = npt_stolen_event(now);
+	}
+
+	// Loops over the threshold, without a timestamp
+	if (blockMaxTicks > spikeTicks) {
+		for (i = 0; i < n; i++) {
+			at += ticks[i];
+			if (ticks[i] > spikeTicks) npt_spike_record(0, at, ticks[i]);
+		}
+	}
+
+	// Store data in the histogram if duration < max size
+	for (i = 0; i < n; i++) {
+		if (duration[i] < NPT_HISTOGRAM_SIZE)
+			histogram[(int)duration[i]]++;
+		else histogramOverruns++;
+	}
+
+	// Mergeable sketch of the durations
+	if (sketch != NULL)
+		for (i = 0; i < n; i++) npt_sketch_account(duration[i]);
+}
+
+/**
+ * Compute several percentiles from the histogram in one scan, the
+ * fractions being sorted in increasing order. The values are the lower
+ * bound of their bucket, or the maximum duration for the overruns.
+ */
+void npt_histogram_percentiles(const double *fractions, double *values, int n) {
+	uint64_t total = 0, sum = 0, rank;
+	int i, j = 0;
+
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++) total += histogram[i];
+	total += histogramOverruns;
+
+	for (i = 0; i < NPT_HISTOGRAM_SIZE && j < n; i++) {
+		sum += histogram[i];
+		while (j < n) {
+			rank = (uint64_t)ceil(fractions[j] * (double)total);
+			if (rank == 0) rank = 1;
+			if (sum < rank) break;
+			values[j++] = (double)i;
+		}
+	}
+	for (; j < n; j++) values[j] = maxDuration;
+}
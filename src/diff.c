@@ -0,0 +1,588 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <dirent.h>	// scandir
+#include <getopt.h>	// getopt_long
+#include <inttypes.h>	// PRIu64, SCNu64
+#include <math.h>	// sqrt, log, exp, ceil, fabs
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strcmp, strncmp, strlen
+#include <sys/stat.h>	// stat
+
+#include <npt/npt.h>
+#include <npt/soak.h>
+#include <version.h>
+
+/**
+ * Default significance level of the distribution test, relative shift
+ * of a percentile to consider it relevant and number of bootstrap draws
+ */
+#define NPT_DIFF_DEFAULT_ALPHA		0.01
+#define NPT_DIFF_DEFAULT_TOLERANCE	10
+#define NPT_DIFF_DEFAULT_BOOTSTRAPS	2000
+
+/**
+ * Exit codes, so that npt-diff can be used as a pass/fail gate
+ */
+#define NPT_DIFF_SIMILAR	0
+#define NPT_DIFF_DIFFERENT	1
+#define NPT_DIFF_ERROR		2
+
+/**
+ * A loaded histogram, reduced to its non-empty buckets. The overruns
+ * are stored as a last bucket at the maximum recorded duration (or at
+ * the histogram size when the maximum is unknown).
+ */
+struct npt_diff_histogram {
+	const char *name;
+	int unit;
+	double max;
+	uint64_t *counts;	// loaded histogram, NPT_HISTOGRAM_SIZE + 1
+	uint64_t overruns;
+
+	size_t size;
+	double *values;
+	uint64_t *cumulated;
+	uint64_t total;
+};
+
+/** The options */
+static struct {
+	double alpha;
+	double tolerance;
+	unsigned int bootstraps;
+	uint64_t seed;
+} diffArgs;
+
+/** The percentiles to compare */
+static const double diffPercentiles[] = { 0.5, 0.9, 0.99, 0.999, 0.9999, 0.99999 };
+#define NPT_DIFF_PERCENTILES (sizeof(diffPercentiles) / sizeof(diffPercentiles[0]))
+
+static const char *diffUnits[] = { "us", "ns", "ps" };
+
+/**
+ * Show help message
+ */
+static void _help() {
+	printf("npt histograms comparison (npt-diff) %s\n", FULL_VERSION);
+	printf(	"usage: npt-diff <options> BASELINE RUN [RUN...]\n\n"
+		"Compare the latency distribution of each RUN with the one of BASELINE.\n"
+		"Each file is either an output file of npt (-o option), a checkpoint file\n"
+		"or a checkpoint directory (--checkpoint option) whose periods are merged.\n\n"
+		"	-a ALPHA	--alpha=ALPHA		significance level of the Kolmogorov-Smirnov\n"
+		"						test (default: %g)\n"
+		"	-b NB		--bootstraps=NB		number of bootstrap draws for the confidence\n"
+		"						intervals (default: %d)\n"
+		"	-h		--help			show this message\n"
+		"	-s SEED		--seed=SEED		seed of the bootstrap draws\n"
+		"	-t PCT		--tolerance=PCT		relative shift of a percentile, in percent,\n"
+		"						under which it is not a regression (default: %d)\n"
+		"	-V		--version		show the tool version\n\n"
+		"Exit status: %d when the distributions are similar, %d when they differ,\n"
+		"%d on error.\n",
+		NPT_DIFF_DEFAULT_ALPHA,
+		NPT_DIFF_DEFAULT_BOOTSTRAPS,
+		NPT_DIFF_DEFAULT_TOLERANCE,
+		NPT_DIFF_SIMILAR, NPT_DIFF_DIFFERENT, NPT_DIFF_ERROR
+	      );
+}
+
+/**
+ * Load an output file of npt: the histogram lines, the unit, the
+ * maximum and the overruns
+ */
+static int _load_output(FILE *fd, struct npt_diff_histogram *h) {
+	char line[256], unit[8];
+	uint64_t count;
+	int i;
+
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		if (line[0] == '#') {
+			if (sscanf(line, "# The time values are expressed in %2s.", unit) == 1) {
+				for (i = 0; i < 3; i++)
+					if (strcmp(unit, diffUnits[i]) == 0) h->unit = i;
+			} else if (sscanf(line, "#	max: %lf", &h->max) == 1) {
+				continue;
+			} else {
+				sscanf(line, "# Overruns (%*d+): %" SCNu64, &h->overruns);
+			}
+			continue;
+		}
+		if (sscanf(line, "%d %" SCNu64, &i, &count) != 2) continue;
+		if (i < 0 || i >= NPT_HISTOGRAM_SIZE) {
+			fprintf(stderr, "Error: '%s' has an invalid histogram line: %s", h->name, line);
+			return EXIT_FAILURE;
+		}
+		h->counts[i] += count;
+	}
+
+	if (h->unit < 0) {
+		fprintf(stderr, "Error: '%s' is neither an output file nor a checkpoint.\n", h->name);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Load a checkpoint file and add its histogram to the given one
+ */
+static int _load_checkpoint(FILE *fd, const char *filename, struct npt_diff_histogram *h) {
+	struct npt_checkpoint_header header;
+	struct npt_checkpoint_bucket bucket;
+	uint64_t i, hash = NPT_FNV1A_INIT, checksum;
+
+	if (fread(&header, sizeof(header), 1, fd) != 1
+		|| strncmp(header.magic, NPT_CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != NPT_CHECKPOINT_VERSION || header.unit > 2) {
+		fprintf(stderr, "Error: '%s' is not a valid checkpoint file.\n", filename);
+		return EXIT_FAILURE;
+	}
+	if (h->unit >= 0 && h->unit != (int)header.unit) {
+		fprintf(stderr, "Error: '%s' was not recorded in %s.\n", filename, diffUnits[h->unit]);
+		return EXIT_FAILURE;
+	}
+	h->unit = header.unit;
+	hash = npt_fnv1a(hash, &header, sizeof(header));
+
+	for (i = 0; i < header.buckets; i++) {
+		if (fread(&bucket, sizeof(bucket), 1, fd) != 1
+			|| bucket.index >= NPT_HISTOGRAM_SIZE) {
+			fprintf(stderr, "Error: '%s' is truncated or corrupted.\n", filename);
+			return EXIT_FAILURE;
+		}
+		hash = npt_fnv1a(hash, &bucket, sizeof(bucket));
+		h->counts[bucket.index] += bucket.count;
+	}
+
+	if (fread(&checksum, sizeof(checksum), 1, fd) != 1 || checksum != hash) {
+		fprintf(stderr, "Error: '%s' has an invalid checksum.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	h->overruns += header.stats.overruns;
+	if (header.stats.max > h->max) h->max = header.stats.max;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Load a file, guessing its format from its first bytes
+ */
+static int _load_file(const char *filename, struct npt_diff_histogram *h) {
+	char magic[8];
+	FILE *fd;
+	int ret;
+
+	fd = fopen(filename, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in read mode.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(magic, sizeof(magic), 1, fd) == 1
+		&& strncmp(magic, NPT_CHECKPOINT_MAGIC, sizeof(magic)) == 0) {
+		rewind(fd);
+		ret = _load_checkpoint(fd, filename, h);
+	} else {
+		rewind(fd);
+		ret = _load_output(fd, h);
+	}
+
+	fclose(fd);
+	return ret;
+}
+
+static int _checkpoint_filter(const struct dirent *entry) {
+	size_t len = strlen(entry->d_name);
+	return strncmp(entry->d_name, "period-", 7) == 0
+		&& len > 4 && strcmp(entry->d_name + len - 4, ".npt") == 0;
+}
+
+/**
+ * Load a histogram from a file or a checkpoint directory, and reduce
+ * it to its non-empty buckets
+ */
+static int _load(const char *name, struct npt_diff_histogram *h) {
+	struct dirent **entries;
+	struct stat st;
+	char *filename;
+	int i, n, ret = EXIT_SUCCESS;
+
+	memset(h, 0, sizeof(*h));
+	h->name = name;
+	h->unit = -1;
+	h->counts = calloc(NPT_HISTOGRAM_SIZE, sizeof(uint64_t));
+	if (h->counts == NULL) {
+		fprintf(stderr, "Error: unable to allocate the histogram of '%s'.\n", name);
+		return EXIT_FAILURE;
+	}
+
+	if (stat(name, &st) == 0 && S_ISDIR(st.st_mode)) {
+		n = scandir(name, &entries, _checkpoint_filter, alphasort);
+		if (n <= 0) {
+			fprintf(stderr, "Error: no checkpoint found in '%s'.\n", name);
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < n; i++) {
+			if (ret == EXIT_SUCCESS) {
+				if (asprintf(&filename, "%s/%s", name, entries[i]->d_name) < 0)
+					ret = EXIT_FAILURE;
+				else {
+					ret = _load_file(filename, h);
+					free(filename);
+				}
+			}
+			free(entries[i]);
+		}
+		free(entries);
+	} else {
+		ret = _load_file(name, h);
+	}
+	if (ret != EXIT_SUCCESS) return ret;
+
+	// Keep the non-empty buckets, with their cumulated counts
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++)
+		if (h->counts[i] > 0) h->size++;
+	if (h->overruns > 0) h->size++;
+	if (h->size == 0) {
+		fprintf(stderr, "Error: '%s' has an empty histogram.\n", name);
+		return EXIT_FAILURE;
+	}
+
+	h->values = malloc(h->size * sizeof(double));
+	h->cumulated = malloc(h->size * sizeof(uint64_t));
+	if (h->values == NULL || h->cumulated == NULL) {
+		fprintf(stderr, "Error: unable to allocate the histogram of '%s'.\n", name);
+		return EXIT_FAILURE;
+	}
+	for (i = 0, n = 0; i < NPT_HISTOGRAM_SIZE; i++) {
+		if (h->counts[i] == 0) continue;
+		h->total += h->counts[i];
+		h->values[n] = (double)i;
+		h->cumulated[n++] = h->total;
+	}
+	if (h->overruns > 0) {
+		h->total += h->overruns;
+		h->values[n] = (h->max > NPT_HISTOGRAM_SIZE) ? h->max : NPT_HISTOGRAM_SIZE;
+		h->cumulated[n] = h->total;
+	}
+
+	free(h->counts);
+	h->counts = NULL;
+	return EXIT_SUCCESS;
+}
+
+static void _free(struct npt_diff_histogram *h) {
+	free(h->counts);
+	free(h->values);
+	free(h->cumulated);
+}
+
+/**
+ * Return the value of the given rank (1 to total), by binary search
+ */
+static double _value_at_rank(const struct npt_diff_histogram *h, uint64_t rank) {
+	size_t lo = 0, hi = h->size - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (h->cumulated[mid] >= rank) hi = mid;
+		else lo = mid + 1;
+	}
+	return h->values[lo];
+}
+
+/**
+ * Return the smallest value whose cumulated fraction reaches p
+ */
+static double _percentile(const struct npt_diff_histogram *h, double p) {
+	uint64_t rank = (uint64_t)ceil(p * (double)h->total);
+	if (rank == 0) rank = 1;
+	if (rank > h->total) rank = h->total;
+	return _value_at_rank(h, rank);
+}
+
+/**
+ * xorshift64* generator, and uniform draw in (0, 1)
+ */
+static double _uniform() {
+	diffArgs.seed ^= diffArgs.seed >> 12;
+	diffArgs.seed ^= diffArgs.seed << 25;
+	diffArgs.seed ^= diffArgs.seed >> 27;
+	return ((double)((diffArgs.seed * 2685821657736338717ULL) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/**
+ * Draw from the standard normal distribution (Box-Muller)
+ */
+static double _normal() {
+	return sqrt(-2.0 * log(_uniform())) * cos(2.0 * M_PI * _uniform());
+}
+
+/**
+ * Draw from the Gamma(a, 1) distribution, for a >= 1 (Marsaglia and
+ * Tsang)
+ */
+static double _gamma(double a) {
+	double d = a - 1.0 / 3.0, c = 1.0 / sqrt(9.0 * d), x, v, u;
+
+	for (;;) {
+		do {
+			x = _normal();
+			v = 1.0 + c * x;
+		} while (v <= 0.0);
+		v = v * v * v;
+		u = _uniform();
+		if (log(u) < 0.5 * x * x + d - d * v + d * log(v))
+			return d * v;
+	}
+}
+
+/**
+ * Draw the given percentile of a bootstrap resample. The k-th smallest
+ * of n resampled values is the empirical quantile of the k-th smallest
+ * of n uniform values, which follows Beta(k, n - k + 1): one draw
+ * replaces resampling the whole histogram.
+ */
+static double _bootstrap_percentile(const struct npt_diff_histogram *h, double p) {
+	double k = ceil(p * (double)h->total), x, y, u;
+	uint64_t rank;
+
+	if (k < 1.0) k = 1.0;
+	x = _gamma(k);
+	y = _gamma((double)h->total - k + 1.0);
+	u = x / (x + y);
+
+	rank = (uint64_t)ceil(u * (double)h->total);
+	if (rank == 0) rank = 1;
+	if (rank > h->total) rank = h->total;
+	return _value_at_rank(h, rank);
+}
+
+static int _compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Two-sample Kolmogorov-Smirnov test on the binned data. The binning
+ * makes ties, which only makes the test conservative.
+ */
+static double _kolmogorov_smirnov(const struct npt_diff_histogram *a,
+		const struct npt_diff_histogram *b, double *pvalue) {
+	double d = 0.0, fa, fb, value, ne, lambda, term, sum = 0.0;
+	size_t i = 0, j = 0;
+	int k;
+
+	while (i < a->size || j < b->size) {
+		if (j >= b->size || (i < a->size && a->values[i] <= b->values[j]))
+			value = a->values[i];
+		else value = b->values[j];
+		while (i < a->size && a->values[i] <= value) i++;
+		while (j < b->size && b->values[j] <= value) j++;
+
+		fa = (i > 0) ? (double)a->cumulated[i - 1] / (double)a->total : 0.0;
+		fb = (j > 0) ? (double)b->cumulated[j - 1] / (double)b->total : 0.0;
+		if (fabs(fa - fb) > d) d = fabs(fa - fb);
+	}
+
+	// Asymptotic distribution of the statistic
+	ne = (double)a->total * (double)b->total / ((double)a->total + (double)b->total);
+	lambda = (sqrt(ne) + 0.12 + 0.11 / sqrt(ne)) * d;
+	for (k = 1; k <= 100; k++) {
+		term = 2.0 * ((k % 2) ? 1.0 : -1.0) * exp(-2.0 * k * k * lambda * lambda);
+		sum += term;
+		if (fabs(term) < 1e-12) break;
+	}
+	*pvalue = (sum > 1.0) ? 1.0 : ((sum < 0.0) ? 0.0 : sum);
+	if (lambda < 0.3) *pvalue = 1.0;
+
+	return d;
+}
+
+/**
+ * Compare a run with the baseline, and return true if they differ
+ */
+static bool _compare(const struct npt_diff_histogram *base, const struct npt_diff_histogram *run) {
+	const char *unit = diffUnits[base->unit];
+	double shifts[NPT_DIFF_PERCENTILES][2], *draws;
+	double b, r, shift, relative, d, pvalue;
+	bool different = false, relevant;
+	unsigned int i, j;
+
+	draws = malloc(diffArgs.bootstraps * sizeof(double));
+	if (draws == NULL) {
+		fprintf(stderr, "Error: unable to allocate the bootstrap draws.\n");
+		exit(NPT_DIFF_ERROR);
+	}
+
+	// 95% confidence interval of the shift of each percentile
+	for (i = 0; i < NPT_DIFF_PERCENTILES; i++) {
+		for (j = 0; j < diffArgs.bootstraps; j++)
+			draws[j] = _bootstrap_percentile(run, diffPercentiles[i])
+				- _bootstrap_percentile(base, diffPercentiles[i]);
+		qsort(draws, diffArgs.bootstraps, sizeof(double), _compare_doubles);
+		shifts[i][0] = draws[(size_t)(0.025 * (diffArgs.bootstraps - 1))];
+		shifts[i][1] = draws[(size_t)ceil(0.975 * (diffArgs.bootstraps - 1))];
+	}
+	free(draws);
+
+	d = _kolmogorov_smirnov(base, run, &pvalue);
+
+	printf("# %s (%" PRIu64 " loops) compared to %s (%" PRIu64 " loops)\n",
+			run->name, run->total, base->name, base->total);
+	printf("percentile	baseline (%s)	run (%s)		shift (%s)	shift (%%)	95%% CI of the shift\n",
+			unit, unit, unit);
+	for (i = 0; i < NPT_DIFF_PERCENTILES; i++) {
+		b = _percentile(base, diffPercentiles[i]);
+		r = _percentile(run, diffPercentiles[i]);
+		shift = r - b;
+		relative = (b > 0.0) ? 100.0 * shift / b : 0.0;
+
+		// A shift is a regression if it is significant, bigger than the
+		// histogram resolution and than the tolerance
+		relevant = (shifts[i][0] > 0.0 || shifts[i][1] < 0.0)
+			&& fabs(shift) > 1.0 && fabs(relative) > diffArgs.tolerance;
+		if (relevant) different = true;
+
+		printf("%g		%.0f		%.0f		%+.0f		%+.2f		[%+.0f, %+.0f]%s\n",
+				diffPercentiles[i] * 100.0, b, r, shift, relative,
+				shifts[i][0], shifts[i][1], relevant ? "	*" : "");
+	}
+	printf("max		%.0f		%.0f		%+.0f\n",
+			base->values[base->size - 1], run->values[run->size - 1],
+			run->values[run->size - 1] - base->values[base->size - 1]);
+
+	printf("Kolmogorov-Smirnov: D = %.6f, p = %.3g (%s at alpha %g)\n", d, pvalue,
+			(pvalue < diffArgs.alpha) ? "different" : "similar", diffArgs.alpha);
+
+	// Both the shape and at least one percentile have to change
+	different = different && pvalue < diffArgs.alpha;
+	printf("Result: %s\n\n", different ? "DIFFERENT" : "SIMILAR");
+
+	return different;
+}
+
+int main(int argc, char **argv) {
+	struct npt_diff_histogram base, run;
+	int c, i, ret = NPT_DIFF_SIMILAR;
+
+	diffArgs.alpha = NPT_DIFF_DEFAULT_ALPHA;
+	diffArgs.tolerance = NPT_DIFF_DEFAULT_TOLERANCE;
+	diffArgs.bootstraps = NPT_DIFF_DEFAULT_BOOTSTRAPS;
+	diffArgs.seed = 88172645463325252ULL;
+
+	for (;;) {
+		static struct option long_options[] = {
+			{"alpha",		required_argument,	0,	'a'},
+			{"bootstraps",		required_argument,	0,	'b'},
+			{"help",		no_argument,		0,	'h'},
+			{"seed",		required_argument,	0,	's'},
+			{"tolerance",		required_argument,	0,	't'},
+			{"version",		no_argument,		0,	'V'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "a:b:hs:t:V", long_options, &option_index);
+		if (c == -1) break;
+
+		switch (c) {
+			// Option -a, --alpha
+			case 'a':
+				if (sscanf(optarg, "%lf", &diffArgs.alpha) != 1
+					|| diffArgs.alpha <= 0.0 || diffArgs.alpha >= 1.0) {
+					fprintf(stderr, "--alpha: argument must be between 0 and 1\n");
+					return NPT_DIFF_ERROR;
+				}
+				break;
+
+			// Option -b, --bootstraps
+			case 'b':
+				if (sscanf(optarg, "%u", &diffArgs.bootstraps) != 1
+					|| diffArgs.bootstraps < 100) {
+					fprintf(stderr, "--bootstraps: argument must be at least 100\n");
+					return NPT_DIFF_ERROR;
+				}
+				break;
+
+			// Option -h, --help
+			case 'h':
+				_help();
+				return NPT_DIFF_SIMILAR;
+
+			// Option -s, --seed
+			case 's':
+				if (sscanf(optarg, "%" SCNu64, &diffArgs.seed) != 1 || diffArgs.seed == 0) {
+					fprintf(stderr, "--seed: argument must be a positive 64bits unsigned int\n");
+					return NPT_DIFF_ERROR;
+				}
+				break;
+
+			// Option -t, --tolerance
+			case 't':
+				if (sscanf(optarg, "%lf", &diffArgs.tolerance) != 1 || diffArgs.tolerance < 0.0) {
+					fprintf(stderr, "--tolerance: argument must be a positive percentage\n");
+					return NPT_DIFF_ERROR;
+				}
+				break;
+
+			// Option -V, --version
+			case 'V':
+				printf("npt histograms comparison (npt-diff) %s\n", FULL_VERSION);
+				return NPT_DIFF_SIMILAR;
+
+			case '?':
+				/* getopt_long already printed an error message. */
+				return NPT_DIFF_ERROR;
+
+			default:
+				abort();
+		}
+	}
+
+	if (argc - optind < 2) {
+		_help();
+		return NPT_DIFF_ERROR;
+	}
+
+	if (_load(argv[optind], &base) != EXIT_SUCCESS) {
+		_free(&base);
+		return NPT_DIFF_ERROR;
+	}
+
+	for (i = optind + 1; i < argc && ret != NPT_DIFF_ERROR; i++) {
+		if (_load(argv[i], &run) != EXIT_SUCCESS) {
+			ret = NPT_DIFF_ERROR;
+		} else if (run.unit != base.unit) {
+			fprintf(stderr, "Error: '%s' is in %s while '%s' is in %s.\n", run.name,
+					diffUnits[run.unit], base.name, diffUnits[base.unit]);
+			ret = NPT_DIFF_ERROR;
+		} else if (_compare(&base, &run)) {
+			ret = NPT_DIFF_DIFFERENT;
+		}
+		_free(&run);
+	}
+
+	_free(&base);
+	return ret;
+}
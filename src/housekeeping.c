@@ -0,0 +1,198 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <pthread.h>	// pthread_*
+#include <sched.h>	// sched_*, CPU_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>	// strerror
+#include <time.h>	// nanosleep, clock_gettime
+#include <unistd.h>	// sysconf
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+
+/**
+ * The housekeeping threads kept away from the measured CPU, re-pinned
+ * when the loop moves to another one
+ */
+#define NPT_HOUSEKEEPING_MAX_THREADS	16
+static pthread_t housekeepingThreads[NPT_HOUSEKEEPING_MAX_THREADS];
+static bool housekeepingUsed[NPT_HOUSEKEEPING_MAX_THREADS];
+static pthread_mutex_t housekeepingLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Build the mask of every online CPU but the measured one, returns false
+ * if there is no other CPU
+ */
+static bool _housekeeping_mask(cpu_set_t *cpuMask) {
+	long nbcpus = sysconf(_SC_NPROCESSORS_CONF);
+	int cpu;
+
+	CPU_ZERO(cpuMask);
+	for (cpu = 0; cpu < nbcpus && cpu < CPU_SETSIZE; cpu++)
+		if (cpu != (int)globalArgs.affinity)
+			CPU_SET(cpu, cpuMask);
+
+	return CPU_COUNT(cpuMask) > 0;
+}
+
+/**
+ * Start a housekeeping thread on the given CPUs
+ */
+int npt_housekeeping_start_on(pthread_t *thread, const char *name,
+		void *(*routine)(void *), void *arg, const cpu_set_t *cpus) {
+	pthread_attr_t attr;
+	struct sched_param schedp;
+	cpu_set_t cpuMask;
+	int ret;
+
+	pthread_attr_init(&attr);
+
+	// Do not inherit the RT scheduler of the measuring thread
+	memset(&schedp, 0, sizeof(schedp));
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	pthread_attr_setschedparam(&attr, &schedp);
+
+	// Keep away from the measured CPU, unless it is the only one
+	if (cpus != NULL) {
+		pthread_attr_setaffinity_np(&attr, sizeof(*cpus), cpus);
+	} else if (_housekeeping_mask(&cpuMask)) {
+		pthread_attr_setaffinity_np(&attr, sizeof(cpuMask), &cpuMask);
+	}
+
+	ret = pthread_create(thread, &attr, routine, arg);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		fprintf(stderr, "Error: unable to start the %s thread, %s (%d)\n",
+				name, strerror(ret), ret);
+		return EXIT_FAILURE;
+	}
+	pthread_setname_np(*thread, name);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Start a housekeeping thread away from the measured CPU
+ */
+int npt_housekeeping_start(pthread_t *thread, const char *name,
+		void *(*routine)(void *), void *arg) {
+	int i;
+
+	if (npt_housekeeping_start_on(thread, name, routine, arg, NULL) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	pthread_mutex_lock(&housekeepingLock);
+	for (i = 0; i < NPT_HOUSEKEEPING_MAX_THREADS; i++) {
+		if (!housekeepingUsed[i]) {
+			housekeepingThreads[i] = *thread;
+			housekeepingUsed[i] = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&housekeepingLock);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Wait for the end of a housekeeping thread
+ */
+void npt_housekeeping_join(pthread_t thread) {
+	int i;
+
+	pthread_mutex_lock(&housekeepingLock);
+	for (i = 0; i < NPT_HOUSEKEEPING_MAX_THREADS; i++) {
+		if (housekeepingUsed[i] && pthread_equal(housekeepingThreads[i], thread)) {
+			housekeepingUsed[i] = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&housekeepingLock);
+
+	pthread_join(thread, NULL);
+}
+
+/**
+ * Keep the running housekeeping threads away from the measured CPU,
+ * after the loop moved to another one
+ */
+void npt_housekeeping_repin() {
+	cpu_set_t cpuMask;
+	int i, ret;
+
+	if (!_housekeeping_mask(&cpuMask)) return;
+
+	pthread_mutex_lock(&housekeepingLock);
+	for (i = 0; i < NPT_HOUSEKEEPING_MAX_THREADS; i++) {
+		if (!housekeepingUsed[i]) continue;
+		ret = pthread_setaffinity_np(housekeepingThreads[i], sizeof(cpuMask), &cpuMask);
+		if (ret != 0)
+			fprintf(stderr, "Warning: unable to move a housekeeping thread away from CPU %u, %s (%d)\n",
+					globalArgs.affinity, strerror(ret), ret);
+	}
+	pthread_mutex_unlock(&housekeepingLock);
+}
+
+/**
+ * Sleep for the given number of milliseconds
+ */
+
+void npt_housekeeping_sleep(unsigned int ms) {
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+/**
+ * Read the raw monotonic clock in nanoseconds
+ */
+uint64_t npt_housekeeping_raw_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Call the routine every interval, skipping the calls which are already
+ * late rather than catching up
+ */
+void npt_housekeeping_every(uint64_t interval, const int *stopping, void (*routine)()) {
+	uint64_t now, next = npt_housekeeping_raw_ns() + interval;
+
+	while (!__atomic_load_n(stopping, __ATOMIC_ACQUIRE)) {
+		now = npt_housekeeping_raw_ns();
+		if (now >= next) {
+			routine();
+			next += interval;
+			if (next < now) next = now + interval;
+			continue;
+		}
+
+		// Wake up at least every 100ms to check if we must stop
+		npt_housekeeping_sleep(((next - now) / 1000000 < 100) ? (next - now) / 1000000 + 1 : 100);
+	}
+}
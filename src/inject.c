@@ -0,0 +1,260 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <pthread.h>	// pthread_*
+#include <signal.h>	// sigaction, siginfo_t, SIGRTMIN
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// strtod
+#include <string.h>	// memset, strerror
+#include <sys/syscall.h>	// SYS_rt_tgsigqueueinfo, SYS_gettid
+#include <time.h>	// clock_gettime, clock_nanosleep
+#include <unistd.h>	// syscall, getpid, getuid
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/inject.h>
+#include <npt/numa.h>
+#include <npt/spikes.h>
+
+/**
+ * Signal delivered to the loop, carrying the size of the disturbance
+ */
+#define NPT_INJECT_SIGNAL	SIGRTMIN
+
+/** The sizes of the disturbances, in microseconds and in ticks */
+static double injectSizes[NPT_INJECT_SIZES];
+static uint64_t injectTicks[NPT_INJECT_SIZES];
+static unsigned int injectSizesCount = 0;
+
+/** The disturbances of the run, recorded by the loop */
+static struct npt_injection *injections = NULL;
+static uint64_t injectCount;
+
+/** The injector thread, and the disturbances it sent */
+static pthread_t injectThread;
+static int injectStopping;
+static bool injectStarted = false;
+static pid_t injectTid;
+static uint64_t injectSent[NPT_INJECT_SIZES];
+
+/**
+ * Parse the comma separated sizes of the disturbances, in microseconds
+ */
+int npt_inject_parse(const char *list) {
+	const char *p = list;
+	char *end;
+	double size;
+
+	injectSizesCount = 0;
+	do {
+		size = strtod(p, &end);
+		if (end == p || size <= 0 || (*end != ',' && *end != '\0')
+			|| injectSizesCount == NPT_INJECT_SIZES)
+			return EXIT_FAILURE;
+		injectSizes[injectSizesCount++] = size;
+		p = end + 1;
+	} while (*end == ',');
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Allocate the records of the disturbances on the node of the measured
+ * CPU, as the loop writes them
+ */
+int npt_inject_init() {
+	unsigned int i;
+
+	for (i = 0; i < injectSizesCount; i++)
+		injectTicks[i] = (uint64_t)(injectSizes[i] * 1.0e-6 * globalArgs.cpuHz);
+
+	if (injections == NULL)
+		injections = npt_alloc_local(sizeof(struct npt_injection) * NPT_INJECT_MAX, "injections");
+	if (injections == NULL) {
+		fprintf(stderr, "Error: unable to allocate the records of the disturbances.\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+void npt_inject_free() {
+	npt_free_local(injections);
+	injections = NULL;
+}
+
+/**
+ * Record a disturbance, if the loop is counting
+ */
+void npt_inject_record(uint64_t start, uint64_t end, unsigned int size) {
+	if (counter > 0 && injectCount < NPT_INJECT_MAX) {
+		injections[injectCount].start = start;
+		injections[injectCount].end = end;
+		injections[injectCount].size = size;
+		injectCount++;
+	}
+}
+
+/**
+ * Take the CPU from the loop for the size of the disturbance, and record
+ * it if the loop is counting
+ */
+static void _inject_handler(int sig, siginfo_t *info, void *context) {
+	unsigned int size = (unsigned int)info->si_value.sival_int;
+	uint64_t start = rdtsc(), end;
+	(void)sig;
+	(void)context;
+
+	if (size >= injectSizesCount) return;
+	while ((end = rdtsc()) - start < injectTicks[size]);
+
+	npt_inject_record(start, end, size);
+}
+
+/**
+ * Send the disturbances to the loop at the chosen rate, cycling through
+ * the sizes
+ */
+static void *_inject_thread(void *arg) {
+	uint64_t interval = 1000000000ULL / globalArgs.inject_rate, now, next, n = 0;
+	struct timespec ts;
+	siginfo_t info;
+	(void)arg;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	next = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + interval;
+	while (!__atomic_load_n(&injectStopping, __ATOMIC_ACQUIRE)) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		if (now < next) {
+			// Wake up at least every 100ms to check if we must stop
+			if (next - now > 100000000ULL) now += 100000000ULL;
+			else now = next;
+			ts.tv_sec = now / 1000000000ULL;
+			ts.tv_nsec = now % 1000000000ULL;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			continue;
+		}
+
+		memset(&info, 0, sizeof(info));
+		info.si_signo = NPT_INJECT_SIGNAL;
+		info.si_code = SI_QUEUE;
+		info.si_pid = getpid();
+		info.si_uid = getuid();
+		info.si_value.sival_int = n % injectSizesCount;
+		if (syscall(SYS_rt_tgsigqueueinfo, getpid(), injectTid, NPT_INJECT_SIGNAL, &info) == 0)
+			injectSent[n % injectSizesCount]++;
+		n++;
+		next += interval;
+	}
+
+	return NULL;
+}
+
+/**
+ * Start injecting disturbances in the loop, from another CPU
+ */
+int npt_inject_start() {
+	struct sigaction sa;
+
+	injectCount = 0;
+	memset(injectSent, 0, sizeof(injectSent));
+	if (globalArgs.inject == NULL) return EXIT_SUCCESS;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = _inject_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(NPT_INJECT_SIGNAL, &sa, NULL) != 0) {
+		fprintf(stderr, "Error: unable to handle the disturbances, %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	injectTid = syscall(SYS_gettid);
+	injectStopping = 0;
+	if (npt_housekeeping_start(&injectThread, "npt-inject", _inject_thread, NULL) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	injectStarted = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Stop injecting disturbances
+ */
+void npt_inject_stop() {
+	if (!injectStarted) return;
+	__atomic_store_n(&injectStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(injectThread);
+	injectStarted = false;
+}
+
+/**
+ * Print the detection rate of the disturbances and the error of the
+ * measured durations, by size. A disturbance is detected when a spike
+ * contains it, and the error is the duration of the spike minus the
+ * one of the disturbance.
+ */
+void npt_inject_print(FILE *fd, const char *prefix) {
+	uint64_t recorded[NPT_INJECT_SIZES] = { 0 }, detected[NPT_INJECT_SIZES] = { 0 };
+	double sumError[NPT_INJECT_SIZES] = { 0 }, minError[NPT_INJECT_SIZES], maxError[NPT_INJECT_SIZES];
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	const struct npt_injection *inj;
+	uint64_t i, j = 0, stored = (spikesCount < spikesSize) ? spikesCount : spikesSize;
+	unsigned int s;
+	double error;
+
+	if (globalArgs.inject == NULL) return;
+
+	for (i = 0; i < injectCount; i++) {
+		inj = &injections[i];
+
+		// The spikes past the buffer are unknown
+		if (spikesCount > spikesSize && stored > 0 && inj->end > spikes[stored - 1].tsc)
+			break;
+		recorded[inj->size]++;
+
+		while (j < stored && spikes[j].tsc < inj->end) j++;
+		if (j == stored || spikes[j].tsc - spikes[j].ticks > inj->start) continue;
+
+		error = ((double)spikes[j].ticks - (double)(inj->end - inj->start)) * globalArgs.cpuPeriod;
+		if (detected[inj->size] == 0 || error < minError[inj->size]) minError[inj->size] = error;
+		if (detected[inj->size] == 0 || error > maxError[inj->size]) maxError[inj->size] = error;
+		sumError[inj->size] += error;
+		detected[inj->size]++;
+	}
+
+	fprintf(fd, "%sInjected disturbances (%u Hz, spikes over %" PRIu64 " %s):\n", prefix,
+			globalArgs.inject_rate, globalArgs.threshold, unit);
+	fprintf(fd, "%s	size (us)	sent	in loops	detected	error mean / min / max (%s)\n",
+			prefix, unit);
+	for (s = 0; s < injectSizesCount; s++) {
+		fprintf(fd, "%s	%g		%" PRIu64 "	%" PRIu64 "		%" PRIu64 " (%.1f%%)", prefix,
+				injectSizes[s], injectSent[s], recorded[s], detected[s],
+				recorded[s] ? 100.0 * detected[s] / recorded[s] : 0.0);
+		if (detected[s] > 0)
+			fprintf(fd, "	%.3f / %.3f / %.3f", sumError[s] / detected[s], minError[s], maxError[s]);
+		fprintf(fd, "\n");
+	}
+	if (injectCount == NPT_INJECT_MAX)
+		fprintf(fd, "%s	Records limited to the first %d disturbances\n", prefix, NPT_INJECT_MAX);
+}
@@ -0,0 +1,146 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <inttypes.h>	// PRIu64
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <npt/npt.h>
+#include <npt/irqdiff.h>
+#include <npt/signals.h>
+#include <npt/spikes.h>
+#include <npt/tsc.h>
+
+/** The phases of the last run */
+static struct npt_irqdiff_phase irqdiffPhases[2 * NPT_IRQDIFF_MAX_PAIRS];
+static int irqdiffPhasesCount = 0;
+
+/**
+ * Run the loop, in the differential mode as pairs of phases with the
+ * interrupts enabled and disabled on the same CPU. The phases share the
+ * run evenly, in loops or in time, and alternate as on, off, off, on so
+ * that a linear drift weighs the same on both states. The statistics
+ * are those of the whole run, the phases only delimit the spikes.
+ */
+int npt_irqdiff_cycle() {
+	uint64_t loops = globalArgs.loops, duration = globalArgs.duration;
+	uint64_t counter0, spikes0;
+	int nocount = globalArgs.nocountloop, phases, p, ret = 0;
+	struct npt_irqdiff_phase *ph;
+
+	irqdiffPhasesCount = 0;
+	if (globalArgs.irq_diff == 0) return cycle();
+
+	phases = 2 * globalArgs.irq_diff;
+	for (p = 0; p < phases && signalStopped == 0; p++) {
+		ph = &irqdiffPhases[p];
+		ph->irqOff = (p % 4 == 1 || p % 4 == 2);
+		ph->start = npt_elapsed_ticks();
+		counter0 = counter;
+		spikes0 = spikesCount;
+
+		// Go up to the share of the run of the phase, the warm-up
+		// being done before the first one only: the next ones only
+		// skip the loop that takes their first timestamp
+		if (duration > 0)
+			globalArgs.duration = (uint64_t)((double)duration * (p + 1) / phases);
+		else
+			globalArgs.loops = loops * (p + 1) / phases;
+		if (p > 0) globalArgs.nocountloop = 1;
+
+		if (ph->irqOff) { cli(); }
+		else { sti(); }
+		ret = cycle();
+
+		ph->end = npt_elapsed_ticks();
+		ph->loops = counter - counter0;
+		ph->spikes = spikesCount - spikes0;
+		irqdiffPhasesCount++;
+		if (ret != 0) break;
+	}
+
+	// Back to the interrupts state of the RT mode
+	sti();
+	CLI_STI_OPTION_COND { cli(); }
+
+	globalArgs.loops = loops;
+	globalArgs.duration = duration;
+	globalArgs.nocountloop = nocount;
+	return ret;
+}
+
+/**
+ * Print the gaps of each state, and split them between the interrupts,
+ * whose gaps are gone when they are disabled, and the non-maskable
+ * stalls (SMI, firmware or hardware) which remain
+ */
+void npt_irqdiff_print(FILE *fd, const char *prefix) {
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	static const char *states[2] = { "on", "off" };
+	uint64_t loops[2] = { 0, 0 }, ticks[2] = { 0, 0 }, gaps[2] = { 0, 0 };
+	double stolen[2] = { 0.0, 0.0 }, max[2] = { 0.0, 0.0 }, rate[2], fraction[2];
+	uint64_t i, stored = (spikesCount < spikesSize) ? spikesCount : spikesSize;
+	struct npt_irqdiff_phase *ph;
+	double seconds, duration;
+	int p, s;
+
+	if (irqdiffPhasesCount == 0) return;
+
+	for (p = 0; p < irqdiffPhasesCount; p++) {
+		ph = &irqdiffPhases[p];
+		loops[ph->irqOff] += ph->loops;
+		ticks[ph->irqOff] += ph->end - ph->start;
+		gaps[ph->irqOff] += ph->spikes;
+	}
+
+	// The spikes are in the order of the run, as the phases: the time
+	// a gap stole is its excess over the shortest loop, both rescaled
+	// with the TSC frequency of their interval
+	for (i = 0, p = 0; i < stored; i++) {
+		while (p < irqdiffPhasesCount && spikes[i].at > irqdiffPhases[p].end) p++;
+		if (p == irqdiffPhasesCount) break;
+		s = irqdiffPhases[p].irqOff;
+		duration = (double)spikes[i].ticks * npt_tsc_scale(spikes[i].at) * globalArgs.cpuPeriod;
+		if (duration > minDuration) stolen[s] += duration - minDuration;
+		if (duration > max[s]) max[s] = duration;
+	}
+
+	fprintf(fd, "%sIRQ differential (%d phases, on/off/off/on order, gaps over %.3f %s):\n",
+			prefix, irqdiffPhasesCount, (double)spikeTicks * globalArgs.cpuPeriod, unit);
+	fprintf(fd, "%s	IRQs	loops		time (%s)	gaps	gaps/s		stolen (%s)	stolen	max gap (%s)\n",
+			prefix, unit, unit, unit);
+	for (s = 0; s < 2; s++) {
+		seconds = (double)ticks[s] / (double)globalArgs.cpuHz;
+		rate[s] = (seconds > 0.0) ? (double)gaps[s] / seconds : 0.0;
+		fraction[s] = (ticks[s] > 0)
+			? stolen[s] / ((double)ticks[s] * globalArgs.cpuPeriod) * 100.0 : 0.0;
+		fprintf(fd, "%s	%s	%" PRIu64 "	%.3f	%" PRIu64 "	%.1f		%.3f	%.4f%%	%.3f\n",
+				prefix, states[s], loops[s], (double)ticks[s] * globalArgs.cpuPeriod,
+				gaps[s], rate[s], stolen[s], fraction[s], max[s]);
+	}
+	fprintf(fd, "%s	IRQ-attributable:	%.1f gaps/s, %.4f%% of the time stolen\n",
+			prefix, rate[0] - rate[1], fraction[0] - fraction[1]);
+	fprintf(fd, "%s	non-maskable:		%.1f gaps/s, %.4f%% of the time stolen"
+			" (SMI, firmware or hardware)\n", prefix, rate[1], fraction[1]);
+	if (stored < spikesCount)
+		fprintf(fd, "%s	stolen time and max gap over the first %" PRIu64 " gaps only,"
+				" see --max-spikes\n", prefix, stored);
+}
@@ -0,0 +1,611 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <pthread.h>	// pthread_*
+#include <sched.h>	// cpu_set_t, CPU_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strcmp, strtok_r, memcpy
+#include <sys/mman.h>	// mmap, munmap
+#include <time.h>	// clock_nanosleep
+#include <unistd.h>	// sysconf
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>	// _mm512_*, _mm256_*
+	#define NPT_LOAD_X86
+#endif /* __x86_64__ && __GNUC__ */
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/load.h>
+#include <npt/numa.h>
+
+/** The runs, one per load profile */
+static struct npt_load_run loadRuns[NPT_LOAD_MAX_RUNS];
+static int loadRunsCount = 0;
+static int loadCurrent = -1;
+
+/** The workers of the current run */
+static struct npt_load_worker *loadWorkers = NULL;
+static int loadWorkersCount = 0;
+static int loadStopping;
+
+/**
+ * Integer spin: a dependency chain of multiplications and shifts
+ */
+static void _load_int(struct npt_load_worker *w) {
+	uint64_t x = w->seed, y = ~w->seed;
+	int i;
+
+	for (i = 0; i < (1 << 20); i++) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		y ^= x >> 29;
+		y += y << 7;
+	}
+	w->seed = x ^ y;
+}
+
+#ifdef NPT_LOAD_X86
+/**
+ * AVX-512 heavy: independent FMA chains on the 512 bits registers, which
+ * lower the frequency license of the core on most CPUs
+ */
+__attribute__((target("avx512f")))
+static void _load_avx512(struct npt_load_worker *w) {
+	__m512d b = _mm512_set1_pd(0.9999999), c = _mm512_set1_pd(1.0e-7);
+	__m512d a0 = _mm512_set1_pd(1.0), a1 = a0, a2 = a0, a3 = a0;
+	__m512d a4 = a0, a5 = a0, a6 = a0, a7 = a0;
+	double out[8];
+	int i;
+
+	for (i = 0; i < (1 << 17); i++) {
+		a0 = _mm512_fmadd_pd(a0, b, c);
+		a1 = _mm512_fmadd_pd(a1, b, c);
+		a2 = _mm512_fmadd_pd(a2, b, c);
+		a3 = _mm512_fmadd_pd(a3, b, c);
+		a4 = _mm512_fmadd_pd(a4, b, c);
+		a5 = _mm512_fmadd_pd(a5, b, c);
+		a6 = _mm512_fmadd_pd(a6, b, c);
+		a7 = _mm512_fmadd_pd(a7, b, c);
+	}
+	a0 = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)),
+			_mm512_add_pd(_mm512_add_pd(a4, a5), _mm512_add_pd(a6, a7)));
+	_mm512_storeu_pd(out, a0);
+	w->seed ^= (uint64_t)out[0];
+}
+
+/**
+ * Same with the 256 bits registers, when AVX-512 is not available
+ */
+__attribute__((target("avx2,fma")))
+static void _load_avx2(struct npt_load_worker *w) {
+	__m256d b = _mm256_set1_pd(0.9999999), c = _mm256_set1_pd(1.0e-7);
+	__m256d a0 = _mm256_set1_pd(1.0), a1 = a0, a2 = a0, a3 = a0;
+	__m256d a4 = a0, a5 = a0, a6 = a0, a7 = a0;
+	double out[4];
+	int i;
+
+	for (i = 0; i < (1 << 17); i++) {
+		a0 = _mm256_fmadd_pd(a0, b, c);
+		a1 = _mm256_fmadd_pd(a1, b, c);
+		a2 = _mm256_fmadd_pd(a2, b, c);
+		a3 = _mm256_fmadd_pd(a3, b, c);
+		a4 = _mm256_fmadd_pd(a4, b, c);
+		a5 = _mm256_fmadd_pd(a5, b, c);
+		a6 = _mm256_fmadd_pd(a6, b, c);
+		a7 = _mm256_fmadd_pd(a7, b, c);
+	}
+	a0 = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)),
+			_mm256_add_pd(_mm256_add_pd(a4, a5), _mm256_add_pd(a6, a7)));
+	_mm256_storeu_pd(out, a0);
+	w->seed ^= (uint64_t)out[0];
+}
+#endif /* NPT_LOAD_X86 */
+
+/**
+ * Use the widest vector instructions the CPU supports
+ */
+static int _load_prepare_avx512(struct npt_load_worker *w) {
+	static bool warned = false;
+
+#ifdef NPT_LOAD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		w->work = _load_avx512;
+		return EXIT_SUCCESS;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		if (!warned) printf("# AVX-512 is not supported, using AVX2 instead\n");
+		warned = true;
+		w->work = _load_avx2;
+		return EXIT_SUCCESS;
+	}
+#endif /* NPT_LOAD_X86 */
+
+	if (!warned) printf("# AVX-512 is not supported, using the integer spin instead\n");
+	warned = true;
+	w->work = _load_int;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Allocate and touch the buffer of a memory load, from its worker
+ */
+static int _load_prepare_buffer(struct npt_load_worker *w, size_t size) {
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s load", w->profile->name);
+	w->buffer = npt_alloc_local(size, name);
+	if (w->buffer == NULL) return EXIT_FAILURE;
+	w->size = size;
+	return EXIT_SUCCESS;
+}
+
+static int _load_prepare_stream(struct npt_load_worker *w) {
+	return _load_prepare_buffer(w, NPT_LOAD_STREAM_SIZE);
+}
+
+/**
+ * Memory streaming: the triad kernel of STREAM over a buffer much bigger
+ * than the caches
+ */
+static void _load_stream(struct npt_load_worker *w) {
+	size_t i, n = w->size / sizeof(double) / 3;
+	double *a = w->buffer, *b = a + n, *c = b + n;
+
+	for (i = 0; i < n; i++)
+		a[i] = b[i] + 3.0 * c[i];
+}
+
+/**
+ * Memory bandwidth: copy between the two halves of a buffer much bigger
+ * than the caches
+ */
+static void _load_membw(struct npt_load_worker *w) {
+	size_t half = w->size / 2;
+	char *p = w->buffer;
+
+	memcpy(p, p + half, half);
+	memcpy(p + half, p, half);
+}
+
+/**
+ * Size of the last level cache of the measured CPU
+ */
+static size_t _llc_size() {
+	char *filename = NULL;
+	unsigned long size = 0;
+	char unit = 'K';
+	int index;
+	FILE *fd;
+
+	// The last index is the last level
+	for (index = 3; index >= 0 && size == 0; index--) {
+		if (asprintf(&filename, "/sys/devices/system/cpu/cpu%u/cache/index%d/size",
+				globalArgs.affinity, index) < 0)
+			break;
+		fd = fopen(filename, "r");
+		free(filename);
+		if (fd == NULL) continue;
+		if (fscanf(fd, "%lu%c", &size, &unit) < 1) size = 0;
+		fclose(fd);
+	}
+
+	if (size == 0) return NPT_LOAD_LLC_SIZE;
+	if (unit == 'M') return size << 20;
+	if (unit == 'K') return size << 10;
+	return size;
+}
+
+/**
+ * The LLC thrash works on twice the size of the cache, so that each
+ * worker keeps evicting the lines of the measured CPU
+ */
+static int _load_prepare_llc(struct npt_load_worker *w) {
+	return _load_prepare_buffer(w, 2 * _llc_size());
+}
+
+/**
+ * LLC thrash: read-modify-write of random cache lines
+ */
+static void _load_llc(struct npt_load_worker *w) {
+	uint64_t x = w->seed, lines = w->size / 64;
+	uint64_t *p = w->buffer;
+	int i;
+
+	for (i = 0; i < (1 << 16); i++) {
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		p[((x * 2685821657736338717ULL) % lines) * 8]++;
+	}
+	w->seed = x;
+}
+
+/**
+ * TLB shootdowns: each munmap of a page touched by this process sends
+ * an IPI to the other CPUs running it, including the measured one
+ */
+static void _load_tlb(struct npt_load_worker *w) {
+	size_t page = sysconf(_SC_PAGESIZE), size = NPT_LOAD_TLB_PAGES * page, i;
+	char *p;
+	int n;
+
+	for (n = 0; n < 64; n++) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) return;
+		for (i = 0; i < size; i += page) p[i] = 1;
+		munmap(p, size);
+	}
+	(void)w;
+}
+
+/**
+ * Timer heavy: short sleeps, each one programming and firing a timer
+ */
+static void _load_timer(struct npt_load_worker *w) {
+	struct timespec ts = { 0, NPT_LOAD_TIMER_SLEEP };
+	int i;
+
+	for (i = 0; i < 100; i++)
+		clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+	(void)w;
+}
+
+/**
+ * The load profiles
+ */
+static const struct npt_load_profile loadProfiles[] = {
+	{ "idle",	"nothing runs",				NULL,			NULL },
+	{ "int",	"integer spin",				NULL,			_load_int },
+	{ "avx512",	"AVX-512 FMA chains",			_load_prepare_avx512,	_load_int },
+	{ "stream",	"STREAM triad over 96MiB",		_load_prepare_stream,	_load_stream },
+	{ "membw",	"copies over 96MiB",			_load_prepare_stream,	_load_membw },
+	{ "llc",	"random writes over twice the LLC",	_load_prepare_llc,	_load_llc },
+	{ "tlb",	"mmap/munmap churn",			NULL,			_load_tlb },
+	{ "timer",	"50us sleeps",				NULL,			_load_timer },
+};
+#define NPT_LOAD_PROFILES (sizeof(loadProfiles) / sizeof(loadProfiles[0]))
+
+/**
+ * Parse a CPU list as in sysfs, like 0-3,8,10-11
+ */
+int npt_parse_cpu_list(const char *list, cpu_set_t *set) {
+	const char *p = list;
+	char *end;
+	long first, last, cpu;
+
+	CPU_ZERO(set);
+	while (*p != '\0' && *p != '\n') {
+		first = strtol(p, &end, 10);
+		if (end == p || first < 0) return EXIT_FAILURE;
+		last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1 || last < first) return EXIT_FAILURE;
+			p = end;
+		}
+		if (last >= CPU_SETSIZE) return EXIT_FAILURE;
+		for (cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+		if (*p == ',') p++;
+		else if (*p != '\0' && *p != '\n') return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Format a CPU set as a list
+ */
+static void _cpu_list(const cpu_set_t *set, char *buf, size_t size) {
+	int cpu, len = 0;
+
+	buf[0] = '\0';
+	for (cpu = 0; cpu < CPU_SETSIZE && len < (int)size; cpu++) {
+		if (!CPU_ISSET(cpu, set)) continue;
+		len += snprintf(buf + len, size - len, "%s%d", (len > 0) ? "," : "", cpu);
+	}
+}
+
+/**
+ * Read the SMT siblings of the measured CPU
+ */
+static int _smt_siblings(cpu_set_t *set) {
+	char *filename = NULL, line[256];
+	FILE *fd;
+
+	if (asprintf(&filename, "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list",
+			globalArgs.affinity) < 0)
+		return EXIT_FAILURE;
+	fd = fopen(filename, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in read mode.\n", filename);
+		free(filename);
+		return EXIT_FAILURE;
+	}
+	free(filename);
+
+	if (fgets(line, sizeof(line), fd) == NULL || npt_parse_cpu_list(line, set) != EXIT_SUCCESS) {
+		fprintf(stderr, "Error: unable to read the SMT siblings of CPU %u.\n", globalArgs.affinity);
+		fclose(fd);
+		return EXIT_FAILURE;
+	}
+	fclose(fd);
+
+	CPU_CLR(globalArgs.affinity, set);
+	if (CPU_COUNT(set) == 0) {
+		fprintf(stderr, "Error: CPU %u has no SMT sibling.\n", globalArgs.affinity);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Add a run for each profile of a comma separated list, or for all the
+ * profiles
+ */
+static int _load_add_runs(const char *list, const char *placement, const cpu_set_t *cpus,
+		const char *option) {
+	char *copy, *name, *saveptr = NULL;
+	size_t i;
+	int ret = EXIT_SUCCESS;
+
+	copy = strdup(list);
+	if (copy == NULL) return EXIT_FAILURE;
+
+	for (name = strtok_r(copy, ",", &saveptr); name != NULL && ret == EXIT_SUCCESS;
+			name = strtok_r(NULL, ",", &saveptr)) {
+		for (i = 0; i < NPT_LOAD_PROFILES; i++) {
+			if (strcmp(name, "all") != 0 && strcmp(name, loadProfiles[i].name) != 0)
+				continue;
+			if (loadRunsCount == NPT_LOAD_MAX_RUNS) {
+				fprintf(stderr, "%s: too many load profiles (max. %d)\n",
+						option, NPT_LOAD_MAX_RUNS);
+				ret = EXIT_FAILURE;
+				break;
+			}
+			loadRuns[loadRunsCount].profile = &loadProfiles[i];
+			loadRuns[loadRunsCount].placement = placement;
+			loadRuns[loadRunsCount].cpus = *cpus;
+			loadRunsCount++;
+			if (strcmp(name, "all") != 0) break;
+		}
+		if (i == NPT_LOAD_PROFILES && strcmp(name, "all") != 0) {
+			fprintf(stderr, "%s: unknown load profile '%s'\n", option, name);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	free(copy);
+	return ret;
+}
+
+/**
+ * CPUs of the stressors: the given ones, or all the online ones but
+ * the measured CPU
+ */
+static int _stress_cpus(cpu_set_t *set) {
+	char line[1024];
+	FILE *fd;
+
+	if (globalArgs.stress_cpus != NULL) {
+		if (npt_parse_cpu_list(globalArgs.stress_cpus, set) != EXIT_SUCCESS) {
+			fprintf(stderr, "--stress-cpus: invalid CPU list '%s'\n", globalArgs.stress_cpus);
+			return EXIT_FAILURE;
+		}
+	} else {
+		fd = fopen("/sys/devices/system/cpu/online", "r");
+		if (fd == NULL || fgets(line, sizeof(line), fd) == NULL
+			|| npt_parse_cpu_list(line, set) != EXIT_SUCCESS) {
+			fprintf(stderr, "Error: unable to read the online CPUs.\n");
+			if (fd != NULL) fclose(fd);
+			return EXIT_FAILURE;
+		}
+		fclose(fd);
+	}
+
+	CPU_CLR(globalArgs.affinity, set);
+	if (CPU_COUNT(set) == 0) {
+		fprintf(stderr, "Error: no CPU left for the stressors besides CPU %u.\n",
+				globalArgs.affinity);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Prepare the runs of the load modes
+ */
+int npt_load_init() {
+	cpu_set_t siblings, others;
+
+	loadRunsCount = 0;
+
+	if (globalArgs.smt_sibling != NULL) {
+		if (_smt_siblings(&siblings) != EXIT_SUCCESS
+			|| _load_add_runs(globalArgs.smt_sibling, "SMT sibling", &siblings,
+				"--smt-sibling") != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+	}
+
+	if (globalArgs.stress != NULL) {
+		if (_stress_cpus(&others) != EXIT_SUCCESS
+			|| _load_add_runs(globalArgs.stress, "other", &others,
+				"--stress") != EXIT_SUCCESS)
+			return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Number of runs of the load modes, 0 if they are not used
+ */
+int npt_load_runs() {
+	return loadRunsCount;
+}
+
+const char *npt_load_name(int run) {
+	return loadRuns[run].profile->name;
+}
+
+static void *_load_thread(void *arg) {
+	struct npt_load_worker *w = arg;
+
+	if (w->profile->prepare != NULL && w->profile->prepare(w) != EXIT_SUCCESS) {
+		__atomic_store_n(&w->state, NPT_LOAD_FAILED, __ATOMIC_RELEASE);
+		return NULL;
+	}
+	__atomic_store_n(&w->state, NPT_LOAD_READY, __ATOMIC_RELEASE);
+
+	while (!__atomic_load_n(&loadStopping, __ATOMIC_RELAXED)) {
+		w->work(w);
+		w->chunks++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Start the load of a run: one worker on each of its CPUs
+ */
+int npt_load_start(int run) {
+	struct npt_load_run *r = &loadRuns[run];
+	struct npt_load_worker *w;
+	char cpus[256];
+	cpu_set_t mask;
+	int cpu, i;
+
+	if (run >= loadRunsCount) return EXIT_SUCCESS;
+
+	_cpu_list(&r->cpus, cpus, sizeof(cpus));
+	printf("# Load profile '%s' (%s) on the %s CPU(s) %s\n", r->profile->name,
+			r->profile->description, r->placement, cpus);
+	loadCurrent = run;
+	loadStopping = 0;
+	loadWorkersCount = 0;
+	if (r->profile->work == NULL) return EXIT_SUCCESS;
+
+	loadWorkers = calloc(CPU_COUNT(&r->cpus), sizeof(struct npt_load_worker));
+	if (loadWorkers == NULL) {
+		fprintf(stderr, "Error: unable to allocate the load workers.\n");
+		return EXIT_FAILURE;
+	}
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &r->cpus)) continue;
+
+		w = &loadWorkers[loadWorkersCount];
+		w->profile = r->profile;
+		w->work = r->profile->work;
+		w->cpu = cpu;
+		w->seed = 0x9E3779B97F4A7C15ULL * (cpu + 1);
+		w->state = NPT_LOAD_PREPARING;
+
+		CPU_ZERO(&mask);
+		CPU_SET(cpu, &mask);
+		if (npt_housekeeping_start_on(&w->thread, "npt-load", _load_thread, w, &mask)
+				!= EXIT_SUCCESS)
+			goto err;
+		loadWorkersCount++;
+	}
+
+	// Do not measure while the workers are still faulting their buffers
+	for (i = 0; i < loadWorkersCount; i++) {
+		while (__atomic_load_n(&loadWorkers[i].state, __ATOMIC_ACQUIRE) == NPT_LOAD_PREPARING)
+			npt_housekeeping_sleep(1);
+		if (loadWorkers[i].state == NPT_LOAD_FAILED) goto err;
+	}
+
+	return EXIT_SUCCESS;
+
+err:
+	npt_load_stop(run);
+	return EXIT_FAILURE;
+}
+
+/**
+ * Stop the load of a run and keep its results
+ */
+void npt_load_stop(int run) {
+	struct npt_load_run *r = &loadRuns[run];
+	uint64_t chunks = 0;
+	double seconds;
+	int i;
+
+	if (run >= loadRunsCount) return;
+
+	__atomic_store_n(&loadStopping, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < loadWorkersCount; i++) {
+		pthread_join(loadWorkers[i].thread, NULL);
+		chunks += loadWorkers[i].chunks;
+		npt_free_local(loadWorkers[i].buffer);
+	}
+	free(loadWorkers);
+	loadWorkers = NULL;
+	loadWorkersCount = 0;
+
+	npt_summary_fill(&r->summary);
+	seconds = (double)sumTicks / (double)globalArgs.cpuHz;
+	r->chunksPerSecond = (seconds > 0.0) ? (double)chunks / seconds : 0.0;
+	r->done = 1;
+}
+
+/**
+ * Print the load profile of the current run
+ */
+void npt_load_print(FILE *fd, const char *prefix) {
+	struct npt_load_run *r;
+	char cpus[256];
+
+	if (loadCurrent < 0) return;
+	r = &loadRuns[loadCurrent];
+
+	_cpu_list(&r->cpus, cpus, sizeof(cpus));
+	fprintf(fd, "%sLoad profile:	%s on the %s CPU(s) %s, %.1f chunks/s\n", prefix,
+			r->profile->name, r->placement, cpus, r->chunksPerSecond);
+}
+
+/**
+ * Compare the results of the runs
+ */
+void npt_load_print_comparison(FILE *fd, const char *prefix) {
+	struct npt_load_run *r;
+	int i;
+
+	if (loadRunsCount == 0) return;
+
+	fprintf(fd, "%sLoad profiles comparison (%s):\n", prefix,
+			UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
+	fprintf(fd, "%s	profile	placement	chunks/s	", prefix);
+	npt_summary_print_header(fd);
+
+	for (i = 0; i < loadRunsCount; i++) {
+		r = &loadRuns[i];
+		if (!r->done) continue;
+		fprintf(fd, "%s	%s	%s	%.1f		", prefix,
+				r->profile->name, r->placement, r->chunksPerSecond);
+		npt_summary_print(fd, &r->summary);
+	}
+}
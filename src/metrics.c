@@ -0,0 +1,293 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <arpa/inet.h>	// htons, htonl
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <netinet/in.h>	// struct sockaddr_in
+#include <poll.h>	// poll
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strlen
+#include <sys/socket.h>	// socket, bind, listen, accept
+#include <sys/time.h>	// struct timeval
+#include <time.h>	// clock_gettime
+#include <unistd.h>	// close, unlink
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/metrics.h>
+
+/** The exporter thread and its listening socket */
+static pthread_t metricsThread;
+static int metricsStopping;
+static bool metricsStarted = false;
+static int metricsSocket = -1;
+
+/** The last rendered metrics */
+static char *metricsText = NULL;
+static size_t metricsSize = 0;
+
+/**
+ * Quantiles exported as gauges
+ */
+static const double metricsQuantiles[] = { 0.5, 0.9, 0.99, 0.999, 0.9999, 0.99999 };
+#define NPT_METRICS_QUANTILES (sizeof(metricsQuantiles) / sizeof(metricsQuantiles[0]))
+
+/**
+ * Write the current results in the OpenMetrics text format. The loop
+ * is not stopped: each value is read once, and the counters can only
+ * be slightly ahead of each other.
+ */
+void npt_metrics_render(FILE *fd) {
+	double values[NPT_METRICS_QUANTILES];
+	double toSeconds = 1.0 / multi;
+	uint64_t cumulated = 0, loops = counter, ticks = sumTicks;
+	uint64_t overruns = histogramOverruns;
+	double max = maxDuration;
+	int i, b = 0, decade, bound;
+	const int steps[] = { 1, 2, 5 };
+
+	npt_histogram_percentiles(metricsQuantiles, values, NPT_METRICS_QUANTILES);
+
+	fprintf(fd, "# TYPE npt_loop_duration_seconds histogram\n");
+	fprintf(fd, "# UNIT npt_loop_duration_seconds seconds\n");
+	fprintf(fd, "# HELP npt_loop_duration_seconds Duration of the measured loops.\n");
+
+	// Buckets at 1, 2 and 5 times the powers of ten of the unit
+	for (decade = 1; decade <= NPT_HISTOGRAM_SIZE; decade *= 10) {
+		for (i = 0; i < 3; i++) {
+			bound = steps[i] * decade;
+			if (bound > NPT_HISTOGRAM_SIZE) break;
+			for (; b < bound; b++) cumulated += histogram[b];
+			fprintf(fd, "npt_loop_duration_seconds_bucket{cpu=\"%u\",le=\"%g\"} %" PRIu64 "\n",
+					globalArgs.affinity, bound * toSeconds, cumulated);
+		}
+	}
+	for (; b < NPT_HISTOGRAM_SIZE; b++) cumulated += histogram[b];
+	cumulated += overruns;
+	fprintf(fd, "npt_loop_duration_seconds_bucket{cpu=\"%u\",le=\"+Inf\"} %" PRIu64 "\n",
+			globalArgs.affinity, cumulated);
+	fprintf(fd, "npt_loop_duration_seconds_count{cpu=\"%u\"} %" PRIu64 "\n",
+			globalArgs.affinity, cumulated);
+	fprintf(fd, "npt_loop_duration_seconds_sum{cpu=\"%u\"} %.12g\n",
+			globalArgs.affinity, (double)ticks * globalArgs.cpuPeriod * toSeconds);
+
+	fprintf(fd, "# TYPE npt_loop_duration_quantile_seconds gauge\n");
+	fprintf(fd, "# UNIT npt_loop_duration_quantile_seconds seconds\n");
+	fprintf(fd, "# HELP npt_loop_duration_quantile_seconds Quantiles of the loop durations, at the histogram resolution.\n");
+	for (i = 0; i < (int)NPT_METRICS_QUANTILES; i++)
+		fprintf(fd, "npt_loop_duration_quantile_seconds{cpu=\"%u\",quantile=\"%g\"} %.12g\n",
+				globalArgs.affinity, metricsQuantiles[i], values[i] * toSeconds);
+
+	fprintf(fd, "# TYPE npt_loop_duration_max_seconds gauge\n");
+	fprintf(fd, "# UNIT npt_loop_duration_max_seconds seconds\n");
+	fprintf(fd, "# HELP npt_loop_duration_max_seconds Longest loop duration.\n");
+	fprintf(fd, "npt_loop_duration_max_seconds{cpu=\"%u\"} %.12g\n",
+			globalArgs.affinity, max * toSeconds);
+
+	fprintf(fd, "# TYPE npt_loops counter\n");
+	fprintf(fd, "# HELP npt_loops Number of measured loops.\n");
+	fprintf(fd, "npt_loops_total{cpu=\"%u\"} %" PRIu64 "\n", globalArgs.affinity, loops);
+
+	fprintf(fd, "# TYPE npt_histogram_overruns counter\n");
+	fprintf(fd, "# HELP npt_histogram_overruns Number of loops longer than the histogram.\n");
+	fprintf(fd, "npt_histogram_overruns_total{cpu=\"%u\"} %" PRIu64 "\n",
+			globalArgs.affinity, overruns);
+
+	fprintf(fd, "# EOF\n");
+}
+
+/**
+ * Render the metrics, and write them in the text file if needed. The
+ * file is renamed in place so that the collector never reads it half
+ * written.
+ */
+static void _metrics_refresh() {
+	char *tmpname = NULL;
+	FILE *fd;
+
+	free(metricsText);
+	metricsText = NULL;
+	fd = open_memstream(&metricsText, &metricsSize);
+	if (fd == NULL) return;
+	npt_metrics_render(fd);
+	fclose(fd);
+
+	if (globalArgs.metrics_file == NULL) return;
+	if (asprintf(&tmpname, "%s.tmp", globalArgs.metrics_file) < 0) return;
+
+	fd = fopen(tmpname, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode.\n", tmpname);
+	} else {
+		fwrite(metricsText, 1, metricsSize, fd);
+		fclose(fd);
+		if (rename(tmpname, globalArgs.metrics_file) != 0) unlink(tmpname);
+	}
+	free(tmpname);
+}
+
+/**
+ * Answer one HTTP request with the last rendered metrics
+ */
+static void _metrics_serve(int client) {
+	struct timeval tv = { 0, 100000 };
+	char request[1024], *header = NULL;
+	int len;
+
+	// Do not wait for slow clients
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	len = recv(client, request, sizeof(request) - 1, 0);
+	if (len <= 0) return;
+	request[len] = 0;
+
+	if (strncmp(request, "GET ", 4) != 0) {
+		len = asprintf(&header, "HTTP/1.1 405 Method Not Allowed\r\n"
+				"Allow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		if (len > 0) send(client, header, len, MSG_NOSIGNAL);
+	} else {
+		len = asprintf(&header, "HTTP/1.1 200 OK\r\n"
+				"Content-Type: " NPT_METRICS_CONTENT_TYPE "\r\n"
+				"Content-Length: %zu\r\nConnection: close\r\n\r\n", metricsSize);
+		if (len > 0) {
+			send(client, header, len, MSG_NOSIGNAL | MSG_MORE);
+			send(client, metricsText, metricsSize, MSG_NOSIGNAL);
+		}
+	}
+	free(header);
+}
+
+/**
+ * Return the current CLOCK_MONOTONIC time in microseconds
+ */
+static uint64_t _now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * Exporter thread: refreshes the metrics and answers the requests
+ */
+static void *_metrics_thread(void *arg) {
+	struct pollfd pfd;
+	uint64_t now, next = _now();
+	int client, timeout;
+	(void)arg;
+
+	while (!__atomic_load_n(&metricsStopping, __ATOMIC_ACQUIRE)) {
+		now = _now();
+		if (now >= next) {
+			_metrics_refresh();
+			next += globalArgs.metrics_interval;
+			if (next < now) next = now + globalArgs.metrics_interval;
+		}
+
+		// Wake up at least every 100ms to check if we must stop
+		timeout = (int)((next - now) / 1000);
+		if (timeout > 100) timeout = 100;
+
+		if (metricsSocket < 0) {
+			npt_housekeeping_sleep(timeout);
+			continue;
+		}
+
+		pfd.fd = metricsSocket;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout) > 0) {
+			client = accept(metricsSocket, NULL, NULL);
+			if (client >= 0) {
+				_metrics_serve(client);
+				close(client);
+			}
+		}
+	}
+
+	// Export the final results
+	_metrics_refresh();
+
+	return NULL;
+}
+
+/**
+ * Open the HTTP endpoint on localhost, if needed, and start the
+ * exporter thread
+ */
+int npt_metrics_start() {
+	struct sockaddr_in addr;
+	int one = 1;
+
+	if (globalArgs.metrics_file == NULL && globalArgs.metrics_port == 0)
+		return EXIT_SUCCESS;
+
+	if (globalArgs.metrics_port > 0) {
+		metricsSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (metricsSocket < 0) {
+			fprintf(stderr, "Error: unable to create the metrics socket, %s (%d)\n",
+					strerror(errno), errno);
+			return EXIT_FAILURE;
+		}
+		setsockopt(metricsSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(globalArgs.metrics_port);
+		if (bind(metricsSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0
+			|| listen(metricsSocket, 8) != 0) {
+			fprintf(stderr, "Error: unable to listen on 127.0.0.1:%u, %s (%d)\n",
+					globalArgs.metrics_port, strerror(errno), errno);
+			close(metricsSocket);
+			metricsSocket = -1;
+			return EXIT_FAILURE;
+		}
+		printf("# Metrics served on http://127.0.0.1:%u/metrics\n", globalArgs.metrics_port);
+	}
+
+	metricsStopping = 0;
+	if (npt_housekeeping_start(&metricsThread, "npt-metrics", _metrics_thread, NULL) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	metricsStarted = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Stop the exporter thread, after a last refresh
+ */
+void npt_metrics_stop() {
+	if (metricsStarted) {
+		__atomic_store_n(&metricsStopping, 1, __ATOMIC_RELEASE);
+		npt_housekeeping_join(metricsThread);
+		metricsStarted = false;
+	}
+
+	if (metricsSocket >= 0) {
+		close(metricsSocket);
+		metricsSocket = -1;
+	}
+	free(metricsText);
+	metricsText = NULL;
+}
@@ -0,0 +1,277 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <fcntl.h>	// open, O_RDONLY
+#include <inttypes.h>	// PRIu64
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// realloc, free
+#include <string.h>	// strerror
+#include <unistd.h>	// pread, close
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/msr.h>
+#include <npt/spikes.h>
+#include <npt/tsc.h>
+
+/** The sampling thread, and the MSR device of the measured CPU */
+static pthread_t msrThread;
+static int msrStopping;
+static bool msrStarted = false;
+static int msrFd = -1;
+
+/** If the thermal status of the core and of the package can be read */
+static bool msrCoreTherm, msrPackageTherm;
+
+/** The reads of the current run */
+static struct npt_msr_sample *msrSamples = NULL;
+static size_t msrCount = 0, msrSize = 0;
+
+/**
+ * Read a MSR of the measured CPU, which the msr driver does on it
+ */
+static int _msr_read(uint32_t msr, uint64_t *value) {
+	return (pread(msrFd, value, sizeof(*value), msr) == sizeof(*value)) ? 0 : -1;
+}
+
+/**
+ * Read the MSRs with the loops and ticks summed by the loop. Each read
+ * interrupts the measured CPU for a few microseconds, which is why they
+ * are only done at the interval boundaries, and not around the spikes:
+ * the reads would disturb the loops right after each spike.
+ */
+static void _msr_sample() {
+	struct npt_msr_sample s;
+
+	s.ns = npt_housekeeping_raw_ns();
+	s.loops = __atomic_load_n(&counter, __ATOMIC_RELAXED);
+	s.ticks = __atomic_load_n(&sumTicks, __ATOMIC_RELAXED);
+	s.at = npt_elapsed_ticks();
+	if (_msr_read(NPT_MSR_MPERF, &s.mperf) != 0 || _msr_read(NPT_MSR_APERF, &s.aperf) != 0)
+		return;
+	s.therm = 0;
+	s.packageTherm = 0;
+	if (msrCoreTherm) _msr_read(NPT_MSR_THERM_STATUS, &s.therm);
+	if (msrPackageTherm) _msr_read(NPT_MSR_PACKAGE_THERM_STATUS, &s.packageTherm);
+
+	npt_msr_record(&s);
+}
+
+/**
+ * Keep a read of the MSRs
+ */
+void npt_msr_record(const struct npt_msr_sample *s) {
+	struct npt_msr_sample *samples;
+
+	if (msrCount == msrSize) {
+		samples = realloc(msrSamples, sizeof(*samples) * (msrSize ? 2 * msrSize : 64));
+		if (samples == NULL) return;
+		msrSamples = samples;
+		msrSize = msrSize ? 2 * msrSize : 64;
+	}
+	msrSamples[msrCount++] = *s;
+}
+
+static void *_msr_thread(void *arg) {
+	(void)arg;
+
+	_msr_sample();
+	npt_housekeeping_every(globalArgs.msr_interval * 1000, &msrStopping, _msr_sample);
+
+	// Close the last interval at the end of the run
+	_msr_sample();
+	return NULL;
+}
+
+/**
+ * Start reading the MSRs of the measured CPU for a run
+ */
+int npt_msr_start() {
+	char device[32];
+	uint64_t value;
+
+	msrCount = 0;
+	if (globalArgs.msr_interval == 0) return EXIT_SUCCESS;
+
+	// MPERF counts at the frequency of the TSC
+	if (tscHz == 0.0) npt_tsc_calibrate();
+
+	snprintf(device, sizeof(device), "/dev/cpu/%u/msr", globalArgs.affinity);
+	msrFd = open(device, O_RDONLY | O_CLOEXEC);
+	if (msrFd < 0) {
+		fprintf(stderr, "Error: unable to open %s, %s (%d), is the msr module loaded?\n",
+				device, strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+	if (_msr_read(NPT_MSR_MPERF, &value) != 0 || _msr_read(NPT_MSR_APERF, &value) != 0) {
+		fprintf(stderr, "Error: unable to read APERF and MPERF from %s, %s (%d)\n",
+				device, strerror(errno), errno);
+		close(msrFd);
+		msrFd = -1;
+		return EXIT_FAILURE;
+	}
+	msrCoreTherm = _msr_read(NPT_MSR_THERM_STATUS, &value) == 0;
+	msrPackageTherm = _msr_read(NPT_MSR_PACKAGE_THERM_STATUS, &value) == 0;
+
+	msrStopping = 0;
+	if (npt_housekeeping_start(&msrThread, "npt-msr", _msr_thread, NULL) != EXIT_SUCCESS) {
+		close(msrFd);
+		msrFd = -1;
+		return EXIT_FAILURE;
+	}
+	msrStarted = true;
+	return EXIT_SUCCESS;
+}
+
+void npt_msr_stop() {
+	if (!msrStarted) return;
+	__atomic_store_n(&msrStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(msrThread);
+	msrStarted = false;
+	close(msrFd);
+	msrFd = -1;
+}
+
+/**
+ * Free the reads, at the end
+ */
+void npt_msr_free() {
+	free(msrSamples);
+	msrSamples = NULL;
+	msrCount = 0;
+	msrSize = 0;
+}
+
+/**
+ * Throttling of an interval from the thermal status at its ends: only
+ * the throttling in progress at either end is seen
+ */
+static uint64_t _msr_throttled(uint64_t before, uint64_t after) {
+	return (before | after) & (NPT_MSR_THERMAL | NPT_MSR_POWER);
+}
+
+/**
+ * Name the throttling of an interval, of the core and of the package
+ */
+static void _msr_throttle_name(char *name, size_t size, uint64_t core, uint64_t package) {
+	snprintf(name, size, "%s%s%s%s",
+			(core & NPT_MSR_THERMAL) ? ",core-thermal" : "",
+			(core & NPT_MSR_POWER) ? ",core-power" : "",
+			(package & NPT_MSR_THERMAL) ? ",pkg-thermal" : "",
+			(package & NPT_MSR_POWER) ? ",pkg-power" : "");
+	if (name[0] == '\0') snprintf(name, size, ",-");
+}
+
+/**
+ * Effective frequency of an interval, 0 if the loop did not run in it
+ */
+static double _msr_hz(const struct npt_msr_sample *a, const struct npt_msr_sample *b) {
+	if (b->loops <= a->loops || b->mperf <= a->mperf) return 0.0;
+	return tscHz * (double)(b->aperf - a->aperf) / (double)(b->mperf - a->mperf);
+}
+
+/**
+ * Print the effective frequency and the throttling of each interval,
+ * and mark the ones whose loops were slower than in the fastest one
+ * when the frequency dipped or the CPU was throttled in them
+ */
+void npt_msr_print(FILE *fd, const char *prefix) {
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	const struct npt_msr_sample *a, *b;
+	uint64_t i, spike = 0, count, core, package;
+	uint64_t stored = (spikesCount < spikesSize) ? spikesCount : spikesSize;
+	double hz, mean, c0, maxHz = 0.0, minMean = 0.0, sumHz = 0.0, minHz = 0.0;
+	unsigned int intervals = 0, slow = 0, explained = 0, dips = 0, throttled = 0;
+	char throttle[64], spikeCount[24], mark[16];
+	bool isSlow, isDip;
+
+	if (msrCount < 2) return;
+
+	// The references are the fastest interval and the highest frequency
+	for (i = 1; i < msrCount; i++) {
+		hz = _msr_hz(&msrSamples[i - 1], &msrSamples[i]);
+		if (hz == 0.0) continue;
+		mean = (double)(msrSamples[i].ticks - msrSamples[i - 1].ticks)
+			/ (double)(msrSamples[i].loops - msrSamples[i - 1].loops);
+		if (intervals == 0 || hz > maxHz) maxHz = hz;
+		if (intervals == 0 || hz < minHz) minHz = hz;
+		if (intervals == 0 || mean < minMean) minMean = mean;
+		sumHz += hz;
+		intervals++;
+	}
+	if (intervals == 0) return;
+
+	fprintf(fd, "%sMSR:	effective frequency %.3f MHz over %u interval(s) of %gs"
+			" (min %.3f, max %.3f)\n", prefix, sumHz / intervals / 1e6, intervals,
+			globalArgs.msr_interval * 1.0e-6, minHz / 1e6, maxHz / 1e6);
+	if (!msrCoreTherm || !msrPackageTherm)
+		fprintf(fd, "%s	%s thermal status not readable, throttling not tracked\n", prefix,
+				(!msrCoreTherm && !msrPackageTherm) ? "core and package"
+				: (!msrCoreTherm) ? "core" : "package");
+	else
+		fprintf(fd, "%s	throttling seen only when in progress at the ends of an interval\n", prefix);
+	fprintf(fd, "%s	time (s)	loops		mean (%s)	MHz		C0	throttle	spikes	mark\n",
+			prefix, unit);
+
+	for (i = 1; i < msrCount; i++) {
+		a = &msrSamples[i - 1];
+		b = &msrSamples[i];
+
+		// The spikes are in the order of the run, as the intervals
+		for (count = 0; spike < stored && spikes[spike].at <= b->at; spike++)
+			if (spikes[spike].at > a->at) count++;
+
+		hz = _msr_hz(a, b);
+		if (hz == 0.0) continue;
+		mean = (double)(b->ticks - a->ticks) / (double)(b->loops - a->loops);
+		c0 = (double)(b->mperf - a->mperf) / ((double)(b->ns - a->ns) * 1.0e-9 * tscHz);
+		core = _msr_throttled(a->therm, b->therm);
+		package = _msr_throttled(a->packageTherm, b->packageTherm);
+
+		_msr_throttle_name(throttle, sizeof(throttle), core, package);
+		if (globalArgs.threshold > 0) snprintf(spikeCount, sizeof(spikeCount), "%" PRIu64, count);
+		else snprintf(spikeCount, sizeof(spikeCount), "-");
+
+		isSlow = mean > minMean * (1.0 + NPT_MSR_TOLERANCE);
+		isDip = hz < maxHz * (1.0 - NPT_MSR_TOLERANCE);
+		if (isDip) dips++;
+		if (core != 0 || package != 0) throttled++;
+		if (isSlow) slow++;
+		if (isSlow && (isDip || core != 0 || package != 0)) explained++;
+		snprintf(mark, sizeof(mark), "%s%s%s", isSlow ? " slow" : "", isDip ? " dip" : "",
+				(isSlow && (isDip || core != 0 || package != 0)) ? " <-" : "");
+
+		fprintf(fd, "%s	%.3f		%" PRIu64 "	%.6f	%.3f	%.1f%%	%s		%s	%s\n",
+				prefix, (double)(a->ns - msrSamples[0].ns) * 1.0e-9, b->loops - a->loops,
+				mean * globalArgs.cpuPeriod, hz / 1e6, (c0 < 1.0) ? c0 * 100.0 : 100.0,
+				throttle + 1, spikeCount, (mark[0] != '\0') ? mark + 1 : "");
+	}
+
+	fprintf(fd, "%s	%u slow interval(s) (mean over %g%% above the fastest), %u of them (<-) with a"
+			" frequency dip (over %g%% under the highest) or throttling; %u dip(s),"
+			" %u throttled interval(s)\n", prefix, slow, NPT_MSR_TOLERANCE * 100.0, explained,
+			NPT_MSR_TOLERANCE * 100.0, dips, throttled);
+	if (stored < spikesCount)
+		fprintf(fd, "%s	spikes over the first %" PRIu64 " only, see --max-spikes\n", prefix, stored);
+}
@@ -36,6 +36,28 @@
 #include <unistd.h>	// getuid
 
 #include <npt/npt.h>
+#include <npt/chase.h>
+#include <npt/converge.h>
+#include <npt/housekeeping.h>
+#include <npt/inject.h>
+#include <npt/irqdiff.h>
+#include <npt/load.h>
+#include <npt/metrics.h>
+#include <npt/msr.h>
+#include <npt/numa.h>
+#include <npt/replay.h>
+#include <npt/scenario.h>
+#include <npt/sched.h>
+#include <npt/schedtrace.h>
+#include <npt/shm.h>
+#include <npt/signals.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+#include <npt/spikes.h>
+#include <npt/stolen.h>
+#include <npt/tsc.h>
+#include <npt/wait.h>
+#include <npt/workload.h>
 #include <version.h>
 
 /**
@@ -58,16 +80,54 @@ void initopt() {
 	WINDOWTRACE_OPTION_INIT
 	WINDOWWAIT_OPTION_INIT
 
+	globalArgs.soak_period = 0;
+	globalArgs.checkpoint = NULL;
+	globalArgs.replay = NULL;
+	globalArgs.raw_dump = NULL;
+	globalArgs.threshold = 0;
+	globalArgs.spike_bin = NPT_DEFAULT_SPIKE_BIN;
+	globalArgs.max_spikes = NPT_DEFAULT_MAX_SPIKES;
+	globalArgs.metrics_file = NULL;
+	globalArgs.metrics_port = 0;
+	globalArgs.metrics_interval = NPT_DEFAULT_METRICS_INTERVAL;
+	globalArgs.smt_sibling = NULL;
+	globalArgs.stress = NULL;
+	globalArgs.stress_cpus = NULL;
+	globalArgs.pointer_chase = 0;
+	globalArgs.chase_hops = NPT_DEFAULT_CHASE_HOPS;
+	globalArgs.workload = NULL;
+	globalArgs.converge = 0;
+	globalArgs.converge_precision = NPT_DEFAULT_CONVERGE_PRECISION;
+	globalArgs.policy = SCHED_FIFO;
+	globalArgs.dl_runtime = NPT_DEFAULT_DL_RUNTIME;
+	globalArgs.dl_deadline = NPT_DEFAULT_DL_DEADLINE;
+	globalArgs.dl_period = NPT_DEFAULT_DL_PERIOD;
+	globalArgs.sweep = NULL;
+	globalArgs.sweep_prios = NULL;
+	globalArgs.sweep_cpus = NULL;
+	globalArgs.tsc_interval = NPT_DEFAULT_TSC_INTERVAL;
+	globalArgs.tsc_tolerance = NPT_DEFAULT_TSC_TOLERANCE;
+	globalArgs.sketch = NULL;
+	globalArgs.sched_trace = false;
+	globalArgs.inject = NULL;
+	globalArgs.inject_rate = NPT_DEFAULT_INJECT_RATE;
+	globalArgs.stolen_interval = NPT_DEFAULT_STOLEN_INTERVAL;
+	globalArgs.scenario = NULL;
+	globalArgs.irq_diff = 0;
+	globalArgs.wait = NULL;
+	globalArgs.wait_period = NPT_DEFAULT_WAIT_PERIOD;
+	globalArgs.wait_spin = NPT_DEFAULT_WAIT_SPIN;
+	globalArgs.msr_interval = 0;
+
 	globalArgs.picoseconds = false;
 	globalArgs.nanoseconds = false;
 	globalArgs.evaluateSpeed = 0;
+	globalArgs.resume = false;
+	globalArgs.shm = false;
 }
 
-/** The array used to store the histogram */
-uint64_t histogram[NPT_HISTOGRAM_SIZE];
-
-/** counter for bigger values than histogram size */
-uint64_t histogramOverruns;
+/** The options */
+struct globalArgs_t globalArgs;
 
 /**
  * Show help message
@@ -85,11 +145,96 @@ void npt_help() {
 		CLI_STI_OPTION_HELP
 		"	-l LOOPS	--loops=LOOPS		define the number of loops to do (default: %" PRIu64 ")\n"
 		"	-n NOCOUNT	--nocountloop=NOCOUNT	define the number of loops to do before starting\n"
-		"						analysis (default: %d)\n"
+		"						analysis, or 'auto' to wait until their\n"
+		"						distribution settles (default: %d)\n"
 		"	-o OUTPUT	--output=OUTPUT		output file for storing the report and histogram\n"
 		"			--nanoseconds		do the report and the histogram in nanoseconds\n"
 		"			--picoseconds		do the report and the histogram in picoseconds\n"
 		"	-p PRIO		--prio=PRIO		priority to use as high prio process (default: %d)\n"
+		"			--soak-period=TIME	rotate to a fresh period histogram every TIME\n"
+		"			--checkpoint=DIR	write each closed soak period in DIR\n"
+		"			--resume		resume the run from the checkpoints in DIR\n"
+		"			--raw-dump=FILE		store the duration of each loop in FILE, up to\n"
+		"						LOOPS loops (8 bytes per loop)\n"
+		"			--replay=FILE		compute the report from a raw dump, or from a\n"
+		"						text file of durations or npt:loop events\n"
+		"			--threshold=TIME	record the loops longer than TIME (spikes) and\n"
+		"						search for their dominant periods\n"
+		"			--spike-bin=TIME	resolution of the periodicity analysis\n"
+		"						(default: %dus)\n"
+		"			--max-spikes=NB		number of spikes to keep (default: %d)\n"
+		"			--metrics-file=FILE	export the live results in FILE, in the\n"
+		"						OpenMetrics text format\n"
+		"			--metrics-port=PORT	serve the live results on\n"
+		"						http://127.0.0.1:PORT/metrics\n"
+		"			--metrics-interval=TIME	refresh the exported results every TIME\n"
+		"						(default: %ds)\n"
+		"			--shm			publish the live results in the shared memory\n"
+		"						segment /dev/shm/npt.PID, see npt-top\n"
+		"			--smt-sibling=LOADS	run once per load profile of the comma separated\n"
+		"						list LOADS on the SMT sibling(s) of CPU: idle,\n"
+		"						int, avx512, stream, membw, llc, tlb, timer\n"
+		"						or all\n"
+		"			--stress=LOADS		run once per load profile of LOADS, with a\n"
+		"						stressor on each other online CPU\n"
+		"			--stress-cpus=LIST	run the stressors on the CPUs of LIST instead\n"
+		"			--pointer-chase=SIZE	walk a random pointer chain over a working set\n"
+		"						of SIZE bytes (K, M or G suffix) in each loop\n"
+		"			--chase-hops=NB		number of pointers walked in each loop\n"
+		"						(default: %d)\n"
+		"			--workload=LIB:SYMBOL	time the calls of the function SYMBOL of the\n"
+		"						plugin LIB, see npt/plugin.h\n"
+		"			--converge=PERCENTILE	stop once the confidence interval of the\n"
+		"						PERCENTILE is tight enough, LOOPS or the\n"
+		"						duration being the upper limit\n"
+		"			--converge-ci=PCT	relative half-width of the 95%% confidence\n"
+		"						interval to reach (default: %g%%)\n"
+		"			--policy=POLICY		scheduling policy of the loop: fifo, rr,\n"
+		"						deadline or other (default: fifo)\n"
+		"			--deadline=R,D,P	runtime, deadline and period of the deadline\n"
+		"						policy in us (default: %d,%d,%d)\n"
+		"			--sweep=POLICIES	run once per combination of the comma separated\n"
+		"						POLICIES, priorities and CPUs\n"
+		"			--sweep-prios=LIST	priorities of the sweep (default: PRIO)\n"
+		"			--sweep-cpus=LIST	CPUs of the sweep (default: CPU)\n"
+		"			--tsc-interval=TIME	check the TSC frequency against the raw\n"
+		"						monotonic clock every TIME, 0 to disable\n"
+		"						(default: %ds)\n"
+		"			--tsc-tolerance=PPM	drift from the calibrated frequency beyond\n"
+		"						which an interval is flagged and its\n"
+		"						durations rescaled (default: %gppm)\n"
+		"			--msr-interval=TIME	read APERF, MPERF and the throttling status of\n"
+		"						CPU through /dev/cpu/CPU/msr every TIME, and\n"
+		"						mark the intervals whose loops slowed down with\n"
+		"						the frequency or a throttling in progress at\n"
+		"						their ends, 0 to disable (default: 0)\n"
+		"			--sketch=FILE		write a mergeable sketch of the durations in\n"
+		"						FILE, see npt-sketch-merge\n"
+		"			--sched-trace		trace the tasks and interrupts of CPU and rank\n"
+		"						the ones that ran during the spikes, see\n"
+		"						--threshold\n"
+		"			--inject=LIST		self-test: take the CPU from the loop for each\n"
+		"						comma separated size of LIST in us in turn,\n"
+		"						from another CPU, and report how many are\n"
+		"						detected over the threshold (default: 1us)\n"
+		"			--inject-rate=HZ	rate of the disturbances (default: %d)\n"
+		"			--stolen-interval=TIME	interval over which the stolen time is summed\n"
+		"						(default: %ds)\n"
+		"			--scenario=FILE		run once per line of FILE: a run name followed\n"
+		"						by its options, on top of the other ones, the\n"
+		"						CPU frequency being measured once\n"
+		"			--irq-diff=PAIRS	split the run in PAIRS pairs of phases with the\n"
+		"						interrupts enabled and disabled, and split the\n"
+		"						gaps over the threshold between the interrupts\n"
+		"						and the non-maskable stalls (default: 1us)\n"
+		"			--wait=LIST		instead of the loop, wait for a periodic event\n"
+		"						with each comma separated strategy of LIST in\n"
+		"						turn: busy, spin, sleep, timerfd or epoll, for\n"
+		"						the duration or LOOPS events (default: %d),\n"
+		"						and compare the latencies and CPU usage\n"
+		"			--wait-period=TIME	period of the event (default: %dus)\n"
+		"			--wait-spin=TIME	time the spin strategy polls before it sleeps\n"
+		"						(default: %dus)\n"
 		WINDOWTRACE_OPTION_HELP
 		WINDOWWAIT_OPTION_HELP
 		VERBOSE_OPTION_HELP
@@ -97,7 +242,22 @@ void npt_help() {
 		globalArgs.affinity,
 		globalArgs.loops,
 		globalArgs.nocountloop,
-		globalArgs.priority
+		globalArgs.priority,
+		NPT_DEFAULT_SPIKE_BIN,
+		NPT_DEFAULT_MAX_SPIKES,
+		NPT_DEFAULT_METRICS_INTERVAL / 1000000,
+		NPT_DEFAULT_CHASE_HOPS,
+		NPT_DEFAULT_CONVERGE_PRECISION,
+		NPT_DEFAULT_DL_RUNTIME / 1000,
+		NPT_DEFAULT_DL_DEADLINE / 1000,
+		NPT_DEFAULT_DL_PERIOD / 1000,
+		NPT_DEFAULT_TSC_INTERVAL / 1000000,
+		NPT_DEFAULT_TSC_TOLERANCE,
+		NPT_DEFAULT_INJECT_RATE,
+		NPT_DEFAULT_STOLEN_INTERVAL / 1000000,
+		NPT_DEFAULT_WAIT_EVENTS,
+		NPT_DEFAULT_WAIT_PERIOD,
+		NPT_DEFAULT_WAIT_SPIN
 	      );
 }
 
@@ -142,6 +302,39 @@ int _human_readable_second(char *optarg, uint64_t *arg, char *argname) {
 	return ret;
 }
 
+/**
+ * Accept human-readable size format, with the binary K, M and G suffixes
+ */
+int _human_readable_size(char *optarg, uint64_t *arg, char *argname) {
+	char *end;
+
+	errno = 0;
+	*arg = strtoull(optarg, &end, 10);
+	if (errno != 0 || end == optarg || optarg[0] == '-')
+		goto err;
+
+	switch (*end) {
+		case 'G':
+			(*arg) <<= 10;
+			// Fall through
+		case 'M':
+			(*arg) <<= 10;
+			// Fall through
+		case 'K':
+			(*arg) <<= 10;
+			end++;
+			break;
+	}
+	if (*end != '\0')
+		goto err;
+	return 0;
+
+err:
+	fprintf(stderr, "%s: argument must be an unsigned int,"
+			" followed or not by K, M or G\n", argname);
+	return 1;
+}
+
 /**
  * Accept human-readable time format up to microsecond
  */
@@ -228,10 +421,48 @@ int npt_getopt(int argc, char **argv) {
 			{"version",		no_argument,		0,	'V'},
 			WINDOWTRACE_OPTION_LONG
 			WINDOWWAIT_OPTION_LONG
+			{"soak-period",		required_argument,	0,	4},
+			{"checkpoint",		required_argument,	0,	5},
+			{"replay",		required_argument,	0,	6},
+			{"raw-dump",		required_argument,	0,	7},
+			{"threshold",		required_argument,	0,	8},
+			{"spike-bin",		required_argument,	0,	9},
+			{"max-spikes",		required_argument,	0,	10},
+			{"metrics-file",	required_argument,	0,	11},
+			{"metrics-port",	required_argument,	0,	12},
+			{"metrics-interval",	required_argument,	0,	13},
+			{"smt-sibling",		required_argument,	0,	14},
+			{"stress",		required_argument,	0,	15},
+			{"stress-cpus",		required_argument,	0,	16},
+			{"pointer-chase",	required_argument,	0,	17},
+			{"chase-hops",		required_argument,	0,	18},
+			{"workload",		required_argument,	0,	19},
+			{"converge",		required_argument,	0,	20},
+			{"converge-ci",		required_argument,	0,	21},
+			{"policy",		required_argument,	0,	22},
+			{"deadline",		required_argument,	0,	23},
+			{"sweep",		required_argument,	0,	24},
+			{"sweep-prios",		required_argument,	0,	25},
+			{"sweep-cpus",		required_argument,	0,	26},
+			{"tsc-interval",	required_argument,	0,	27},
+			{"tsc-tolerance",	required_argument,	0,	28},
+			{"sketch",		required_argument,	0,	29},
+			{"sched-trace",		no_argument,		0,	30},
+			{"inject",		required_argument,	0,	31},
+			{"inject-rate",		required_argument,	0,	32},
+			{"stolen-interval",	required_argument,	0,	33},
+			{"scenario",		required_argument,	0,	34},
+			{"irq-diff",		required_argument,	0,	35},
+			{"wait",		required_argument,	0,	36},
+			{"wait-period",		required_argument,	0,	37},
+			{"wait-spin",		required_argument,	0,	38},
+			{"msr-interval",	required_argument,	0,	39},
 
 			// Flags options
 			{"nanoseconds",		no_argument, &globalArgs.nanoseconds, true},
 			{"picoseconds",		no_argument, &globalArgs.picoseconds, true},
+			{"resume",		no_argument, &globalArgs.resume, true},
+			{"shm",			no_argument, &globalArgs.shm, true},
 			{0, 0, 0, 0}
 		};
 		/* getopt_long stores the option index here. */
@@ -319,8 +550,11 @@ int npt_getopt(int argc, char **argv) {
 
 			// Option --nocountloop (-n)
 			case 'n':
-				if (sscanf(optarg, "%u", &globalArgs.nocountloop) == 0) {
-					fprintf(stderr, "--nocountloop: argument must be an unsigned int\n");
+				if (strcmp(optarg, "auto") == 0) {
+					globalArgs.nocountloop = NPT_NOCOUNTLOOP_AUTO;
+				} else if (sscanf(optarg, "%d", &globalArgs.nocountloop) != 1
+					|| globalArgs.nocountloop < 0) {
+					fprintf(stderr, "--nocountloop: argument must be an unsigned int or 'auto'\n");
 					return 1;
 				}
 				break;
@@ -359,6 +593,331 @@ int npt_getopt(int argc, char **argv) {
 			// Option --wait-window
 			WINDOWWAIT_OPTION_CASE
 
+			// Option --soak-period
+			case 4:
+				if (_human_readable_second(optarg, &globalArgs.soak_period, "--soak-period") != 0) {
+					return 1;
+				} else if (globalArgs.soak_period == 0) {
+					fprintf(stderr, "--soak-period: argument must be at least one second\n");
+					return 1;
+				}
+				break;
+
+			// Option --checkpoint
+			case 5:
+				if (asprintf(&globalArgs.checkpoint, "%s", optarg) < 0) {
+					fprintf(stderr, "--checkpoint: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --replay
+			case 6:
+				if (asprintf(&globalArgs.replay, "%s", optarg) < 0) {
+					fprintf(stderr, "--replay: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --raw-dump
+			case 7:
+				if (asprintf(&globalArgs.raw_dump, "%s", optarg) < 0) {
+					fprintf(stderr, "--raw-dump: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --threshold
+			case 8:
+				if (_human_readable_microsecond(optarg, &globalArgs.threshold, "--threshold") != 0) {
+					return 1;
+				}
+				break;
+
+			// Option --spike-bin
+			case 9:
+				if (_human_readable_microsecond(optarg, &globalArgs.spike_bin, "--spike-bin") != 0) {
+					return 1;
+				} else if (globalArgs.spike_bin == 0) {
+					fprintf(stderr, "--spike-bin: argument must be at least one microsecond\n");
+					return 1;
+				}
+				break;
+
+			// Option --max-spikes
+			case 10:
+				if (sscanf(optarg, "%" PRIu64 "", &globalArgs.max_spikes) == 0
+					|| globalArgs.max_spikes == 0) {
+					fprintf(stderr, "--max-spikes: argument must be a positive 64bits unsigned int\n");
+					return 1;
+				}
+				break;
+
+			// Option --metrics-file
+			case 11:
+				if (asprintf(&globalArgs.metrics_file, "%s", optarg) < 0) {
+					fprintf(stderr, "--metrics-file: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --metrics-port
+			case 12:
+				if (sscanf(optarg, "%u", &globalArgs.metrics_port) == 0
+					|| globalArgs.metrics_port == 0 || globalArgs.metrics_port > 65535) {
+					fprintf(stderr, "--metrics-port: argument must be a port between 1 and 65535\n");
+					return 1;
+				}
+				break;
+
+			// Option --metrics-interval
+			case 13:
+				if (_human_readable_microsecond(optarg, &globalArgs.metrics_interval, "--metrics-interval") != 0) {
+					return 1;
+				} else if (globalArgs.metrics_interval < 1000) {
+					fprintf(stderr, "--metrics-interval: argument must be at least one millisecond\n");
+					return 1;
+				}
+				break;
+
+			// Option --smt-sibling
+			case 14:
+				if (asprintf(&globalArgs.smt_sibling, "%s", optarg) < 0) {
+					fprintf(stderr, "--smt-sibling: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --stress
+			case 15:
+				if (asprintf(&globalArgs.stress, "%s", optarg) < 0) {
+					fprintf(stderr, "--stress: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --stress-cpus
+			case 16:
+				if (asprintf(&globalArgs.stress_cpus, "%s", optarg) < 0) {
+					fprintf(stderr, "--stress-cpus: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --pointer-chase
+			case 17:
+				if (_human_readable_size(optarg, &globalArgs.pointer_chase, "--pointer-chase") != 0) {
+					return 1;
+				} else if (globalArgs.pointer_chase < 2 * NPT_CHASE_LINE) {
+					fprintf(stderr, "--pointer-chase: argument must be at least %d bytes\n",
+							2 * NPT_CHASE_LINE);
+					return 1;
+				}
+				break;
+
+			// Option --chase-hops
+			case 18:
+				if (sscanf(optarg, "%u", &globalArgs.chase_hops) == 0
+					|| globalArgs.chase_hops == 0) {
+					fprintf(stderr, "--chase-hops: argument must be a positive int\n");
+					return 1;
+				}
+				break;
+
+			// Option --workload
+			case 19:
+				if (asprintf(&globalArgs.workload, "%s", optarg) < 0) {
+					fprintf(stderr, "--workload: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --converge
+			case 20:
+				if (sscanf(optarg, "%lf", &globalArgs.converge) != 1
+					|| globalArgs.converge <= 0 || globalArgs.converge >= 100) {
+					fprintf(stderr, "--converge: argument must be a percentile between 0 and 100\n");
+					return 1;
+				}
+				break;
+
+			// Option --converge-ci
+			case 21:
+				if (sscanf(optarg, "%lf", &globalArgs.converge_precision) != 1
+					|| globalArgs.converge_precision <= 0) {
+					fprintf(stderr, "--converge-ci: argument must be a positive percentage\n");
+					return 1;
+				}
+				break;
+
+			// Option --policy
+			case 22:
+				globalArgs.policy = npt_sched_parse_policy(optarg);
+				if (globalArgs.policy < 0) {
+					fprintf(stderr, "--policy: argument must be fifo, rr, deadline or other\n");
+					return 1;
+				}
+				break;
+
+			// Option --deadline
+			case 23:
+				if (sscanf(optarg, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &globalArgs.dl_runtime,
+						&globalArgs.dl_deadline, &globalArgs.dl_period) != 3
+					|| globalArgs.dl_runtime == 0
+					|| globalArgs.dl_runtime > globalArgs.dl_deadline
+					|| globalArgs.dl_deadline > globalArgs.dl_period) {
+					fprintf(stderr, "--deadline: argument must be RUNTIME,DEADLINE,PERIOD"
+							" in us, with RUNTIME <= DEADLINE <= PERIOD\n");
+					return 1;
+				}
+				globalArgs.dl_runtime *= 1000;
+				globalArgs.dl_deadline *= 1000;
+				globalArgs.dl_period *= 1000;
+				break;
+
+			// Option --sweep
+			case 24:
+				if (asprintf(&globalArgs.sweep, "%s", optarg) < 0) {
+					fprintf(stderr, "--sweep: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --sweep-prios
+			case 25:
+				if (asprintf(&globalArgs.sweep_prios, "%s", optarg) < 0) {
+					fprintf(stderr, "--sweep-prios: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --sweep-cpus
+			case 26:
+				if (asprintf(&globalArgs.sweep_cpus, "%s", optarg) < 0) {
+					fprintf(stderr, "--sweep-cpus: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --tsc-interval
+			case 27:
+				if (_human_readable_microsecond(optarg, &globalArgs.tsc_interval, "--tsc-interval") != 0) {
+					return 1;
+				} else if (globalArgs.tsc_interval != 0 && globalArgs.tsc_interval < 1000) {
+					fprintf(stderr, "--tsc-interval: argument must be 0 or at least one millisecond\n");
+					return 1;
+				}
+				break;
+
+			// Option --tsc-tolerance
+			case 28:
+				if (sscanf(optarg, "%lf", &globalArgs.tsc_tolerance) != 1
+					|| globalArgs.tsc_tolerance <= 0) {
+					fprintf(stderr, "--tsc-tolerance: argument must be a positive number of ppm\n");
+					return 1;
+				}
+				break;
+
+			// Option --sketch
+			case 29:
+				if (asprintf(&globalArgs.sketch, "%s", optarg) < 0) {
+					fprintf(stderr, "--sketch: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --sched-trace
+			case 30:
+				globalArgs.sched_trace = true;
+				break;
+
+			// Option --inject
+			case 31:
+				if (asprintf(&globalArgs.inject, "%s", optarg) < 0
+					|| npt_inject_parse(optarg) != EXIT_SUCCESS) {
+					fprintf(stderr, "--inject: argument must be comma separated sizes in us\n");
+					return 1;
+				}
+				break;
+
+			// Option --inject-rate
+			case 32:
+				if (sscanf(optarg, "%u", &globalArgs.inject_rate) != 1
+					|| globalArgs.inject_rate == 0 || globalArgs.inject_rate > 100000) {
+					fprintf(stderr, "--inject-rate: argument must be between 1 and 100000\n");
+					return 1;
+				}
+				break;
+
+			// Option --stolen-interval
+			case 33:
+				if (_human_readable_microsecond(optarg, &globalArgs.stolen_interval, "--stolen-interval") != 0) {
+					return 1;
+				} else if (globalArgs.stolen_interval < 1000) {
+					fprintf(stderr, "--stolen-interval: argument must be at least one millisecond\n");
+					return 1;
+				}
+				break;
+
+			// Option --scenario
+			case 34:
+				if (asprintf(&globalArgs.scenario, "%s", optarg) < 0) {
+					fprintf(stderr, "--scenario: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --irq-diff
+			case 35:
+#ifdef ENABLE_CLI_STI
+				if (sscanf(optarg, "%u", &globalArgs.irq_diff) != 1
+					|| globalArgs.irq_diff == 0 || globalArgs.irq_diff > NPT_IRQDIFF_MAX_PAIRS) {
+					fprintf(stderr, "--irq-diff: argument must be between 1 and %d\n",
+							NPT_IRQDIFF_MAX_PAIRS);
+					return 1;
+				}
+				break;
+#else /* ENABLE_CLI_STI */
+				fprintf(stderr, "--irq-diff: needs to disable the interrupts, see "
+						"the --enable-cli-sti configure option\n");
+				return 1;
+#endif /* ENABLE_CLI_STI */
+
+			// Option --wait
+			case 36:
+				if (asprintf(&globalArgs.wait, "%s", optarg) < 0) {
+					fprintf(stderr, "--wait: argument invalid\n");
+					return 1;
+				}
+				break;
+
+			// Option --wait-period
+			case 37:
+				if (_human_readable_microsecond(optarg, &globalArgs.wait_period, "--wait-period") != 0) {
+					return 1;
+				} else if (globalArgs.wait_period == 0) {
+					fprintf(stderr, "--wait-period: argument must be at least one microsecond\n");
+					return 1;
+				}
+				break;
+
+			// Option --wait-spin
+			case 38:
+				if (_human_readable_microsecond(optarg, &globalArgs.wait_spin, "--wait-spin") != 0) {
+					return 1;
+				}
+				break;
+
+			// Option --msr-interval
+			case 39:
+				if (_human_readable_microsecond(optarg, &globalArgs.msr_interval, "--msr-interval") != 0) {
+					return 1;
+				} else if (globalArgs.msr_interval > 0 && globalArgs.msr_interval < 1000) {
+					fprintf(stderr, "--msr-interval: argument must be 0 or at least one millisecond\n");
+					return 1;
+				}
+				break;
+
 			case '?':
 				/* getopt_long already printed an error message. */
 				return 1;
@@ -370,6 +929,75 @@ int npt_getopt(int argc, char **argv) {
 		}
 	}
 
+	// Check the options that depend on each other
+	if (globalArgs.checkpoint != NULL && globalArgs.soak_period == 0) {
+		fprintf(stderr, "--checkpoint: needs a soak period, see --soak-period\n");
+		return 1;
+	}
+	if (globalArgs.resume && globalArgs.checkpoint == NULL) {
+		fprintf(stderr, "--resume: needs a checkpoint directory, see --checkpoint\n");
+		return 1;
+	}
+	if ((globalArgs.smt_sibling != NULL || globalArgs.stress != NULL)
+		&& (globalArgs.soak_period > 0 || globalArgs.raw_dump != NULL)) {
+		fprintf(stderr, "--smt-sibling, --stress: run once per load profile, which is "
+				"not possible with --soak-period or --raw-dump\n");
+		return 1;
+	}
+	if (globalArgs.workload != NULL && globalArgs.pointer_chase > 0) {
+		fprintf(stderr, "--workload: only one workload at a time, not with --pointer-chase\n");
+		return 1;
+	}
+	if (globalArgs.stress_cpus != NULL && globalArgs.stress == NULL) {
+		fprintf(stderr, "--stress-cpus: needs load profiles, see --stress\n");
+		return 1;
+	}
+	if (globalArgs.sweep != NULL && (globalArgs.smt_sibling != NULL || globalArgs.stress != NULL
+			|| globalArgs.soak_period > 0 || globalArgs.raw_dump != NULL)) {
+		fprintf(stderr, "--sweep: runs once per combination, which is not possible with "
+				"the load modes, --soak-period or --raw-dump\n");
+		return 1;
+	}
+	if ((globalArgs.sweep_prios != NULL || globalArgs.sweep_cpus != NULL)
+		&& globalArgs.sweep == NULL) {
+		fprintf(stderr, "--sweep-prios, --sweep-cpus: need policies, see --sweep\n");
+		return 1;
+	}
+	if (globalArgs.scenario != NULL && (globalArgs.replay != NULL || globalArgs.sweep != NULL
+			|| globalArgs.smt_sibling != NULL || globalArgs.stress != NULL
+			|| globalArgs.soak_period > 0 || globalArgs.raw_dump != NULL)) {
+		fprintf(stderr, "--scenario: runs once per line of FILE, which is not possible with "
+				"--replay, the load modes, --sweep, --soak-period or --raw-dump\n");
+		return 1;
+	}
+	if (globalArgs.sched_trace && globalArgs.threshold == 0) {
+		fprintf(stderr, "--sched-trace: needs spikes to match, see --threshold\n");
+		return 1;
+	}
+	if (globalArgs.inject != NULL && sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+		fprintf(stderr, "--inject: needs another online CPU for the injector\n");
+		return 1;
+	}
+	if (globalArgs.irq_diff > 0 && globalArgs.converge > 0) {
+		fprintf(stderr, "--irq-diff: the phases share the whole run, which is not possible "
+				"with --converge\n");
+		return 1;
+	}
+	if ((globalArgs.inject != NULL || globalArgs.irq_diff > 0) && globalArgs.threshold == 0)
+		globalArgs.threshold = 1;
+	if (globalArgs.wait != NULL && (globalArgs.replay != NULL || globalArgs.scenario != NULL
+			|| globalArgs.sweep != NULL || globalArgs.smt_sibling != NULL
+			|| globalArgs.stress != NULL || globalArgs.soak_period > 0
+			|| globalArgs.raw_dump != NULL || globalArgs.irq_diff > 0
+			|| globalArgs.inject != NULL)) {
+		fprintf(stderr, "--wait: runs instead of the loop, which is not possible with "
+				"--replay, --scenario, --sweep, the load modes, --soak-period, "
+				"--raw-dump, --irq-diff or --inject\n");
+		return 1;
+	}
+	if (globalArgs.wait != NULL && globalArgs.loops == NPT_DEFAULT_LOOP_NUMBER)
+		globalArgs.loops = NPT_DEFAULT_WAIT_EVENTS;
+
 #ifdef DEBUG
 	/* Print any remaining command line arguments (not options). */
 	if (optind < argc) {
@@ -468,115 +1096,13 @@ unsigned long get_cpu_speed() {
 	else return _get_cpu_speed_from_proc_cpuinfo();
 }
 
-/**
- * Function to calculate the time difference between two rdtsc
- */
-static __inline__ double diff(uint64_t start, uint64_t end) {
-	if (globalArgs.cpuHz == 0) return 0.0;
-	else if (end < start)
-		return (double)(UINT64_MAX-start+end+1) * globalArgs.cpuPeriod;
-	else return (double)(end-start) * globalArgs.cpuPeriod;
-}
-
-/**
- * The loop
- */
-int cycle() {
-	double duration = 0;
-	counter = 0;
-	uint64_t t0, t1;
-
-	TPMAXFREQ_WORK_INIT
-
-	// General statistics
-	minDuration = 99999.0;
-	maxDuration = 0.0;
-	sumDuration = 0.0;
-
-	// For variance and standard deviation
-	double deltaDuration = 0.0;
-	meanDuration = 0.0;
-	double meanSquared = 0.0;
-	variance_n = 0.0;
-	stdDeviation = 0.0;
-
-	// Windows mode
-	WINDOW_WORK_INIT
-
-	// Time declaration for the first loop
-	t0 = rdtsc();
-	t1 = t0;
-
-	uint64_t sum64 = 0;
-	uint64_t compareMax;
-	uint64_t* compareMin;
-	if (globalArgs.duration > 0) {
-		compareMax = globalArgs.duration;
-		compareMin = &sum64;
-	} else {
-		compareMax = globalArgs.loops+NPT_NOCOUNTLOOP;
-		compareMin = &counter;
-	}
-
-	UST_TRACE_START
-
-	// We are cycling NPT_NOCOUNTLOOP more times to let the system
-	// enters in the loop period we want to analyze
-	duration = 0;
-	while (*compareMin < compareMax) {
-		NPT_TRACE_LOOP
-
-		// Increment counter as we have done one more loop
-		counter++;
-
-		// Update stat variables
-		if (counter > NPT_NOCOUNTLOOP) {
-			// General statistics
-			if (duration < minDuration) minDuration = duration;
-			if (duration > maxDuration) maxDuration = duration;
-			sumDuration += duration;
-			sum64 = (uint64_t)sumDuration;
-
-			WINDOW_WORK_LOOP
-
-			// For variance and standard deviation
-			deltaDuration = duration - meanDuration;
-			meanDuration = meanDuration
-				+ deltaDuration / (double)(counter-NPT_NOCOUNTLOOP);
-			meanSquared = meanSquared
-				+ deltaDuration * (duration - meanDuration);
-
-			// Store data in the histogram if duration < max size
-			if (duration < NPT_HISTOGRAM_SIZE)
-				histogram[(int)duration]++;
-			else histogramOverruns++;
-		}
-
-		// Get new t0 from rdtsc function
-		t1 = t0;
-		t0 = rdtsc();
-
-		// Calculate diff between t0 and t1
-		duration = diff(t1, t0);
-	}
-
-	UST_TRACE_STOP
-
-	// Readapt the counter to the number of counted loops
-	counter = counter-NPT_NOCOUNTLOOP;
-
-	// Calcul of variance dans standard deviation
-	variance_n = meanSquared / (double)counter;
-	stdDeviation = sqrt(variance_n);
-
-	return 0;
-}
-
 int print_results() {
 	int i;
 	FILE *hfd = NULL;
 
 	// Print the statistics
+	if (signalStopped != 0)
+		printf("# Run stopped by %s, partial results\n", strsignal(signalStopped));
 	printf("%" PRIu64 " loops done.\n", counter);
 	printf("Loops duration:\n");
 	printf("	min:		%.6f %s\n", minDuration, UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
@@ -586,6 +1112,21 @@ int print_results() {
 	printf("	variance:	%g %s\n", variance_n, UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
 	printf("	std dev:	%.6f %s\n", stdDeviation, UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
 	TPMAXFREQ_STATS_PRINT
+	npt_converge_print(stdout, "");
+	npt_stolen_print(stdout, "");
+	npt_irqdiff_print(stdout, "");
+	npt_workload_print(stdout, "");
+	npt_chase_print(stdout, "");
+	npt_load_print(stdout, "");
+	npt_scenario_print(stdout, "");
+	npt_sched_print(stdout, "");
+	npt_tsc_print(stdout, "");
+	npt_msr_print(stdout, "");
+	npt_schedtrace_print(stdout, "");
+	npt_inject_print(stdout, "");
+	npt_soak_print(stdout, "");
+	npt_periodicity_print(stdout, "");
+	npt_numa_print(stdout, "");
 
 	// If we want to save the histogram in a file
 	if (globalArgs.output != NULL) {
@@ -597,6 +1138,8 @@ int print_results() {
 			fprintf(hfd, "# Data generated by NPT for %" PRIu64 " loops\n", globalArgs.loops);
 			fprintf(hfd, "# The time values are expressed in %s.\n", UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
 			fprintf(hfd, "#\n");
+			if (signalStopped != 0)
+				fprintf(hfd, "# Run stopped by %s, partial results\n", strsignal(signalStopped));
 			fprintf(hfd, "# %" PRIu64 " loops done.\n", counter);
 			fprintf(hfd, "#\n");
 			fprintf(hfd, "#General statistics of loops duration:\n");
@@ -607,6 +1150,21 @@ int print_results() {
 			fprintf(hfd, "#	variance:	%g\n", variance_n);
 			fprintf(hfd, "#	std dev:	%.6f\n", stdDeviation);
 			TPMAXFREQ_STATS_FILE
+			npt_converge_print(hfd, "#");
+			npt_stolen_print(hfd, "#");
+			npt_irqdiff_print(hfd, "#");
+			npt_workload_print(hfd, "#");
+			npt_chase_print(hfd, "#");
+			npt_load_print(hfd, "#");
+			npt_scenario_print(hfd, "#");
+			npt_sched_print(hfd, "#");
+			npt_tsc_print(hfd, "#");
+			npt_msr_print(hfd, "#");
+			npt_schedtrace_print(hfd, "#");
+			npt_inject_print(hfd, "#");
+			npt_soak_print(hfd, "#");
+			npt_periodicity_print(hfd, "#");
+			npt_numa_print(hfd, "#");
 			fprintf(hfd, "#\n");
 			fprintf(hfd, "#	time	nb. loops\n");
 			fprintf(hfd, "#	------------------\n");
@@ -624,9 +1182,16 @@ int print_results() {
 				fprintf(hfd, "	%d	%" PRIu64 "\n", i, histogram[i]);
 		}
 	}
-	if (globalArgs.output != NULL) fclose(hfd);
 	printf("--------------------------\n");
 	printf("Overruns (%d+): %" PRIu64 "\n", NPT_HISTOGRAM_SIZE, histogramOverruns);
+	if (globalArgs.output != NULL) {
+		fprintf(hfd, "#	------------------\n");
+		fprintf(hfd, "# Overruns (%d+): %" PRIu64 "\n", NPT_HISTOGRAM_SIZE, histogramOverruns);
+		fclose(hfd);
+	}
+
+	// Write the mergeable sketch
+	npt_sketch_write(globalArgs.sketch);
 
 	return 0;
 }
@@ -668,9 +1233,11 @@ int setrtmode(bool rt) {
 		}
 
 		// Set RT scheduler
-		if (setrtpriority(globalArgs.priority, SCHED_FIFO) == EXIT_SUCCESS)
-			printf("# Application priority set to %d\n", globalArgs.priority);
-		else return EXIT_FAILURE;
+		if (npt_sched_set(globalArgs.policy, globalArgs.priority) == EXIT_SUCCESS) {
+			printf("# Scheduling policy set to ");
+			npt_sched_describe(stdout, globalArgs.policy, globalArgs.priority);
+			printf("\n");
+		} else return EXIT_FAILURE;
 
 		// Lock the memory to disable swapping
 		if (mlockall(MCL_CURRENT | MCL_FUTURE) == EXIT_SUCCESS)
@@ -697,34 +1264,167 @@ int setrtmode(bool rt) {
 	return ret;
 }
 
+/**
+ * Allocate the buffers of the loop, once pinned so that they are local
+ * to the measured CPU
+ */
+static int _loop_buffers_init() {
+	if (npt_histogram_init() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// Prepare the adaptive warm-up
+	if (npt_converge_init() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// Prepare the working set of the pointer chase, or release the one
+	// of a previous run
+	if (globalArgs.pointer_chase == 0) npt_chase_free();
+	else if (npt_chase_init() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// Prepare the records of the injected disturbances
+	if (globalArgs.inject != NULL && npt_inject_init() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// Prepare the mergeable sketch, or release the one of a previous run
+	if (globalArgs.sketch == NULL) npt_sketch_free();
+	else if (npt_sketch_init() != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	// Prepare the spikes buffer
+	return npt_spikes_init();
+}
+
+/**
+ * Move the buffers of the loop to the node of the CPU it moved to. The
+ * histogram, the spikes and the sketch are kept, as the metrics and the
+ * signal threads may read them at any time, the other ones are allocated
+ * again by _loop_buffers_init.
+ */
+static void _loop_buffers_move() {
+	npt_move_local(histogram);
+	npt_move_local(spikes);
+	npt_move_local(sketch);
+	npt_inject_free();
+	npt_chase_free();
+	npt_converge_free();
+}
+
+static void _loop_buffers_free() {
+	npt_spikes_free();
+	npt_sketch_free();
+	npt_inject_free();
+	npt_chase_free();
+	npt_converge_free();
+	npt_histogram_free();
+}
+
+/**
+ * Print the results of a run of the load modes, of the sweep mode or of
+ * a scenario, in an output file suffixed by the name of the run
+ */
+static void _print_run_results(int run) {
+	char *output = globalArgs.output, *runOutput = NULL;
+	char *sketchFile = globalArgs.sketch, *runSketch = NULL;
+	const char *name = (npt_scenario_runs() > 0) ? npt_scenario_name(run)
+		: (npt_load_runs() > 0) ? npt_load_name(run) : npt_sched_name(run);
+
+	if (output != NULL && asprintf(&runOutput, "%s.%s", output, name) < 0)
+		runOutput = NULL;
+	if (sketchFile != NULL && asprintf(&runSketch, "%s.%s", sketchFile, name) < 0)
+		runSketch = NULL;
+	globalArgs.output = runOutput;
+	globalArgs.sketch = runSketch;
+	print_results();
+	free(runOutput);
+	free(runSketch);
+	globalArgs.output = output;
+	globalArgs.sketch = sketchFile;
+}
+
+/**
+ * Write the comparison of the wait strategies mode in the output file
+ */
+static void _print_wait_results() {
+	FILE *fd;
+
+	if (globalArgs.output == NULL) return;
+	fd = fopen(globalArgs.output, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode.\n", globalArgs.output);
+		return;
+	}
+	fprintf(fd, "# Data generated by NPT for the wait strategies mode\n");
+	fprintf(fd, "# The time values are expressed in %s.\n", UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
+	fprintf(fd, "#\n");
+	if (signalStopped != 0)
+		fprintf(fd, "# Run stopped by %s, partial results\n", strsignal(signalStopped));
+	npt_wait_print(fd, "#");
+	fclose(fd);
+}
+
 int main (int argc, char **argv) {
-	int i, ret = 0;
+	int ret = 0, run = 0, runs = 1, last = -1;
+	unsigned int cpu;
 
 	// Init options and load command line arguments
 	initopt();
 	if (npt_getopt(argc, argv) != EXIT_SUCCESS) exit(1);
 
+	// Parse the runs of the scenario with the same options
+	if (npt_scenario_init(npt_getopt) != EXIT_SUCCESS) exit(1);
+
+	// Unit of the report and the histogram
+	if (globalArgs.picoseconds) multi = 1.0e12;
+	else if (globalArgs.nanoseconds) multi = 1.0e9;
+	else multi = 1.0e6;
+
+	// Scale the microsecond values with the right multiplier
+	globalArgs.threshold *= multi * 1.0e-6;
+	globalArgs.spike_bin *= multi * 1.0e-6;
+
+	// Replay recorded durations, which needs neither root nor RT mode
+	if (globalArgs.replay != NULL) {
+		if (npt_histogram_init() != EXIT_SUCCESS)
+			goto err;
+		if (globalArgs.sketch != NULL && npt_sketch_init() != EXIT_SUCCESS)
+			goto err;
+		reset_statistics();
+		if (npt_replay(globalArgs.replay) != EXIT_SUCCESS)
+			goto err;
+		print_results();
+		goto end;
+	}
+
 	// Running as root ?
 	if (getuid() != 0) {
 		fprintf(stderr, "Root access is needed. -- Aborting!\n");
 		return EXIT_FAILURE;
 	}
 
-	// Prepare histogram
-	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++) histogram[i] = 0;
-	histogramOverruns = 0;
+	// Prepare the load modes, the sweep mode and the wait strategies mode
+	if (npt_load_init() != EXIT_SUCCESS || npt_sched_init() != EXIT_SUCCESS
+		|| npt_wait_init() != EXIT_SUCCESS)
+		goto err;
+
+	// Handle the signals in a dedicated thread, before any other
+	// thread is started so that they all block them
+	if (npt_signals_start() != EXIT_SUCCESS)
+		goto err;
+
+	// Load the workload plugin before entering RT mode
+	if (globalArgs.workload != NULL && npt_workload_init() != EXIT_SUCCESS)
+		goto err;
 
 	// Enter in RT mode
 	if (setrtmode(true) != EXIT_SUCCESS)
-		goto err;
+		goto fail;
 
 	// Get CPU frequency and calculate period
 	globalArgs.cpuHz = get_cpu_speed();
-	if (globalArgs.cpuHz <= 0) exit(1);
+	if (globalArgs.cpuHz <= 0)
+		goto fail;
 
-	if (globalArgs.picoseconds) multi = 1.0e12;
-	else if (globalArgs.nanoseconds) multi = 1.0e9;
-	else multi = 1.0e6;
 	globalArgs.cpuPeriod = multi / (double)globalArgs.cpuHz;
 
 	// Scale duration values with the right multiplier
@@ -735,26 +1435,157 @@ int main (int argc, char **argv) {
 		((globalArgs.evaluateSpeed)?"evaluation":"/proc/cpuinfo"),
 		globalArgs.cpuHz / 1e6);
 
-	if (globalArgs.duration > 0) {
+	// Calibrate the TSC, the reference of its monitor and of the MSRs
+	if (globalArgs.tsc_interval > 0 || globalArgs.msr_interval > 0)
+		printf("# TSC frequency (calibration): %.02f MHz\n", npt_tsc_calibrate() / 1e6);
+
+	// The wait strategies mode runs instead of the loop
+	if (npt_wait_runs() > 0) {
+		if (npt_wait_cycle() != EXIT_SUCCESS) ret = 1;
+		setrtmode(false);
+		npt_signals_stop();
+		npt_wait_print(stdout, "");
+		_print_wait_results();
+		goto end;
+	}
+
+	// Prepare the buffers of the loop, statistics and histogram
+	if (_loop_buffers_init() != EXIT_SUCCESS)
+		goto fail;
+	reset_statistics();
+
+	// Prepare the raw dump
+	if (globalArgs.raw_dump != NULL && npt_raw_dump_init() != EXIT_SUCCESS)
+		goto fail;
+
+	// Prepare the soak mode, which may reload previous results
+	if (globalArgs.soak_period > 0 && npt_soak_init() != EXIT_SUCCESS)
+		goto fail;
+
+	if (npt_scenario_runs() > 0) {
+		printf("# Running %d scenario runs.. Please wait.\n", npt_scenario_runs());
+	} else if (globalArgs.duration > 0) {
 		printf("# Running for %d seconds.. Please wait.\n", (int)(globalArgs.duration/multi));
 	} else {
 		printf("# Running for %" PRIu64 " loops.. Please wait.\n", globalArgs.loops);
 	}
 
-	// Start cycling
-	cycle();
+	// Start the exporter of the live results
+	if (npt_metrics_start() != EXIT_SUCCESS)
+		goto fail;
+
+	// Publish the live results in shared memory
+	if (npt_shm_start() != EXIT_SUCCESS)
+		goto fail;
+
+	// Start cycling, once per load profile in the load modes, once per
+	// combination of policy, priority and CPU in the sweep mode, or once
+	// per run of the scenario
+	npt_numa_start();
+	runs = (npt_load_runs() > 0) ? npt_load_runs() : 1;
+	if (npt_sched_runs() > 0) runs = npt_sched_runs();
+	if (npt_scenario_runs() > 0) runs = npt_scenario_runs();
+	cpu = globalArgs.affinity;
+	for (run = 0; run < runs && signalStopped == 0; run++) {
+		// Move to the CPU of the sweep or scenario run, with buffers
+		// local to it, and kept but resized to the options of a
+		// scenario run on the same CPU
+		if (npt_scenario_start(run) != EXIT_SUCCESS)
+			continue;
+		if (npt_sched_start(run) != EXIT_SUCCESS) {
+			npt_scenario_fail(run);
+			continue;
+		}
+		if (globalArgs.affinity != cpu) {
+			npt_housekeeping_repin();
+			_loop_buffers_move();
+		}
+		if ((globalArgs.affinity != cpu || npt_scenario_runs() > 0)
+			&& _loop_buffers_init() != EXIT_SUCCESS)
+			goto fail;
+		cpu = globalArgs.affinity;
+
+		if (run > 0) reset_statistics();
+		if (npt_load_start(run) != EXIT_SUCCESS)
+			goto fail;
+
+		if (npt_tsc_start() != EXIT_SUCCESS || npt_msr_start() != EXIT_SUCCESS
+			|| npt_schedtrace_start() != EXIT_SUCCESS || npt_inject_start() != EXIT_SUCCESS) {
+			npt_schedtrace_stop();
+			npt_msr_stop();
+			npt_tsc_stop();
+			npt_load_stop(run);
+			goto fail;
+		}
 
-	// Exit RT mode
+		npt_irqdiff_cycle();
+		npt_inject_stop();
+		npt_schedtrace_stop();
+		npt_msr_stop();
+		npt_tsc_stop();
+		last = run;
+
+		npt_scenario_stop(run);
+		npt_sched_stop(run);
+		npt_load_stop(run);
+		if (runs > 1 && run < runs - 1) _print_run_results(run);
+	}
+
+	// Exit RT mode, also when a run failed to start
+stop:
 	setrtmode(false);
+	npt_signals_stop();
+	npt_numa_stop();
+
+	// Export the final results
+	npt_metrics_stop();
+
+	// Write the last soak period and the raw dump
+	npt_soak_stop();
+	if (ret != 0) goto end;
+	npt_raw_dump_write();
 
 	// Generate and print the results & histogram
-	print_results();
+	if (runs > 1 || npt_scenario_runs() > 0) {
+		if (last >= 0) _print_run_results(last);
+		npt_load_print_comparison(stdout, "");
+		npt_sched_print_comparison(stdout, "");
+		npt_scenario_print_comparison(stdout, "");
+		npt_scenario_write();
+	} else print_results();
 
 end:
+	npt_signals_stop();
+	npt_shm_stop();
+	npt_scenario_free();
+
 	// Free variables
 	free(globalArgs.output);
+	free(globalArgs.checkpoint);
+	free(globalArgs.replay);
+	free(globalArgs.raw_dump);
+	free(globalArgs.metrics_file);
+	free(globalArgs.smt_sibling);
+	free(globalArgs.stress);
+	free(globalArgs.stress_cpus);
+	free(globalArgs.sweep);
+	free(globalArgs.sweep_prios);
+	free(globalArgs.sweep_cpus);
+	free(globalArgs.sketch);
+	free(globalArgs.inject);
+	free(globalArgs.scenario);
+	free(globalArgs.wait);
+	_loop_buffers_free();
+	npt_tsc_free();
+	npt_msr_free();
+	npt_workload_free();
+	free(globalArgs.workload);
 	return ret;
 
+fail:
+	ret = 1;
+	goto stop;
+
 err:
 	ret = 1;
 	goto end;
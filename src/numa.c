@@ -0,0 +1,301 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <pthread.h>	// pthread_mutex_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strcmp, memset
+#include <sys/mman.h>	// mmap, munmap
+#include <sys/syscall.h>	// SYS_getcpu, SYS_mbind, SYS_move_pages
+#include <unistd.h>	// syscall, sysconf
+
+#ifdef HAVE_NUMAIF_H
+	#include <numaif.h>	// MPOL_PREFERRED
+#endif /* HAVE_NUMAIF_H */
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+
+/**
+ * A buffer allocated by npt_alloc_local, and where its pages landed
+ */
+struct npt_numa_buffer {
+	char name[32];
+	void *ptr;
+	size_t size;
+	unsigned int cpu;
+	int node;
+	char placement[64];
+};
+
+/** The buffers, kept after they are freed so that they can be reported */
+static struct npt_numa_buffer numaBuffers[NPT_NUMA_MAX_BUFFERS];
+static int numaBuffersCount = 0;
+static pthread_mutex_t numaLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Counters of the per-node numastat, at the start and the end of the
+ * measure
+ */
+#define NPT_NUMASTAT_COUNTERS	4
+static const char *numastatNames[NPT_NUMASTAT_COUNTERS] = {
+	"local_node", "other_node", "numa_miss", "numa_foreign"
+};
+static uint64_t numastat[2][NPT_NUMA_MAX_NODES][NPT_NUMASTAT_COUNTERS];
+static bool numastatNodes[NPT_NUMA_MAX_NODES];
+static int numastatState = 0;
+
+/**
+ * Find where the pages of a buffer are, on a sample of its pages
+ */
+static void _numa_placement(struct npt_numa_buffer *b) {
+#ifdef SYS_move_pages
+	size_t page = sysconf(_SC_PAGESIZE), pages = b->size / page, count, i;
+	void *addresses[NPT_NUMA_SAMPLE_PAGES];
+	int status[NPT_NUMA_SAMPLE_PAGES], nodes[NPT_NUMA_MAX_NODES];
+	int node, len = 0, found = 0;
+
+	count = (pages < NPT_NUMA_SAMPLE_PAGES) ? pages : NPT_NUMA_SAMPLE_PAGES;
+	for (i = 0; i < count; i++)
+		addresses[i] = (char *)b->ptr + (i * pages / count) * page;
+
+	// Without target nodes, move_pages only tells where the pages are
+	if (syscall(SYS_move_pages, 0, count, addresses, NULL, status, 0) != 0) {
+		snprintf(b->placement, sizeof(b->placement), "unknown");
+		return;
+	}
+
+	memset(nodes, 0, sizeof(nodes));
+	for (i = 0; i < count; i++)
+		if (status[i] >= 0 && status[i] < NPT_NUMA_MAX_NODES) nodes[status[i]]++;
+
+	for (node = 0; node < NPT_NUMA_MAX_NODES; node++) {
+		if (nodes[node] == 0) continue;
+		if (nodes[node] == (int)count)
+			len += snprintf(b->placement + len, sizeof(b->placement) - len, "node %d", node);
+		else
+			len += snprintf(b->placement + len, sizeof(b->placement) - len, "%s%d:%.0f%%",
+					found ? " " : "nodes ", node, 100.0 * nodes[node] / count);
+		found++;
+		if (len >= (int)sizeof(b->placement)) break;
+	}
+	if (found == 0) snprintf(b->placement, sizeof(b->placement), "unknown");
+#else /* SYS_move_pages */
+	snprintf(b->placement, sizeof(b->placement), "unknown");
+#endif /* SYS_move_pages */
+}
+
+/**
+ * Allocate a buffer on the NUMA node of the calling thread, and prefault
+ * it there. The thread must already be pinned on the CPU which will use
+ * the buffer. The memory is zeroed and page aligned: the size of the
+ * mapping is kept in the page before it, so that it is always unmapped
+ * whole, even if the buffer is not in the placement report.
+ */
+void *npt_alloc_local(size_t size, const char *name) {
+	size_t page = sysconf(_SC_PAGESIZE), off;
+	unsigned int cpu = 0, node = 0;
+	struct npt_numa_buffer *b = NULL;
+	volatile char *p;
+	char *mapping;
+	int i;
+
+	size = (size + page - 1) / page * page;
+	mapping = mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		fprintf(stderr, "Error: unable to allocate the %s (%zu bytes), %s (%d)\n",
+				name, size, strerror(errno), errno);
+		return NULL;
+	}
+	*(size_t *)mapping = size + page;
+	p = mapping + page;
+
+	// Prefer the local node even if the process has another policy
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) node = 0;
+#if defined(HAVE_NUMAIF_H) && defined(SYS_mbind)
+	{
+		unsigned long nodemask[NPT_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+		if (node < NPT_NUMA_MAX_NODES) {
+			nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+			syscall(SYS_mbind, p, size, MPOL_PREFERRED, nodemask, NPT_NUMA_MAX_NODES + 1, 0);
+		}
+	}
+#endif /* HAVE_NUMAIF_H && SYS_mbind */
+
+	// Fault every page now, from the CPU which will use them
+	for (off = 0; off < size; off += page) p[off] = 0;
+
+	pthread_mutex_lock(&numaLock);
+	for (i = 0; i < numaBuffersCount; i++) {
+		// Buffers allocated again for each run are reported once
+		if (numaBuffers[i].ptr == NULL && numaBuffers[i].cpu == cpu
+			&& strcmp(numaBuffers[i].name, name) == 0) {
+			b = &numaBuffers[i];
+			break;
+		}
+	}
+	if (b == NULL && numaBuffersCount < NPT_NUMA_MAX_BUFFERS)
+		b = &numaBuffers[numaBuffersCount++];
+	if (b != NULL) {
+		snprintf(b->name, sizeof(b->name), "%s", name);
+		b->ptr = (void *)p;
+		b->size = size;
+		b->cpu = cpu;
+		b->node = node;
+		_numa_placement(b);
+	}
+	pthread_mutex_unlock(&numaLock);
+
+	return (void *)p;
+}
+
+/**
+ * Free a buffer allocated by npt_alloc_local
+ */
+void npt_free_local(void *ptr) {
+	char *mapping;
+	int i;
+
+	if (ptr == NULL) return;
+
+	pthread_mutex_lock(&numaLock);
+	for (i = 0; i < numaBuffersCount; i++) {
+		if (numaBuffers[i].ptr == ptr) {
+			numaBuffers[i].ptr = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&numaLock);
+
+	mapping = (char *)ptr - sysconf(_SC_PAGESIZE);
+	munmap(mapping, *(size_t *)mapping);
+}
+
+/**
+ * Move the pages of a buffer allocated by npt_alloc_local to the node of
+ * the calling thread, keeping its content, once the thread moved to
+ * another CPU. The pages stay where they are if they cannot be moved.
+ */
+void npt_move_local(void *ptr) {
+	size_t page = sysconf(_SC_PAGESIZE), size;
+	unsigned int cpu = 0, node = 0;
+	int i;
+
+	if (ptr == NULL) return;
+	size = *(size_t *)((char *)ptr - page) - page;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) node = 0;
+#if defined(HAVE_NUMAIF_H) && defined(SYS_mbind)
+	{
+		unsigned long nodemask[NPT_NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+		if (node < NPT_NUMA_MAX_NODES) {
+			nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+			syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, nodemask, NPT_NUMA_MAX_NODES + 1,
+					MPOL_MF_MOVE);
+		}
+	}
+#endif /* HAVE_NUMAIF_H && SYS_mbind */
+
+	pthread_mutex_lock(&numaLock);
+	for (i = 0; i < numaBuffersCount; i++) {
+		if (numaBuffers[i].ptr == ptr) {
+			numaBuffers[i].cpu = cpu;
+			numaBuffers[i].node = node;
+			_numa_placement(&numaBuffers[i]);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&numaLock);
+}
+
+/**
+ * Read the numastat counters of every node
+ */
+static void _numastat_read(int state) {
+	char filename[64], name[32];
+	uint64_t value;
+	FILE *fd;
+	int node, i;
+
+	for (node = 0; node < NPT_NUMA_MAX_NODES; node++) {
+		snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/numastat", node);
+		fd = fopen(filename, "r");
+		numastatNodes[node] = (fd != NULL);
+		if (fd == NULL) continue;
+		while (fscanf(fd, "%31s %" SCNu64, name, &value) == 2)
+			for (i = 0; i < NPT_NUMASTAT_COUNTERS; i++)
+				if (strcmp(name, numastatNames[i]) == 0)
+					numastat[state][node][i] = value;
+		fclose(fd);
+	}
+}
+
+/**
+ * Take the numastat counters before the measure
+ */
+void npt_numa_start() {
+	_numastat_read(0);
+	numastatState = 1;
+}
+
+/**
+ * Take the numastat counters after the measure
+ */
+void npt_numa_stop() {
+	if (numastatState != 1) return;
+	_numastat_read(1);
+	numastatState = 2;
+}
+
+/**
+ * Print where the buffers landed, and the numastat deltas during the
+ * measure
+ */
+void npt_numa_print(FILE *fd, const char *prefix) {
+	struct npt_numa_buffer *b;
+	int node, i;
+
+	if (numastatState != 2) return;
+
+	fprintf(fd, "%sMemory placement:\n", prefix);
+	fprintf(fd, "%s	%-32sCPU	local node	pages\n", prefix, "buffer");
+	for (i = 0; i < numaBuffersCount; i++) {
+		b = &numaBuffers[i];
+		fprintf(fd, "%s	%-32s%u	%d		%s%s\n", prefix, b->name, b->cpu, b->node,
+				b->placement, (strncmp(b->placement, "node ", 5) == 0
+					&& atoi(b->placement + 5) != b->node) ? " (remote)" : "");
+	}
+
+	fprintf(fd, "%sNUMA statistics during the measure (whole system):\n", prefix);
+	fprintf(fd, "%s	node", prefix);
+	for (i = 0; i < NPT_NUMASTAT_COUNTERS; i++) fprintf(fd, "	%s", numastatNames[i]);
+	fprintf(fd, "\n");
+	for (node = 0; node < NPT_NUMA_MAX_NODES; node++) {
+		if (!numastatNodes[node]) continue;
+		fprintf(fd, "%s	%d", prefix, node);
+		for (i = 0; i < NPT_NUMASTAT_COUNTERS; i++)
+			fprintf(fd, "	+%" PRIu64, numastat[1][node][i] - numastat[0][node][i]);
+		fprintf(fd, "\n");
+	}
+}
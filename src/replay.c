@@ -0,0 +1,215 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <fcntl.h>	// open
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// llround
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// memchr, memmem, strerror
+#include <sys/mman.h>	// mmap, madvise
+#include <sys/stat.h>	// fstat
+#include <unistd.h>	// close
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+#include <npt/replay.h>
+#include <npt/spikes.h>
+
+/** The raw dump buffer and its capacity */
+uint64_t *rawDump = NULL;
+uint64_t rawDumpSize = 0;
+
+/**
+ * Text files do not give the CPU frequency: their durations are
+ * accounted with a resolution of 1/NPT_REPLAY_TEXT_TICKS of the unit
+ */
+#define NPT_REPLAY_TEXT_TICKS 1000
+
+/**
+ * Prepare the raw dump of the loop durations: one slot per loop to
+ * do, so that the loop never has to allocate memory
+ */
+int npt_raw_dump_init() {
+	rawDumpSize = globalArgs.loops;
+	rawDump = npt_alloc_local(sizeof(uint64_t) * rawDumpSize, "raw dump");
+	if (rawDump == NULL) {
+		fprintf(stderr, "Error: unable to allocate the raw dump of %" PRIu64 " loops.\n",
+				rawDumpSize);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Write the raw dump of the loop durations
+ */
+int npt_raw_dump_write() {
+	struct npt_raw_header header;
+	FILE *fd;
+	int ret = EXIT_SUCCESS;
+
+	if (rawDump == NULL) return EXIT_SUCCESS;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NPT_RAW_MAGIC, sizeof(NPT_RAW_MAGIC));
+	header.version = NPT_RAW_VERSION;
+	header.cpuHz = globalArgs.cpuHz;
+	header.loops = (counter < rawDumpSize) ? counter : rawDumpSize;
+
+	fd = fopen(globalArgs.raw_dump, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode.\n", globalArgs.raw_dump);
+		ret = EXIT_FAILURE;
+	} else {
+		if (fwrite(&header, sizeof(header), 1, fd) != 1
+			|| fwrite(rawDump, sizeof(uint64_t), header.loops, fd) != header.loops) {
+			fprintf(stderr, "Error: unable to write '%s', %s (%d)\n",
+					globalArgs.raw_dump, strerror(errno), errno);
+			ret = EXIT_FAILURE;
+		}
+		fclose(fd);
+	}
+
+	if (counter > rawDumpSize)
+		printf("# Raw dump limited to the first %" PRIu64 " loops\n", rawDumpSize);
+
+	npt_free_local(rawDump);
+	rawDump = NULL;
+	return ret;
+}
+
+/**
+ * Replay a raw dump
+ */
+static int _replay_raw(const char *data, size_t size) {
+	const struct npt_raw_header *header = (const struct npt_raw_header *)data;
+	uint64_t loops;
+
+	if (size < sizeof(*header) || header->version != NPT_RAW_VERSION || header->cpuHz == 0) {
+		fprintf(stderr, "Error: unsupported raw dump.\n");
+		return EXIT_FAILURE;
+	}
+
+	loops = (size - sizeof(*header)) / sizeof(uint64_t);
+	if (header->loops < loops) loops = header->loops;
+
+	globalArgs.cpuHz = header->cpuHz;
+	globalArgs.cpuPeriod = multi / (double)globalArgs.cpuHz;
+	printf("# Raw dump recorded at %.02f MHz\n", globalArgs.cpuHz / 1e6);
+	if (npt_spikes_init() != EXIT_SUCCESS) return EXIT_FAILURE;
+
+	npt_account_block((const uint64_t *)(data + sizeof(*header)), loops);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Replay a text file: either one duration per line, or the text
+ * export of npt:loop events, from which the duration field is read
+ */
+static int _replay_text(const char *data, size_t size) {
+	uint64_t ticks[NPT_ACCOUNT_BLOCK];
+	const char *p = data, *end = data + size, *eol, *value;
+	char number[64];
+	size_t n = 0, len;
+	double d;
+	char *stop;
+
+	globalArgs.cpuHz = (unsigned long)(multi * NPT_REPLAY_TEXT_TICKS);
+	globalArgs.cpuPeriod = 1.0 / NPT_REPLAY_TEXT_TICKS;
+	if (npt_spikes_init() != EXIT_SUCCESS) return EXIT_FAILURE;
+
+	for (; p < end; p = eol + 1) {
+		eol = memchr(p, '\n', end - p);
+		if (eol == NULL) eol = end;
+
+		value = NULL;
+		if ((*p >= '0' && *p <= '9') || *p == '.') {
+			value = p;
+		} else if (memmem(p, eol - p, "npt:loop", 8) != NULL) {
+			value = memmem(p, eol - p, "duration = ", 11);
+			if (value != NULL) value += 11;
+		}
+		if (value == NULL) continue;
+
+		// The mapping is not null-terminated
+		len = eol - value;
+		if (len >= sizeof(number)) len = sizeof(number) - 1;
+		memcpy(number, value, len);
+		number[len] = 0;
+
+		d = strtod(number, &stop);
+		if (stop == number || d < 0) continue;
+
+		ticks[n++] = (uint64_t)llround(d * NPT_REPLAY_TEXT_TICKS);
+		if (n == NPT_ACCOUNT_BLOCK) {
+			npt_account_block(ticks, n);
+			n = 0;
+		}
+	}
+	npt_account_block(ticks, n);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Feed recorded loop durations through the statistics, as fast as the
+ * file can be read
+ */
+int npt_replay(const char *filename) {
+	struct stat st;
+	char *data;
+	int fd, ret;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Error: unable to open '%s' in read mode.\n", filename);
+		if (fd >= 0) close(fd);
+		return EXIT_FAILURE;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return EXIT_SUCCESS;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Error: unable to map '%s', %s (%d)\n",
+				filename, strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	printf("# Replaying '%s'\n", filename);
+	if ((size_t)st.st_size >= sizeof(NPT_RAW_MAGIC)
+		&& memcmp(data, NPT_RAW_MAGIC, sizeof(NPT_RAW_MAGIC)) == 0)
+		ret = _replay_raw(data, st.st_size);
+	else
+		ret = _replay_text(data, st.st_size);
+
+	munmap(data, st.st_size);
+	finalize_statistics();
+
+	return ret;
+}
@@ -0,0 +1,399 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <ctype.h>	// isalnum
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <sched.h>	// sched_setaffinity, cpu_set_t, SCHED_OTHER
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strcmp, strchr, strtok_r, memset
+#include <unistd.h>	// optind
+
+#include <npt/npt.h>
+#include <npt/inject.h>
+#include <npt/scenario.h>
+#include <npt/sched.h>
+
+/** The runs of the scenario */
+static struct npt_scenario_run scenarioRuns[NPT_SCENARIO_MAX_RUNS];
+static int scenarioRunsCount = 0;
+static int scenarioCurrent = -1;
+
+/** The options of the command line, on top of which each run is parsed */
+static struct globalArgs_t scenarioBase;
+
+
+/**
+ * The option that a run changed while it is prepared once for the whole
+ * scenario, NULL if none
+ */
+static const char *_scenario_fixed(const struct globalArgs_t *a) {
+	const struct globalArgs_t *b = &scenarioBase;
+
+	if (a->scenario != b->scenario) return "--scenario";
+	if (a->replay != b->replay) return "--replay";
+	if (a->raw_dump != b->raw_dump) return "--raw-dump";
+	if (a->soak_period != b->soak_period || a->checkpoint != b->checkpoint
+		|| a->resume != b->resume)
+		return "--soak-period, --checkpoint, --resume";
+	if (a->metrics_file != b->metrics_file || a->metrics_port != b->metrics_port
+		|| a->metrics_interval != b->metrics_interval)
+		return "--metrics-file, --metrics-port, --metrics-interval";
+	if (a->smt_sibling != b->smt_sibling || a->stress != b->stress
+		|| a->stress_cpus != b->stress_cpus)
+		return "--smt-sibling, --stress, --stress-cpus";
+	if (a->sweep != b->sweep || a->sweep_prios != b->sweep_prios
+		|| a->sweep_cpus != b->sweep_cpus)
+		return "--sweep, --sweep-prios, --sweep-cpus";
+	if (a->shm != b->shm) return "--shm";
+	if (a->workload != b->workload) return "--workload";
+	if (a->evaluateSpeed != b->evaluateSpeed) return "--eval-cpu-speed";
+	return NULL;
+}
+
+/**
+ * Free the options that a run allocated on top of the command line ones
+ */
+static void _scenario_free_args(struct globalArgs_t *a) {
+	if (a->output != scenarioBase.output) free(a->output);
+	if (a->sketch != scenarioBase.sketch) free(a->sketch);
+	if (a->inject != scenarioBase.inject) free(a->inject);
+	a->output = scenarioBase.output;
+	a->sketch = scenarioBase.sketch;
+	a->inject = scenarioBase.inject;
+}
+
+/**
+ * Check that a run name can suffix the output files
+ */
+static int _scenario_valid_name(const char *name) {
+	const char *c;
+
+	if (strlen(name) >= sizeof(scenarioRuns[0].name)) return 0;
+	for (c = name; *c != '\0'; c++)
+		if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_' && *c != '.') return 0;
+	return 1;
+}
+
+/**
+ * Parse a line of the scenario: the name of the run and its options,
+ * with the parser of the command line
+ */
+static int _scenario_parse_line(int (*parse)(int argc, char **argv), char *line,
+		int lineno) {
+	char *argv[NPT_SCENARIO_MAX_ARGS + 2], *token, *comment, *saveptr = NULL;
+	struct npt_scenario_run *r;
+	const char *fixed;
+	size_t length = 0;
+	int argc = 0, i;
+
+	comment = strchr(line, '#');
+	if (comment != NULL) *comment = '\0';
+	token = strtok_r(line, " \t\r\n", &saveptr);
+	if (token == NULL) return EXIT_SUCCESS;
+
+	if (scenarioRunsCount == NPT_SCENARIO_MAX_RUNS) {
+		fprintf(stderr, "%s:%d: too many runs (max. %d)\n", scenarioBase.scenario, lineno,
+				NPT_SCENARIO_MAX_RUNS);
+		return EXIT_FAILURE;
+	}
+	if (!_scenario_valid_name(token)) {
+		fprintf(stderr, "%s:%d: the run name '%s' must be shorter than %zu characters "
+				"among letters, digits, '-', '_' and '.'\n", scenarioBase.scenario, lineno,
+				token, sizeof(scenarioRuns[0].name));
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < scenarioRunsCount; i++) {
+		if (strcmp(scenarioRuns[i].name, token) == 0) {
+			fprintf(stderr, "%s:%d: the run name '%s' is already used\n",
+					scenarioBase.scenario, lineno, token);
+			return EXIT_FAILURE;
+		}
+	}
+
+	r = &scenarioRuns[scenarioRunsCount];
+	memset(r, 0, sizeof(*r));
+	strcpy(r->name, token);
+
+	// Keep the options as written, the parser permutes them
+	argv[argc++] = "npt";
+	while ((token = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL) {
+		if (argc == NPT_SCENARIO_MAX_ARGS + 1) {
+			fprintf(stderr, "%s:%d: too many options (max. %d)\n", scenarioBase.scenario,
+					lineno, NPT_SCENARIO_MAX_ARGS);
+			return EXIT_FAILURE;
+		}
+		argv[argc++] = token;
+		length += strlen(token) + 1;
+	}
+	argv[argc] = NULL;
+
+	r->options = calloc(1, length + 1);
+	if (r->options == NULL) return EXIT_FAILURE;
+	for (i = 1; i < argc; i++) {
+		if (i > 1) strcat(r->options, " ");
+		strcat(r->options, argv[i]);
+	}
+
+	// Parse the options of the run on top of the command line ones
+	globalArgs = scenarioBase;
+	optind = 0;
+	if (parse(argc, argv) != 0 || optind < argc) {
+		fprintf(stderr, "%s:%d: invalid options for the run '%s'\n", scenarioBase.scenario,
+				lineno, r->name);
+		goto err;
+	}
+	fixed = _scenario_fixed(&globalArgs);
+	if (fixed != NULL) {
+		fprintf(stderr, "%s:%d: %s cannot change between the runs of a scenario\n",
+				scenarioBase.scenario, lineno, fixed);
+		goto err;
+	}
+
+	r->args = globalArgs;
+	globalArgs = scenarioBase;
+	scenarioRunsCount++;
+	return EXIT_SUCCESS;
+
+err:
+	_scenario_free_args(&globalArgs);
+	globalArgs = scenarioBase;
+	free(r->options);
+	r->options = NULL;
+	return EXIT_FAILURE;
+}
+
+/**
+ * Prepare the runs of the scenario, one per line of the file: the name
+ * of the run followed by its options, on top of the command line ones.
+ * Empty lines and the text following a '#' are ignored.
+ */
+int npt_scenario_init(int (*parse)(int argc, char **argv)) {
+	char *line = NULL;
+	size_t size = 0;
+	int lineno = 0, ret = EXIT_SUCCESS;
+	FILE *fd;
+
+	if (globalArgs.scenario == NULL) return EXIT_SUCCESS;
+
+	scenarioBase = globalArgs;
+	fd = fopen(scenarioBase.scenario, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s', %s (%d)\n", scenarioBase.scenario,
+				strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	while (ret == EXIT_SUCCESS && getline(&line, &size, fd) != -1)
+		ret = _scenario_parse_line(parse, line, ++lineno);
+	free(line);
+	fclose(fd);
+
+	if (ret == EXIT_SUCCESS && scenarioRunsCount == 0) {
+		fprintf(stderr, "--scenario: no run in '%s'\n", scenarioBase.scenario);
+		ret = EXIT_FAILURE;
+	}
+	return ret;
+}
+
+/**
+ * Free the runs of the scenario, and get the command line options back
+ * so that their own allocations are freed by the caller
+ */
+void npt_scenario_free() {
+	int i;
+
+	if (scenarioBase.scenario == NULL) return;
+
+	globalArgs = scenarioBase;
+	for (i = 0; i < scenarioRunsCount; i++) {
+		_scenario_free_args(&scenarioRuns[i].args);
+		free(scenarioRuns[i].options);
+		scenarioRuns[i].options = NULL;
+	}
+	scenarioRunsCount = 0;
+	scenarioCurrent = -1;
+}
+
+/**
+ * Number of runs of the scenario, 0 if it is not used
+ */
+int npt_scenario_runs() {
+	return scenarioRunsCount;
+}
+
+const char *npt_scenario_name(int run) {
+	return scenarioRuns[run].name;
+}
+
+/**
+ * Take the options of a run of the scenario, scaled as the command line
+ * ones, and move to its CPU and policy. The CPU frequency is the one
+ * measured once for the whole scenario. A failed run is reported in the
+ * comparison, and the scenario goes on.
+ */
+int npt_scenario_start(int run) {
+	struct npt_scenario_run *r;
+	unsigned long cpuHz = globalArgs.cpuHz;
+	cpu_set_t mask;
+
+	if (run >= scenarioRunsCount) return EXIT_SUCCESS;
+
+	r = &scenarioRuns[run];
+	scenarioCurrent = run;
+	printf("# Scenario run %d/%d '%s': %s\n", run + 1, scenarioRunsCount, r->name,
+			(r->options[0] != '\0') ? r->options : "command line options");
+
+	globalArgs = r->args;
+	globalArgs.cpuHz = cpuHz;
+	if (globalArgs.picoseconds) multi = 1.0e12;
+	else if (globalArgs.nanoseconds) multi = 1.0e9;
+	else multi = 1.0e6;
+	globalArgs.threshold *= multi * 1.0e-6;
+	globalArgs.spike_bin *= multi * 1.0e-6;
+	globalArgs.duration *= multi;
+	WINDOW_OPTION_SCALE
+	globalArgs.cpuPeriod = multi / (double)globalArgs.cpuHz;
+	if (globalArgs.inject != NULL && npt_inject_parse(globalArgs.inject) != EXIT_SUCCESS)
+		goto err;
+
+	// A SCHED_DEADLINE task cannot change its affinity, leave it first
+	if (npt_sched_set(SCHED_OTHER, 0) != EXIT_SUCCESS)
+		goto err;
+
+	CPU_ZERO(&mask);
+	CPU_SET(globalArgs.affinity, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		fprintf(stderr, "Error: unable to set CPU affinity, %s (%d)\n", strerror(errno), errno);
+		goto err;
+	}
+
+	if (npt_sched_set(globalArgs.policy, globalArgs.priority) != EXIT_SUCCESS)
+		goto err;
+
+	if (globalArgs.duration > 0)
+		printf("# Running for %d seconds.. Please wait.\n", (int)(globalArgs.duration / multi));
+	else
+		printf("# Running for %" PRIu64 " loops.. Please wait.\n", globalArgs.loops);
+	return EXIT_SUCCESS;
+
+err:
+	r->error = 1;
+	r->done = 1;
+	return EXIT_FAILURE;
+}
+
+/**
+ * Report a run of the scenario as failed, when it could not start after
+ * its options were taken
+ */
+void npt_scenario_fail(int run) {
+	if (run >= scenarioRunsCount) return;
+
+	scenarioRuns[run].error = 1;
+	scenarioRuns[run].done = 1;
+}
+
+/**
+ * Keep the results of a run of the scenario
+ */
+void npt_scenario_stop(int run) {
+	struct npt_scenario_run *r;
+
+	if (run >= scenarioRunsCount) return;
+
+	r = &scenarioRuns[run];
+	npt_summary_fill(&r->summary);
+	r->done = 1;
+}
+
+/**
+ * Print the run of the scenario and its options
+ */
+void npt_scenario_print(FILE *fd, const char *prefix) {
+	struct npt_scenario_run *r;
+
+	if (scenarioCurrent < 0) return;
+
+	r = &scenarioRuns[scenarioCurrent];
+	fprintf(fd, "%sScenario run:	%s (%d/%d) from %s", prefix, r->name, scenarioCurrent + 1,
+			scenarioRunsCount, scenarioBase.scenario);
+	if (r->options[0] != '\0') fprintf(fd, ", %s", r->options);
+	fprintf(fd, "\n");
+}
+
+/**
+ * Compare the results of the runs of the scenario, each in its own unit
+ */
+void npt_scenario_print_comparison(FILE *fd, const char *prefix) {
+	struct npt_scenario_run *r;
+	int i;
+
+	if (scenarioRunsCount == 0) return;
+
+	fprintf(fd, "%sScenario comparison:\n", prefix);
+	fprintf(fd, "%s	run		unit	", prefix);
+	npt_summary_print_header(fd);
+
+	for (i = 0; i < scenarioRunsCount; i++) {
+		r = &scenarioRuns[i];
+		if (!r->done) continue;
+		fprintf(fd, "%s	%-15s	%s	", prefix, r->name,
+				UNITE(r->args.picoseconds, r->args.nanoseconds));
+		if (r->error) {
+			fprintf(fd, "failed\n");
+			continue;
+		}
+		npt_summary_print(fd, &r->summary);
+	}
+}
+
+/**
+ * Write the index of the result bundle in the output file of the command
+ * line: the file of each run, and their comparison
+ */
+int npt_scenario_write() {
+	struct npt_scenario_run *r;
+	FILE *fd;
+	int i;
+
+	if (scenarioRunsCount == 0 || scenarioBase.output == NULL) return EXIT_SUCCESS;
+
+	fd = fopen(scenarioBase.output, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode.\n", scenarioBase.output);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(fd, "# Data generated by NPT for the scenario %s, %d run(s)\n",
+			scenarioBase.scenario, scenarioRunsCount);
+	fprintf(fd, "# CPU frequency: %.02f MHz\n", globalArgs.cpuHz / 1e6);
+	fprintf(fd, "#\n");
+	for (i = 0; i < scenarioRunsCount; i++) {
+		r = &scenarioRuns[i];
+		fprintf(fd, "# %s:	%s.%s	%s\n", r->name, r->args.output, r->name, r->options);
+	}
+	fprintf(fd, "#\n");
+	npt_scenario_print_comparison(fd, "");
+	fclose(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,386 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <sched.h>	// sched_setaffinity, sched_get_priority_*, cpu_set_t
+#include <stdint.h>	// uint32_t, uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strcmp, strdup, strtok_r, memset
+#include <sys/syscall.h>	// SYS_sched_setattr
+#include <unistd.h>	// syscall
+
+#include <npt/npt.h>
+#include <npt/load.h>
+#include <npt/sched.h>
+
+/**
+ * Attributes of sched_setattr(2), which the C library may not declare
+ */
+struct npt_sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+/**
+ * Involuntary context switches of the loop during the run: the
+ * throttling events under SCHED_DEADLINE, the preemptions otherwise
+ */
+static uint64_t schedSwitches = 0;
+static uint64_t schedPreempted = 0;
+
+/** The runs of the sweep mode */
+static struct npt_sched_run schedRuns[NPT_SCHED_MAX_RUNS];
+static int schedRunsCount = 0;
+static int schedCurrent = -1;
+
+
+/**
+ * The policies, by name
+ */
+static const struct {
+	const char *name;
+	int policy;
+} schedPolicies[] = {
+	{ "fifo",	SCHED_FIFO },
+	{ "rr",		SCHED_RR },
+	{ "deadline",	SCHED_DEADLINE },
+	{ "other",	SCHED_OTHER },
+};
+#define NPT_SCHED_POLICIES (sizeof(schedPolicies) / sizeof(schedPolicies[0]))
+
+/**
+ * Policy of a name, -1 if unknown
+ */
+int npt_sched_parse_policy(const char *name) {
+	size_t i;
+
+	for (i = 0; i < NPT_SCHED_POLICIES; i++)
+		if (strcmp(name, schedPolicies[i].name) == 0) return schedPolicies[i].policy;
+	return -1;
+}
+
+const char *npt_sched_policy_name(int policy) {
+	size_t i;
+
+	for (i = 0; i < NPT_SCHED_POLICIES; i++)
+		if (schedPolicies[i].policy == policy) return schedPolicies[i].name;
+	return "unknown";
+}
+
+static int _sched_setattr(struct npt_sched_attr *attr) {
+#ifdef SYS_sched_setattr
+	return syscall(SYS_sched_setattr, 0, attr, 0);
+#else /* SYS_sched_setattr */
+	(void)attr;
+	errno = ENOSYS;
+	return -1;
+#endif /* SYS_sched_setattr */
+}
+
+/**
+ * Set the scheduling policy of the calling thread. The threads started
+ * under SCHED_DEADLINE fall back to SCHED_OTHER, as it cannot be
+ * inherited.
+ */
+int npt_sched_set(int policy, int priority) {
+	struct npt_sched_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = policy;
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		attr.sched_priority = priority;
+	if (policy == SCHED_DEADLINE) {
+		attr.sched_flags = NPT_SCHED_FLAG_RESET_ON_FORK;
+		attr.sched_runtime = globalArgs.dl_runtime;
+		attr.sched_deadline = globalArgs.dl_deadline;
+		attr.sched_period = globalArgs.dl_period;
+	}
+
+	if (_sched_setattr(&attr) != 0) {
+		fprintf(stderr, "Error: unable to set the %s policy, %s (%d)\n",
+				npt_sched_policy_name(policy), strerror(errno), errno);
+		if (policy == SCHED_DEADLINE && (errno == EPERM || errno == EBUSY))
+			fprintf(stderr, "SCHED_DEADLINE needs an affinity over its whole root domain:"
+					" isolate CPU %u in an exclusive cpuset\n", globalArgs.affinity);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Print a policy and its parameters
+ */
+void npt_sched_describe(FILE *fd, int policy, int priority) {
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		fprintf(fd, "%s, priority %d", npt_sched_policy_name(policy), priority);
+	else if (policy == SCHED_DEADLINE)
+		fprintf(fd, "deadline, runtime %.1fus, deadline %.1fus, period %.1fus",
+				globalArgs.dl_runtime / 1e3, globalArgs.dl_deadline / 1e3,
+				globalArgs.dl_period / 1e3);
+	else
+		fprintf(fd, "%s", npt_sched_policy_name(policy));
+}
+
+/**
+ * Parse a comma separated list of priorities
+ */
+static int _sched_parse_prios(const char *list, int *prios, int *count) {
+	char *copy, *item, *end, *saveptr = NULL;
+	long prio;
+	int ret = EXIT_SUCCESS;
+
+	copy = strdup(list);
+	if (copy == NULL) return EXIT_FAILURE;
+
+	*count = 0;
+	for (item = strtok_r(copy, ",", &saveptr); item != NULL;
+			item = strtok_r(NULL, ",", &saveptr)) {
+		prio = strtol(item, &end, 10);
+		if (*end != '\0' || prio < sched_get_priority_min(SCHED_FIFO)
+			|| prio > sched_get_priority_max(SCHED_FIFO) || *count == NPT_SCHED_MAX_RUNS) {
+			ret = EXIT_FAILURE;
+			break;
+		}
+		prios[(*count)++] = prio;
+	}
+
+	free(copy);
+	return (*count > 0) ? ret : EXIT_FAILURE;
+}
+
+/**
+ * Add a run of the sweep mode
+ */
+static int _sched_add_run(int policy, int priority, unsigned int cpu) {
+	struct npt_sched_run *r;
+
+	if (schedRunsCount == NPT_SCHED_MAX_RUNS) {
+		fprintf(stderr, "--sweep: too many combinations (max. %d)\n", NPT_SCHED_MAX_RUNS);
+		return EXIT_FAILURE;
+	}
+
+	r = &schedRuns[schedRunsCount++];
+	memset(r, 0, sizeof(*r));
+	r->policy = policy;
+	r->priority = priority;
+	r->cpu = cpu;
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		snprintf(r->name, sizeof(r->name), "%s-%d-cpu%u", npt_sched_policy_name(policy),
+				priority, cpu);
+	else
+		snprintf(r->name, sizeof(r->name), "%s-cpu%u", npt_sched_policy_name(policy), cpu);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Prepare the runs of the sweep mode: each combination of the policies,
+ * the priorities of the policies which have one, and the CPUs
+ */
+int npt_sched_init() {
+	int prios[NPT_SCHED_MAX_RUNS], prioCount = 1, policy, i;
+	char *copy, *name, *saveptr = NULL;
+	cpu_set_t cpus;
+	unsigned int cpu;
+	int ret = EXIT_SUCCESS;
+
+	schedRunsCount = 0;
+	schedCurrent = -1;
+
+	if (globalArgs.sweep == NULL) return EXIT_SUCCESS;
+
+	prios[0] = globalArgs.priority;
+	if (globalArgs.sweep_prios != NULL
+		&& _sched_parse_prios(globalArgs.sweep_prios, prios, &prioCount) != EXIT_SUCCESS) {
+		fprintf(stderr, "--sweep-prios: invalid list of priorities '%s'\n", globalArgs.sweep_prios);
+		return EXIT_FAILURE;
+	}
+
+	CPU_ZERO(&cpus);
+	CPU_SET(globalArgs.affinity, &cpus);
+	if (globalArgs.sweep_cpus != NULL
+		&& npt_parse_cpu_list(globalArgs.sweep_cpus, &cpus) != EXIT_SUCCESS) {
+		fprintf(stderr, "--sweep-cpus: invalid CPU list '%s'\n", globalArgs.sweep_cpus);
+		return EXIT_FAILURE;
+	}
+
+	for (cpu = 0; cpu < CPU_SETSIZE && ret == EXIT_SUCCESS; cpu++) {
+		if (!CPU_ISSET(cpu, &cpus)) continue;
+
+		copy = strdup(globalArgs.sweep);
+		if (copy == NULL) return EXIT_FAILURE;
+		for (name = strtok_r(copy, ",", &saveptr); name != NULL && ret == EXIT_SUCCESS;
+				name = strtok_r(NULL, ",", &saveptr)) {
+			policy = npt_sched_parse_policy(name);
+			if (policy < 0) {
+				fprintf(stderr, "--sweep: unknown policy '%s'\n", name);
+				ret = EXIT_FAILURE;
+			} else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+				for (i = 0; i < prioCount && ret == EXIT_SUCCESS; i++)
+					ret = _sched_add_run(policy, prios[i], cpu);
+			} else {
+				ret = _sched_add_run(policy, 0, cpu);
+			}
+		}
+		free(copy);
+	}
+
+	return ret;
+}
+
+/**
+ * Number of runs of the sweep mode, 0 if it is not used
+ */
+int npt_sched_runs() {
+	return schedRunsCount;
+}
+
+const char *npt_sched_name(int run) {
+	return schedRuns[run].name;
+}
+
+/**
+ * Involuntary context switches of the calling thread
+ */
+static uint64_t _sched_switches() {
+	char line[128];
+	uint64_t switches = 0;
+	FILE *fd;
+
+	fd = fopen("/proc/thread-self/status", "r");
+	if (fd == NULL) return 0;
+	while (fgets(line, sizeof(line), fd) != NULL)
+		if (sscanf(line, "nonvoluntary_ctxt_switches: %" SCNu64, &switches) == 1) break;
+	fclose(fd);
+	return switches;
+}
+
+/**
+ * Move to the CPU and the policy of a run of the sweep mode. A failed
+ * run is reported in the comparison, and the sweep goes on.
+ */
+int npt_sched_start(int run) {
+	struct npt_sched_run *r;
+	cpu_set_t mask;
+
+	if (run >= schedRunsCount) {
+		schedSwitches = _sched_switches();
+		return EXIT_SUCCESS;
+	}
+
+	r = &schedRuns[run];
+	schedCurrent = run;
+	printf("# Sweep run %d/%d: ", run + 1, schedRunsCount);
+	npt_sched_describe(stdout, r->policy, r->priority);
+	printf(" on CPU %u\n", r->cpu);
+
+	// A SCHED_DEADLINE task cannot change its affinity, leave it first
+	if (npt_sched_set(SCHED_OTHER, 0) != EXIT_SUCCESS)
+		goto err;
+
+	CPU_ZERO(&mask);
+	CPU_SET(r->cpu, &mask);
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+		fprintf(stderr, "Error: unable to set CPU affinity, %s (%d)\n", strerror(errno), errno);
+		goto err;
+	}
+	globalArgs.affinity = r->cpu;
+
+	if (npt_sched_set(r->policy, r->priority) != EXIT_SUCCESS)
+		goto err;
+	schedSwitches = _sched_switches();
+	return EXIT_SUCCESS;
+
+err:
+	r->error = 1;
+	r->done = 1;
+	return EXIT_FAILURE;
+}
+
+/**
+ * Keep the results of a run of the sweep mode
+ */
+void npt_sched_stop(int run) {
+	struct npt_sched_run *r;
+
+	schedPreempted = _sched_switches() - schedSwitches;
+	if (run >= schedRunsCount) return;
+
+	r = &schedRuns[run];
+	r->preempted = schedPreempted;
+	npt_summary_fill(&r->summary);
+	r->done = 1;
+}
+
+/**
+ * Print the policy of the run, if it is not the default one
+ */
+void npt_sched_print(FILE *fd, const char *prefix) {
+	int policy = globalArgs.policy, priority = globalArgs.priority;
+
+	if (schedCurrent >= 0) {
+		policy = schedRuns[schedCurrent].policy;
+		priority = schedRuns[schedCurrent].priority;
+	} else if (policy == SCHED_FIFO) return;
+
+	fprintf(fd, "%sScheduling:	", prefix);
+	npt_sched_describe(fd, policy, priority);
+	fprintf(fd, " on CPU %u, %s %" PRIu64 " time(s)\n", globalArgs.affinity,
+			(policy == SCHED_DEADLINE) ? "throttled" : "preempted", schedPreempted);
+}
+
+/**
+ * Compare the results of the runs of the sweep mode
+ */
+void npt_sched_print_comparison(FILE *fd, const char *prefix) {
+	struct npt_sched_run *r;
+	int i;
+
+	if (schedRunsCount == 0) return;
+
+	fprintf(fd, "%sScheduling sweep comparison (%s):\n", prefix,
+			UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
+	fprintf(fd, "%s	policy	prio	CPU	throttled/preempted	", prefix);
+	npt_summary_print_header(fd);
+
+	for (i = 0; i < schedRunsCount; i++) {
+		r = &schedRuns[i];
+		if (!r->done) continue;
+		fprintf(fd, "%s	%s	", prefix, npt_sched_policy_name(r->policy));
+		if (r->policy == SCHED_FIFO || r->policy == SCHED_RR) fprintf(fd, "%d", r->priority);
+		else fprintf(fd, "-");
+		fprintf(fd, "	%u	", r->cpu);
+		if (r->error) {
+			fprintf(fd, "failed\n");
+			continue;
+		}
+		fprintf(fd, "%" PRIu64 "			", r->preempted);
+		npt_summary_print(fd, &r->summary);
+	}
+}
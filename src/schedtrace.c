@@ -0,0 +1,651 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <linux/perf_event.h>	// perf_event_attr, perf_event_mmap_page
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stddef.h>	// offsetof
+#include <stdint.h>	// uint16_t, uint32_t, uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// qsort, calloc, free
+#include <string.h>	// memset, memcpy, strncmp, strerror, strstr
+#include <sys/ioctl.h>	// ioctl
+#include <sys/mman.h>	// mmap, munmap
+#include <sys/syscall.h>	// SYS_perf_event_open, SYS_gettid
+#include <time.h>	// clock_gettime
+#include <unistd.h>	// syscall, close, sysconf
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/schedtrace.h>
+#include <npt/spikes.h>
+
+/**
+ * The tracepoints of the local timer interrupt only exist on x86, and
+ * are used when present
+ */
+#define NPT_TRACE_REQUIRED	5
+
+static const char *traceEvents[NPT_TRACE_EVENTS] = {
+	"sched/sched_switch",
+	"irq/irq_handler_entry",
+	"irq/irq_handler_exit",
+	"irq/softirq_entry",
+	"irq/softirq_exit",
+	"irq_vectors/local_timer_entry",
+	"irq_vectors/local_timer_exit"
+};
+
+static struct {
+	uint16_t id;
+	int fd;
+	int offsets[3];
+	uint32_t size;
+} traceEvent[NPT_TRACE_EVENTS];
+
+static const char *traceFields[NPT_TRACE_EVENTS][3] = {
+	{ "prev_pid", "next_pid", "next_comm" },
+	{ "irq", "name", NULL },
+	{ "irq", NULL, NULL },
+	{ "vec", NULL, NULL },
+	{ "vec", NULL, NULL },
+	{ NULL, NULL, NULL },
+	{ NULL, NULL, NULL }
+};
+
+static const char *softirqNames[] = {
+	"HI", "TIMER", "NET_TX", "NET_RX", "BLOCK", "IRQ_POLL", "TASKLET", "SCHED", "HRTIMER", "RCU"
+};
+
+static const char *tracefs[] = { "/sys/kernel/tracing", "/sys/kernel/debug/tracing" };
+
+/**
+ * Pairings of the timestamp counter with the clock of the tracepoints
+ * kept to convert the spikes, taken each time the ring buffer is read
+ */
+#define NPT_SCHEDTRACE_PAIRS	1024
+
+struct npt_schedtrace_pair {
+	uint64_t tsc;
+	uint64_t ns;
+};
+
+/**
+ * A slice of time taken from the loop by a task or an interrupt, in
+ * nanoseconds of the raw monotonic clock
+ */
+struct npt_schedtrace_slice {
+	uint64_t start;
+	uint64_t end;
+	unsigned int culprit;
+};
+
+/**
+ * A task or an interrupt, and the time it took during the spikes
+ */
+struct npt_schedtrace_culprit {
+	char name[48];
+	uint64_t spikes;
+	uint64_t stolen;
+	uint64_t max;
+	uint64_t lastSpike;
+};
+
+/** The monitor thread, and the ring buffer of the tracepoints */
+static pthread_t traceThread;
+static int traceStopping;
+static bool traceStarted = false;
+static struct perf_event_mmap_page *traceRing = NULL;
+static size_t traceRingSize;
+static pid_t traceTid;
+static int traceCpu;
+
+/** The slices not yet needed by the spikes, in a ring */
+static struct npt_schedtrace_slice *traceSlices = NULL;
+static uint64_t traceSliceHead, traceSliceTail;
+
+/** The tasks and interrupts, and the slices they have open */
+static struct npt_schedtrace_culprit traceCulprits[NPT_SCHEDTRACE_CULPRITS];
+static unsigned int traceCulpritsCount;
+static bool traceAway, traceInIrq, traceInSoftirq, traceInTimer;
+static uint64_t traceAwayStart, traceIrqStart, traceSoftirqStart, traceTimerStart;
+static unsigned int traceAwayCulprit, traceIrqCulprit, traceSoftirqCulprit;
+
+/** The pairings of the timestamp counter with the clock */
+static struct npt_schedtrace_pair tracePairs[NPT_SCHEDTRACE_PAIRS];
+static uint64_t tracePairsCount;
+
+/** Spikes matched so far, and the ones with a culprit */
+static uint64_t traceSpike, traceExplained;
+static uint64_t traceLost, traceDropped;
+
+/**
+ * Read the id of a tracepoint, and the offsets of the given fields in
+ * its records, from its format in tracefs
+ */
+static int _trace_format(int event) {
+	char filename[128], line[256], *field, *end, *at;
+	unsigned int i, id;
+	int j, offset, size, found = 0;
+	size_t len;
+	FILE *fd = NULL;
+
+	for (i = 0; i < sizeof(tracefs) / sizeof(tracefs[0]) && fd == NULL; i++) {
+		snprintf(filename, sizeof(filename), "%s/events/%s/format", tracefs[i], traceEvents[event]);
+		fd = fopen(filename, "r");
+	}
+	if (fd == NULL) {
+		if (event >= NPT_TRACE_REQUIRED) return EXIT_FAILURE;
+		fprintf(stderr, "Error: unable to read the format of the %s tracepoint, "
+				"is tracefs mounted?\n", traceEvents[event]);
+		return EXIT_FAILURE;
+	}
+
+	for (j = 0; j < 3; j++) traceEvent[event].offsets[j] = -1;
+	traceEvent[event].size = 0;
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		if (sscanf(line, "ID: %u", &id) == 1) {
+			traceEvent[event].id = id;
+			found++;
+			continue;
+		}
+
+		// The field name is the last word of its declaration, without
+		// its array size
+		field = strstr(line, "field:");
+		end = (field != NULL) ? strchr(field, ';') : NULL;
+		at = (end != NULL) ? strstr(end, "offset:") : NULL;
+		if (at == NULL || sscanf(at, "offset:%d; size:%d;", &offset, &size) != 2)
+			continue;
+		if (end[-1] == ']')
+			while (end > field && *end != '[') end--;
+		for (at = end; at > field && at[-1] != ' ' && at[-1] != ':'; at--);
+		len = end - at;
+
+		for (j = 0; j < 3; j++)
+			if (traceFields[event][j] != NULL && strlen(traceFields[event][j]) == len
+				&& strncmp(at, traceFields[event][j], len) == 0) {
+				traceEvent[event].offsets[j] = offset;
+				if ((uint32_t)(offset + size) > traceEvent[event].size)
+					traceEvent[event].size = offset + size;
+			}
+	}
+	fclose(fd);
+
+	for (j = 0; j < 3; j++)
+		if (traceFields[event][j] != NULL && traceEvent[event].offsets[j] < 0) found = 0;
+	if (!found) {
+		fprintf(stderr, "Error: unexpected format of the %s tracepoint.\n", traceEvents[event]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Return the index of a culprit, the last one standing for all the
+ * culprits past the capacity
+ */
+static unsigned int _culprit(const char *name) {
+	unsigned int i;
+
+	for (i = 0; i < traceCulpritsCount; i++)
+		if (strcmp(traceCulprits[i].name, name) == 0) return i;
+	if (traceCulpritsCount == NPT_SCHEDTRACE_CULPRITS) return NPT_SCHEDTRACE_CULPRITS - 1;
+
+	i = traceCulpritsCount++;
+	memset(&traceCulprits[i], 0, sizeof(traceCulprits[i]));
+	snprintf(traceCulprits[i].name, sizeof(traceCulprits[i].name), "%s",
+			(i == NPT_SCHEDTRACE_CULPRITS - 1) ? "(other)" : name);
+	return i;
+}
+
+/**
+ * Keep a slice, the oldest one being dropped when the ring is full
+ */
+static void _slice(uint64_t start, uint64_t end, unsigned int culprit) {
+	struct npt_schedtrace_slice *s;
+
+	if (traceSliceHead - traceSliceTail == NPT_SCHEDTRACE_SLICES) {
+		traceSliceTail++;
+		traceDropped++;
+	}
+	s = &traceSlices[traceSliceHead++ % NPT_SCHEDTRACE_SLICES];
+	s->start = start;
+	s->end = end;
+	s->culprit = culprit;
+}
+
+/**
+ * Turn a tracepoint record into the start or the end of a slice
+ */
+static void _trace_record(uint64_t time, const char *raw, uint32_t size) {
+	char name[48], comm[17];
+	uint16_t type;
+	uint32_t loc, vec;
+	int32_t prevPid, nextPid, irq;
+	int *off, event;
+
+	if (size < sizeof(type)) return;
+	memcpy(&type, raw, sizeof(type));
+	for (event = 0; event < NPT_TRACE_EVENTS
+		&& (traceEvent[event].fd < 0 || traceEvent[event].id != type); event++);
+	if (event == NPT_TRACE_EVENTS || size < traceEvent[event].size) return;
+	off = traceEvent[event].offsets;
+
+	switch (event) {
+		case NPT_TRACE_SWITCH:
+			memcpy(&prevPid, raw + off[0], sizeof(prevPid));
+			memcpy(&nextPid, raw + off[1], sizeof(nextPid));
+			memcpy(comm, raw + off[2], 16);
+			comm[16] = '\0';
+
+			// Each task that runs while the loop is away takes a slice
+			if (traceAway) _slice(traceAwayStart, time, traceAwayCulprit);
+			if (nextPid == traceTid) {
+				traceAway = false;
+			} else if (prevPid == traceTid || traceAway) {
+				traceAway = true;
+				traceAwayStart = time;
+				traceAwayCulprit = _culprit(comm);
+			}
+			break;
+
+		case NPT_TRACE_IRQ_ENTRY:
+			memcpy(&irq, raw + off[0], sizeof(irq));
+			memcpy(&loc, raw + off[1], sizeof(loc));
+			if ((loc & 0xffff) + (loc >> 16) <= size)
+				snprintf(name, sizeof(name), "irq/%d %.*s", irq,
+						(int)strnlen(raw + (loc & 0xffff), loc >> 16), raw + (loc & 0xffff));
+			else snprintf(name, sizeof(name), "irq/%d", irq);
+			traceInIrq = true;
+			traceIrqStart = time;
+			traceIrqCulprit = _culprit(name);
+			break;
+
+		case NPT_TRACE_IRQ_EXIT:
+			if (traceInIrq) _slice(traceIrqStart, time, traceIrqCulprit);
+			traceInIrq = false;
+			break;
+
+		case NPT_TRACE_SOFTIRQ_ENTRY:
+			memcpy(&vec, raw + off[0], sizeof(vec));
+			if (vec < sizeof(softirqNames) / sizeof(softirqNames[0]))
+				snprintf(name, sizeof(name), "softirq %s", softirqNames[vec]);
+			else snprintf(name, sizeof(name), "softirq %u", vec);
+			traceInSoftirq = true;
+			traceSoftirqStart = time;
+			traceSoftirqCulprit = _culprit(name);
+			break;
+
+		case NPT_TRACE_SOFTIRQ_EXIT:
+			if (traceInSoftirq) _slice(traceSoftirqStart, time, traceSoftirqCulprit);
+			traceInSoftirq = false;
+			break;
+
+		case NPT_TRACE_TIMER_ENTRY:
+			traceInTimer = true;
+			traceTimerStart = time;
+			break;
+
+		case NPT_TRACE_TIMER_EXIT:
+			if (traceInTimer) _slice(traceTimerStart, time, _culprit("local timer"));
+			traceInTimer = false;
+			break;
+	}
+}
+
+/**
+ * Copy bytes out of the ring buffer, which may wrap
+ */
+static void _ring_copy(void *dst, uint64_t offset, size_t len) {
+	const char *data = (const char *)traceRing + traceRing->data_offset;
+	uint64_t size = traceRing->data_size, at = offset % size;
+
+	if (at + len <= size) {
+		memcpy(dst, data + at, len);
+	} else {
+		memcpy(dst, data + at, size - at);
+		memcpy((char *)dst + (size - at), data, len - (size - at));
+	}
+}
+
+/**
+ * Read all the records of the ring buffer
+ */
+static void _ring_drain() {
+	char record[65536];
+	struct perf_event_header header;
+	uint64_t head, tail, time, lost[2];
+	uint32_t size;
+
+	head = __atomic_load_n(&traceRing->data_head, __ATOMIC_ACQUIRE);
+	tail = traceRing->data_tail;
+	while (tail < head) {
+		_ring_copy(&header, tail, sizeof(header));
+		if (header.size < sizeof(header)) break;
+		if (header.type == PERF_RECORD_SAMPLE) {
+			// The sample is the time, then the raw record and its size
+			_ring_copy(record, tail + sizeof(header), header.size - sizeof(header));
+			memcpy(&time, record, sizeof(time));
+			memcpy(&size, record + sizeof(time), sizeof(size));
+			if (sizeof(time) + sizeof(size) + size <= header.size - sizeof(header))
+				_trace_record(time, record + sizeof(time) + sizeof(size), size);
+		} else if (header.type == PERF_RECORD_LOST) {
+			_ring_copy(lost, tail + sizeof(header), sizeof(lost));
+			traceLost += lost[1];
+		}
+		tail += header.size;
+	}
+	__atomic_store_n(&traceRing->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Pair the timestamp counter with the clock of the tracepoints
+ */
+static void _pair() {
+	struct npt_schedtrace_pair *p = &tracePairs[tracePairsCount % NPT_SCHEDTRACE_PAIRS];
+	struct timespec before, after;
+
+	clock_gettime(NPT_CLOCK_MONOTONIC, &before);
+	p->tsc = rdtsc();
+	clock_gettime(NPT_CLOCK_MONOTONIC, &after);
+	p->ns = ((uint64_t)before.tv_sec * 1000000000ULL + before.tv_nsec
+		+ (uint64_t)after.tv_sec * 1000000000ULL + after.tv_nsec) / 2;
+	tracePairsCount++;
+}
+
+/**
+ * Convert a timestamp counter value to the clock of the tracepoints,
+ * from the pairings around it
+ */
+static uint64_t _trace_time(uint64_t tsc) {
+	const struct npt_schedtrace_pair *a, *b;
+	uint64_t i, oldest;
+	double rate;
+
+	oldest = (tracePairsCount > NPT_SCHEDTRACE_PAIRS) ? tracePairsCount - NPT_SCHEDTRACE_PAIRS : 0;
+	for (i = tracePairsCount - 1; i > oldest && tracePairs[i % NPT_SCHEDTRACE_PAIRS].tsc > tsc; i--);
+	if (i + 1 == tracePairsCount) i--;
+	a = &tracePairs[i % NPT_SCHEDTRACE_PAIRS];
+	b = &tracePairs[(i + 1) % NPT_SCHEDTRACE_PAIRS];
+
+	rate = (double)(b->ns - a->ns) / (double)(b->tsc - a->tsc);
+	return a->ns + (int64_t)((double)(int64_t)(tsc - a->tsc) * rate);
+}
+
+/**
+ * Match the new spikes with the slices that overlap them
+ */
+static void _match(uint64_t count) {
+	const struct npt_schedtrace_slice *s;
+	struct npt_schedtrace_culprit *c;
+	uint64_t i, start, end, overlap;
+	unsigned int beyond;
+	bool explained;
+
+	if (count > spikesSize) count = spikesSize;
+	for (; traceSpike < count; traceSpike++) {
+		end = _trace_time(spikes[traceSpike].tsc);
+		start = _trace_time(spikes[traceSpike].tsc - spikes[traceSpike].ticks);
+
+		// The slices over before this spike are not needed by the next ones
+		while (traceSliceTail < traceSliceHead
+			&& traceSlices[traceSliceTail % NPT_SCHEDTRACE_SLICES].end < start)
+			traceSliceTail++;
+
+		// The slices are ordered by their end, and only the nested ones
+		// end before the slices they are nested in
+		explained = false;
+		for (i = traceSliceTail, beyond = 0; i < traceSliceHead && beyond < 4; i++) {
+			s = &traceSlices[i % NPT_SCHEDTRACE_SLICES];
+			if (s->start >= end) {
+				beyond++;
+				continue;
+			}
+			beyond = 0;
+			if (s->end <= start) continue;
+
+			overlap = ((s->end < end) ? s->end : end) - ((s->start > start) ? s->start : start);
+			c = &traceCulprits[s->culprit];
+			c->stolen += overlap;
+			if (overlap > c->max) c->max = overlap;
+			if (c->lastSpike != traceSpike + 1) {
+				c->lastSpike = traceSpike + 1;
+				c->spikes++;
+			}
+			explained = true;
+		}
+		if (explained) traceExplained++;
+	}
+}
+
+static void *_schedtrace_thread(void *arg) {
+	uint64_t count;
+	(void)arg;
+
+	while (!__atomic_load_n(&traceStopping, __ATOMIC_ACQUIRE)) {
+		// The records of a spike are in the ring once the spike is seen,
+		// and its end is before the new pairing
+		count = __atomic_load_n(&spikesCount, __ATOMIC_ACQUIRE);
+		_pair();
+		_ring_drain();
+		_match(count);
+		npt_housekeeping_sleep(10);
+	}
+
+	return NULL;
+}
+
+/**
+ * Close the tracepoints and their ring buffer
+ */
+static void _close() {
+	int i;
+
+	if (traceRing != NULL) munmap(traceRing, traceRingSize);
+	traceRing = NULL;
+	for (i = 0; i < NPT_TRACE_EVENTS; i++) {
+		if (traceEvent[i].fd >= 0) close(traceEvent[i].fd);
+		traceEvent[i].fd = -1;
+	}
+}
+
+/**
+ * Forget the slices and the culprits of the previous run
+ */
+static int _trace_reset() {
+	traceCulpritsCount = 0;
+	traceSpike = traceExplained = traceLost = traceDropped = 0;
+	traceSliceHead = traceSliceTail = 0;
+	traceAway = traceInIrq = traceInSoftirq = traceInTimer = false;
+	if (!globalArgs.sched_trace) return EXIT_SUCCESS;
+
+	if (traceSlices == NULL)
+		traceSlices = calloc(NPT_SCHEDTRACE_SLICES, sizeof(*traceSlices));
+	if (traceSlices == NULL) {
+		fprintf(stderr, "Error: unable to allocate the slices of the scheduler trace.\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Open the scheduler and interrupt tracepoints of the measured CPU in a
+ * shared ring buffer, timestamped with the raw monotonic clock, and
+ * start the thread that matches them with the spikes of the run
+ */
+int npt_schedtrace_start() {
+	struct perf_event_attr attr;
+	int i;
+
+	if (_trace_reset() != EXIT_SUCCESS) return EXIT_FAILURE;
+	if (!globalArgs.sched_trace) return EXIT_SUCCESS;
+
+	traceTid = syscall(SYS_gettid);
+	traceCpu = globalArgs.affinity;
+	for (i = 0; i < NPT_TRACE_EVENTS; i++) traceEvent[i].fd = -1;
+	for (i = 0; i < NPT_TRACE_EVENTS; i++) {
+		if (_trace_format(i) != EXIT_SUCCESS) {
+			if (i < NPT_TRACE_REQUIRED) goto err;
+			continue;
+		}
+
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.size = sizeof(attr);
+		attr.config = traceEvent[i].id;
+		attr.sample_period = 1;
+		attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+		attr.disabled = 1;
+		attr.use_clockid = 1;
+		attr.clockid = NPT_CLOCK_MONOTONIC;
+		traceEvent[i].fd = syscall(SYS_perf_event_open, &attr, -1, traceCpu, -1, PERF_FLAG_FD_CLOEXEC);
+		if (traceEvent[i].fd < 0) {
+			fprintf(stderr, "Error: unable to open the %s tracepoint, %s (%d)\n",
+					traceEvents[i], strerror(errno), errno);
+			goto err;
+		}
+
+		// All the tracepoints share the ring buffer of the first one, so
+		// that their records are in order
+		if (i == 0) {
+			traceRingSize = (NPT_SCHEDTRACE_PAGES + 1) * sysconf(_SC_PAGESIZE);
+			traceRing = mmap(NULL, traceRingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+					traceEvent[i].fd, 0);
+			if (traceRing == MAP_FAILED) {
+				traceRing = NULL;
+				fprintf(stderr, "Error: unable to map the ring buffer of the tracepoints, %s (%d)\n",
+						strerror(errno), errno);
+				goto err;
+			}
+		} else if (ioctl(traceEvent[i].fd, PERF_EVENT_IOC_SET_OUTPUT, traceEvent[0].fd) != 0) {
+			fprintf(stderr, "Error: unable to share the ring buffer of the tracepoints, %s (%d)\n",
+					strerror(errno), errno);
+			goto err;
+		}
+	}
+	for (i = 0; i < NPT_TRACE_EVENTS; i++)
+		if (traceEvent[i].fd >= 0) ioctl(traceEvent[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+
+	tracePairsCount = 0;
+	_pair();
+	traceStopping = 0;
+	if (npt_housekeeping_start(&traceThread, "npt-schedtrace", _schedtrace_thread, NULL) != EXIT_SUCCESS)
+		goto err;
+	traceStarted = true;
+	return EXIT_SUCCESS;
+
+err:
+	_close();
+	return EXIT_FAILURE;
+}
+
+/**
+ * Stop the thread, and match the last spikes of the run
+ */
+void npt_schedtrace_stop() {
+	int i;
+
+	if (!traceStarted) return;
+	__atomic_store_n(&traceStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(traceThread);
+	traceStarted = false;
+
+	for (i = 0; i < NPT_TRACE_EVENTS; i++)
+		if (traceEvent[i].fd >= 0) ioctl(traceEvent[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+	_pair();
+	_ring_drain();
+	_match(spikesCount);
+	_close();
+}
+
+#ifdef NPT_SYNTHETIC_TIMESTAMP
+/**
+ * Match the spikes of the run with synthetic records of the loop thread
+ * tid, for the checks. The records are timestamped with the timestamp
+ * counter, in the order of their time.
+ */
+int npt_schedtrace_replay(pid_t tid, const struct npt_schedtrace_record *records, size_t count) {
+	size_t i;
+	int event;
+
+	if (_trace_reset() != EXIT_SUCCESS) return EXIT_FAILURE;
+	traceTid = tid;
+	traceCpu = globalArgs.affinity;
+	for (event = 0; event < NPT_TRACE_EVENTS; event++) {
+		traceEvent[event].id = event + 1;
+		traceEvent[event].fd = 0;
+		traceEvent[event].offsets[0] = offsetof(struct npt_schedtrace_record, fields[0]);
+		traceEvent[event].offsets[1] = offsetof(struct npt_schedtrace_record, fields[1]);
+		traceEvent[event].offsets[2] = offsetof(struct npt_schedtrace_record, comm);
+		traceEvent[event].size = offsetof(struct npt_schedtrace_record, time);
+	}
+
+	// The clock of the records is the timestamp counter itself
+	tracePairs[0].tsc = tracePairs[0].ns = 0;
+	tracePairs[1].tsc = tracePairs[1].ns = UINT32_MAX;
+	tracePairsCount = 2;
+
+	for (i = 0; i < count; i++)
+		_trace_record(records[i].time, (const char *)&records[i],
+				offsetof(struct npt_schedtrace_record, time));
+	_match(spikesCount);
+
+	for (event = 0; event < NPT_TRACE_EVENTS; event++) traceEvent[event].fd = -1;
+	return EXIT_SUCCESS;
+}
+#endif /* NPT_SYNTHETIC_TIMESTAMP */
+
+static int _culprit_cmp(const void *a, const void *b) {
+	const struct npt_schedtrace_culprit *ca = a, *cb = b;
+	return (ca->stolen < cb->stolen) - (ca->stolen > cb->stolen);
+}
+
+/**
+ * Print the tasks and interrupts that ran during the spikes, by the
+ * time they took from the loop
+ */
+void npt_schedtrace_print(FILE *fd, const char *prefix) {
+	struct npt_schedtrace_culprit ranked[NPT_SCHEDTRACE_CULPRITS];
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	double scale = multi / 1.0e9;
+	unsigned int i, n = 0;
+
+	if (!globalArgs.sched_trace || traceSpike == 0) return;
+
+	for (i = 0; i < traceCulpritsCount; i++)
+		if (traceCulprits[i].spikes > 0) ranked[n++] = traceCulprits[i];
+	qsort(ranked, n, sizeof(ranked[0]), _culprit_cmp);
+
+	fprintf(fd, "%sStolen time during the spikes (scheduler and interrupt tracepoints of CPU %d):\n",
+			prefix, traceCpu);
+	fprintf(fd, "%s	%" PRIu64 " spike(s) matched, %" PRIu64 " with a culprit\n",
+			prefix, traceSpike, traceExplained);
+	if (traceLost > 0 || traceDropped > 0)
+		fprintf(fd, "%s	%" PRIu64 " record(s) lost, %" PRIu64 " slice(s) dropped\n",
+				prefix, traceLost, traceDropped);
+	if (n == 0) return;
+	fprintf(fd, "%s	%-32s	spikes	stolen (%s)	max (%s)\n", prefix, "culprit", unit, unit);
+	for (i = 0; i < n; i++)
+		fprintf(fd, "%s	%-32s	%" PRIu64 "	%.3f	%.3f\n", prefix, ranked[i].name,
+				ranked[i].spikes, ranked[i].stolen * scale, ranked[i].max * scale);
+}
@@ -0,0 +1,145 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <fcntl.h>	// O_*
+#include <math.h>	// llround
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, memcpy, memset
+#include <sys/mman.h>	// shm_open, shm_unlink, mmap, munmap
+#include <unistd.h>	// ftruncate, getpid, close
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+#include <npt/shm.h>
+
+uint64_t *shmBuckets = NULL;
+
+/** The segment, its name and the publication interval in ticks */
+static struct npt_shm *shm = NULL;
+static char shmName[32];
+static uint64_t shmIntervalTicks;
+
+/**
+ * Create the segment of the instance, named after its pid. The loop
+ * counts in its own buckets, local to the measured CPU, and copies them
+ * in the segment when it publishes.
+ */
+int npt_shm_start() {
+	int fd;
+
+	if (!globalArgs.shm) return EXIT_SUCCESS;
+
+	snprintf(shmName, sizeof(shmName), "/" NPT_SHM_PREFIX "%d", (int)getpid());
+	fd = shm_open(shmName, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Error: unable to create the shared memory segment %s, %s (%d)\n",
+				shmName, strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+	if (ftruncate(fd, sizeof(struct npt_shm)) != 0) {
+		fprintf(stderr, "Error: unable to size the shared memory segment %s, %s (%d)\n",
+				shmName, strerror(errno), errno);
+		close(fd);
+		shm_unlink(shmName);
+		return EXIT_FAILURE;
+	}
+	shm = mmap(NULL, sizeof(struct npt_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		fprintf(stderr, "Error: unable to map the shared memory segment %s, %s (%d)\n",
+				shmName, strerror(errno), errno);
+		shm = NULL;
+		shm_unlink(shmName);
+		return EXIT_FAILURE;
+	}
+
+	shmBuckets = npt_alloc_local(sizeof(uint64_t) * NPT_SHM_BUCKETS, "live histogram");
+	if (shmBuckets == NULL) {
+		npt_shm_stop();
+		return EXIT_FAILURE;
+	}
+
+	memcpy(shm->magic, NPT_SHM_MAGIC, sizeof(NPT_SHM_MAGIC));
+	shm->version = NPT_SHM_VERSION;
+	shm->pid = getpid();
+	npt_shm_reset();
+	printf("# Live statistics published in /dev/shm%s, see npt-top\n", shmName);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Remove the segment
+ */
+void npt_shm_stop() {
+	if (shm == NULL) return;
+
+	munmap(shm, sizeof(struct npt_shm));
+	shm = NULL;
+	shm_unlink(shmName);
+	npt_free_local(shmBuckets);
+	shmBuckets = NULL;
+}
+
+/**
+ * Empty the live histogram before a run
+ */
+void npt_shm_reset() {
+	if (shmBuckets == NULL) return;
+
+	memset(shmBuckets, 0, sizeof(uint64_t) * NPT_SHM_BUCKETS);
+	shmIntervalTicks = (uint64_t)((double)globalArgs.cpuHz * NPT_SHM_INTERVAL * 1.0e-6);
+	if (shmIntervalTicks == 0) shmIntervalTicks = 1;
+	npt_shm_publish(NPT_SHM_IDLE);
+}
+
+/**
+ * Publish the statistics of the loop, with memory accesses only
+ */
+void npt_shm_publish(uint32_t state) {
+	uint64_t seq;
+
+	if (shm == NULL) return;
+
+	seq = shm->seq;
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	shm->cpu = globalArgs.affinity;
+	shm->state = state;
+	shm->cpuHz = globalArgs.cpuHz;
+	shm->loops = counter;
+	shm->ticks = sumTicks;
+	shm->maxTicks = (counter > 0) ? (uint64_t)llround(maxDuration / globalArgs.cpuPeriod) : 0;
+	memcpy(shm->buckets, shmBuckets, sizeof(shm->buckets));
+
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Publish the statistics of the running loop, and return the number of
+ * ticks at which they are due again
+ */
+uint64_t npt_shm_event(uint64_t now) {
+	npt_shm_publish(NPT_SHM_RUNNING);
+	return now + shmIntervalTicks;
+}
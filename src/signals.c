@@ -0,0 +1,190 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// sqrt
+#include <pthread.h>	// pthread_*
+#include <signal.h>	// sigset_t, sigtimedwait
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strsignal
+#include <time.h>	// struct timespec
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/signals.h>
+
+/** Requests not handled by the loop yet */
+int signalPending = 0;
+
+/** Signal which stopped the run */
+int signalStopped = 0;
+
+/** The signals handled by the signal thread */
+static sigset_t signalSet;
+
+/** The signal thread */
+static pthread_t signalThread;
+static int signalStopping;
+static bool signalStarted = false;
+
+/**
+ * Statistics copied by the loop when a snapshot is requested, so that
+ * they are consistent with each other
+ */
+static struct {
+	uint64_t loops;
+	uint64_t sumTicks;
+	uint64_t overruns;
+	double min, max;
+	double mean, meanSquared;
+} signalSnapshot;
+static int signalSnapshotReady;
+static unsigned int signalSnapshots = 0;
+
+/**
+ * Quantiles shown in the snapshot reports
+ */
+static const double signalQuantiles[] = { 0.5, 0.99, 0.9999, 0.999999 };
+#define NPT_SIGNAL_QUANTILES (sizeof(signalQuantiles) / sizeof(signalQuantiles[0]))
+
+/**
+ * Handle the requests of the housekeeping threads, called from the loop.
+ * Returns true if the loop has to stop.
+ */
+bool npt_signal_handle() {
+	int pending = __atomic_exchange_n(&signalPending, 0, __ATOMIC_ACQUIRE);
+
+	if (pending & NPT_SIGNAL_SNAPSHOT) {
+		signalSnapshot.loops = counter;
+		signalSnapshot.sumTicks = sumTicks;
+		signalSnapshot.overruns = histogramOverruns;
+		signalSnapshot.min = minDuration;
+		signalSnapshot.max = maxDuration;
+		signalSnapshot.mean = meanDuration;
+		signalSnapshot.meanSquared = meanSquared;
+		__atomic_store_n(&signalSnapshotReady, 1, __ATOMIC_RELEASE);
+	}
+
+	return (pending & (NPT_SIGNAL_STOP | NPT_SIGNAL_CONVERGED)) != 0;
+}
+
+/**
+ * Print a snapshot of the results. The statistics are the ones copied
+ * by the loop, the quantiles are read from the histogram which may be
+ * a few loops ahead.
+ */
+static void _signal_snapshot() {
+	double values[NPT_SIGNAL_QUANTILES];
+	int i;
+
+	__atomic_store_n(&signalSnapshotReady, 0, __ATOMIC_RELAXED);
+	__atomic_or_fetch(&signalPending, NPT_SIGNAL_SNAPSHOT, __ATOMIC_RELEASE);
+
+	// The loop only checks the requests in counted loops
+	for (i = 0; i < 1000 && !__atomic_load_n(&signalSnapshotReady, __ATOMIC_ACQUIRE); i++)
+		npt_housekeeping_sleep(1);
+	if (!__atomic_load_n(&signalSnapshotReady, __ATOMIC_ACQUIRE)) {
+		fprintf(stderr, "# Snapshot not available, the loop is not running\n");
+		return;
+	}
+
+	npt_histogram_percentiles(signalQuantiles, values, NPT_SIGNAL_QUANTILES);
+
+	flockfile(stdout);
+	printf("# Snapshot %u: %" PRIu64 " loops done in %.6f s\n", ++signalSnapshots,
+			signalSnapshot.loops,
+			(double)signalSnapshot.sumTicks * globalArgs.cpuPeriod / multi);
+	printf("#	min: %.6f	max: %.6f	mean: %.6f	std dev: %.6f %s\n",
+			signalSnapshot.min, signalSnapshot.max, signalSnapshot.mean,
+			(signalSnapshot.loops > 0) ?
+				sqrt(signalSnapshot.meanSquared / signalSnapshot.loops) : 0.0,
+			UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
+	printf("#	");
+	for (i = 0; i < (int)NPT_SIGNAL_QUANTILES; i++)
+		printf("p%g: %.0f	", signalQuantiles[i] * 100.0, values[i]);
+	printf("overruns: %" PRIu64 "\n", signalSnapshot.overruns);
+	fflush(stdout);
+	funlockfile(stdout);
+}
+
+/**
+ * Signal thread: the signals are blocked in every other thread, so
+ * that the loop is never interrupted by a handler
+ */
+static void *_signal_thread(void *arg) {
+	struct timespec timeout = { 0, 100000000 };
+	int sig;
+	(void)arg;
+
+	while (!__atomic_load_n(&signalStopping, __ATOMIC_ACQUIRE)) {
+		sig = sigtimedwait(&signalSet, NULL, &timeout);
+		if (sig == SIGUSR1) {
+			_signal_snapshot();
+		} else if ((sig == SIGINT || sig == SIGTERM) && signalStopped == 0) {
+			fprintf(stderr, "# %s received, stopping the run\n", strsignal(sig));
+			signalStopped = sig;
+			__atomic_or_fetch(&signalPending, NPT_SIGNAL_STOP, __ATOMIC_RELEASE);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Block the handled signals and start the signal thread. Must be called
+ * before any other thread is created, so that they all inherit the mask.
+ */
+int npt_signals_start() {
+	int ret;
+
+	sigemptyset(&signalSet);
+	sigaddset(&signalSet, SIGUSR1);
+	sigaddset(&signalSet, SIGINT);
+	sigaddset(&signalSet, SIGTERM);
+
+	ret = pthread_sigmask(SIG_BLOCK, &signalSet, NULL);
+	if (ret != 0) {
+		fprintf(stderr, "Error: unable to block the signals, %s (%d)\n", strerror(ret), ret);
+		return EXIT_FAILURE;
+	}
+
+	signalStopping = 0;
+	if (npt_housekeeping_start(&signalThread, "npt-signals", _signal_thread, NULL) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	signalStarted = true;
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Stop the signal thread. The signals stay blocked until the end, so
+ * that the report is always written.
+ */
+void npt_signals_stop() {
+	if (!signalStarted) return;
+
+	__atomic_store_n(&signalStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(signalThread);
+	signalStarted = false;
+}
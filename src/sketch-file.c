@@ -0,0 +1,85 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>	// memset, memcpy, strerror
+
+#include <npt/npt.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+
+/**
+ * Write the non-empty buckets of a sketch, with the exact extremes and
+ * sum of its durations in nanoseconds. Shared by npt and by the merge
+ * tool, which does not link the measurement engine.
+ */
+int npt_sketch_write_buckets(const char *filename, const uint64_t *counts, uint64_t overflows,
+		double min, double max, double sum, uint64_t cpuHz) {
+	struct npt_sketch_header header;
+	struct npt_sketch_bucket bucket;
+	uint64_t hash = NPT_FNV1A_INIT;
+	FILE *fd;
+	int i, ret = EXIT_SUCCESS;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NPT_SKETCH_MAGIC, sizeof(NPT_SKETCH_MAGIC));
+	header.version = NPT_SKETCH_VERSION;
+	header.subBits = NPT_SKETCH_SUBBITS;
+	header.minExponent = NPT_SKETCH_MIN_EXPONENT;
+	header.maxExponent = NPT_SKETCH_MAX_EXPONENT;
+	header.cpuHz = cpuHz;
+	header.overflows = overflows;
+	header.count = overflows;
+	for (i = 0; i < NPT_SKETCH_BUCKETS; i++) {
+		if (counts[i] == 0) continue;
+		header.count += counts[i];
+		header.buckets++;
+	}
+	if (header.count > 0) {
+		header.min = min;
+		header.max = max;
+		header.sum = sum;
+	}
+
+	fd = fopen(filename, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	hash = npt_fnv1a(hash, &header, sizeof(header));
+	if (fwrite(&header, sizeof(header), 1, fd) != 1) ret = EXIT_FAILURE;
+	for (i = 0; i < NPT_SKETCH_BUCKETS && ret == EXIT_SUCCESS; i++) {
+		if (counts[i] == 0) continue;
+		bucket.index = i;
+		bucket.count = counts[i];
+		hash = npt_fnv1a(hash, &bucket, sizeof(bucket));
+		if (fwrite(&bucket, sizeof(bucket), 1, fd) != 1) ret = EXIT_FAILURE;
+	}
+	if (ret == EXIT_SUCCESS && fwrite(&hash, sizeof(hash), 1, fd) != 1) ret = EXIT_FAILURE;
+	if (fclose(fd) != 0) ret = EXIT_FAILURE;
+	if (ret != EXIT_SUCCESS)
+		fprintf(stderr, "Error: unable to write '%s', %s (%d)\n", filename, strerror(errno), errno);
+
+	return ret;
+}
@@ -0,0 +1,296 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <dirent.h>	// scandir
+#include <getopt.h>	// getopt_long
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// ceil
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strncmp, strtok_r
+#include <sys/stat.h>	// stat
+
+#include <npt/npt.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+#include <version.h>
+
+/**
+ * Most percentiles that can be asked for
+ */
+#define NPT_MERGE_MAX_PERCENTILES 32
+
+/**
+ * The merged sketch: the buckets of all the sketches added together,
+ * so that memory does not depend on the number of sketches
+ */
+static struct {
+	uint64_t counts[NPT_SKETCH_BUCKETS];
+	uint64_t count, overflows;
+	double min, max, sum;
+	uint64_t cpuHz;
+	unsigned int sketches;
+} merged;
+
+/** The percentiles to print */
+static double mergePercentiles[NPT_MERGE_MAX_PERCENTILES] = { 50, 90, 99, 99.9, 99.99, 99.999 };
+static int mergePercentilesCount = 6;
+
+/**
+ * Show help message
+ */
+static void _help() {
+	printf("npt sketches merge (npt-sketch-merge) %s\n", FULL_VERSION);
+	printf(	"usage: npt-sketch-merge <options> SKETCH [SKETCH...]\n\n"
+		"Merge the sketches written by npt (--sketch option) and print the\n"
+		"percentiles of all their loops, within %.2f%% of the exact ones. Each\n"
+		"SKETCH is either a sketch file or a directory of sketch files.\n\n"
+		"	-h		--help			show this message\n"
+		"	-o FILE		--output=FILE		write the merged sketch in FILE, to be\n"
+		"						merged again\n"
+		"	-p LIST		--percentiles=LIST	comma separated percentiles to print\n"
+		"						(default: 50,90,99,99.9,99.99,99.999)\n"
+		"	-V		--version		show the tool version\n",
+		NPT_SKETCH_ERROR * 100.0
+	      );
+}
+
+/**
+ * Add a sketch file to the merged sketch
+ */
+static int _merge_file(const char *filename) {
+	struct npt_sketch_header header;
+	struct npt_sketch_bucket bucket;
+	uint64_t i, hash = NPT_FNV1A_INIT, checksum;
+	FILE *fd;
+	int ret = EXIT_FAILURE;
+
+	fd = fopen(filename, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in read mode.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(&header, sizeof(header), 1, fd) != 1
+		|| strncmp(header.magic, NPT_SKETCH_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != NPT_SKETCH_VERSION) {
+		fprintf(stderr, "Error: '%s' is not a valid sketch file.\n", filename);
+		goto end;
+	}
+	if (header.subBits != NPT_SKETCH_SUBBITS || header.minExponent != NPT_SKETCH_MIN_EXPONENT
+		|| header.maxExponent != NPT_SKETCH_MAX_EXPONENT) {
+		fprintf(stderr, "Error: '%s' does not use the buckets of this version.\n", filename);
+		goto end;
+	}
+	hash = npt_fnv1a(hash, &header, sizeof(header));
+
+	for (i = 0; i < header.buckets; i++) {
+		if (fread(&bucket, sizeof(bucket), 1, fd) != 1
+			|| bucket.index >= NPT_SKETCH_BUCKETS) {
+			fprintf(stderr, "Error: '%s' is truncated or corrupted.\n", filename);
+			goto end;
+		}
+		hash = npt_fnv1a(hash, &bucket, sizeof(bucket));
+		merged.counts[bucket.index] += bucket.count;
+	}
+
+	if (fread(&checksum, sizeof(checksum), 1, fd) != 1 || checksum != hash) {
+		fprintf(stderr, "Error: '%s' has an invalid checksum.\n", filename);
+		goto end;
+	}
+
+	if (header.count > 0) {
+		if (merged.count == 0 || header.min < merged.min) merged.min = header.min;
+		if (merged.count == 0 || header.max > merged.max) merged.max = header.max;
+	}
+	merged.count += header.count;
+	merged.overflows += header.overflows;
+	merged.sum += header.sum;
+	merged.cpuHz = (merged.sketches == 0 || merged.cpuHz == header.cpuHz) ? header.cpuHz : 0;
+	merged.sketches++;
+	ret = EXIT_SUCCESS;
+
+end:
+	fclose(fd);
+	return ret;
+}
+
+static int _sketch_filter(const struct dirent *entry) {
+	return entry->d_name[0] != '.';
+}
+
+/**
+ * Add a sketch file, or all the sketch files of a directory
+ */
+static int _merge(const char *name) {
+	struct dirent **entries;
+	struct stat st;
+	char *filename;
+	int i, n, ret = EXIT_SUCCESS;
+
+	if (stat(name, &st) != 0 || !S_ISDIR(st.st_mode))
+		return _merge_file(name);
+
+	n = scandir(name, &entries, _sketch_filter, alphasort);
+	if (n <= 0) {
+		fprintf(stderr, "Error: no sketch found in '%s'.\n", name);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < n; i++) {
+		if (ret == EXIT_SUCCESS) {
+			if (asprintf(&filename, "%s/%s", name, entries[i]->d_name) < 0)
+				ret = EXIT_FAILURE;
+			else {
+				ret = _merge_file(filename);
+				free(filename);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return ret;
+}
+
+/**
+ * Print the percentiles of the merged sketch in one scan of its buckets,
+ * the percentiles being sorted in increasing order
+ */
+static void _print() {
+	uint64_t sum = 0, rank;
+	double value;
+	int i = 0, j;
+
+	printf("%u sketch(es), %" PRIu64 " loops merged.\n", merged.sketches, merged.count);
+	if (merged.count == 0) return;
+	printf("Loops duration:\n");
+	printf("	min:		%.6f us\n", merged.min / 1e3);
+	printf("	max:		%.6f us\n", merged.max / 1e3);
+	printf("	mean:		%.6f us\n", merged.sum / (double)merged.count / 1e3);
+	printf("Percentiles (within %.2f%%):\n", NPT_SKETCH_ERROR * 100.0);
+
+	for (j = 0; j < mergePercentilesCount; j++) {
+		rank = (uint64_t)ceil(mergePercentiles[j] / 100.0 * (double)merged.count);
+		if (rank == 0) rank = 1;
+		while (i < NPT_SKETCH_BUCKETS && sum + merged.counts[i] < rank)
+			sum += merged.counts[i++];
+
+		// The overflows are only known by the maximum
+		if (i == NPT_SKETCH_BUCKETS) {
+			printf("	%g%%:		> %.6f us (overflow)\n", mergePercentiles[j],
+					ldexp(1.0, NPT_SKETCH_MAX_EXPONENT + 1) / 1e3);
+			continue;
+		}
+
+		// The extremes are exact, and tighten the first and last buckets
+		value = npt_sketch_value(i);
+		if (value < merged.min) value = merged.min;
+		if (value > merged.max) value = merged.max;
+		printf("	%g%%:		%.6f us\n", mergePercentiles[j], value / 1e3);
+	}
+	if (merged.overflows > 0)
+		printf("Overflows (%.0f+ us): %" PRIu64 "\n",
+				ldexp(1.0, NPT_SKETCH_MAX_EXPONENT + 1) / 1e3, merged.overflows);
+}
+
+/**
+ * Parse the comma separated percentiles, which must be increasing
+ */
+static int _parse_percentiles(char *list) {
+	char *token, *save = NULL, *end;
+	double p;
+
+	mergePercentilesCount = 0;
+	for (token = strtok_r(list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		p = strtod(token, &end);
+		if (end == token || *end != '\0' || p <= 0 || p > 100
+			|| mergePercentilesCount == NPT_MERGE_MAX_PERCENTILES
+			|| (mergePercentilesCount > 0 && p <= mergePercentiles[mergePercentilesCount - 1]))
+			return EXIT_FAILURE;
+		mergePercentiles[mergePercentilesCount++] = p;
+	}
+	return (mergePercentilesCount > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv) {
+	const char *output = NULL;
+	int c, i;
+
+	for (;;) {
+		static struct option long_options[] = {
+			{"help",		no_argument,		0,	'h'},
+			{"output",		required_argument,	0,	'o'},
+			{"percentiles",		required_argument,	0,	'p'},
+			{"version",		no_argument,		0,	'V'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "ho:p:V", long_options, &option_index);
+		if (c == -1) break;
+
+		switch (c) {
+			// Option -h, --help
+			case 'h':
+				_help();
+				return EXIT_SUCCESS;
+
+			// Option -o, --output
+			case 'o':
+				output = optarg;
+				break;
+
+			// Option -p, --percentiles
+			case 'p':
+				if (_parse_percentiles(optarg) != EXIT_SUCCESS) {
+					fprintf(stderr, "--percentiles: argument must be increasing percentiles "
+							"between 0 and 100\n");
+					return EXIT_FAILURE;
+				}
+				break;
+
+			// Option -V, --version
+			case 'V':
+				printf("npt sketches merge (npt-sketch-merge) %s\n", FULL_VERSION);
+				return EXIT_SUCCESS;
+
+			case '?':
+				/* getopt_long already printed an error message. */
+				return EXIT_FAILURE;
+
+			default:
+				abort();
+		}
+	}
+
+	if (argc - optind < 1) {
+		_help();
+		return EXIT_FAILURE;
+	}
+
+	for (i = optind; i < argc; i++)
+		if (_merge(argv[i]) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+	if (output != NULL && npt_sketch_write_buckets(output, merged.counts, merged.overflows,
+			merged.min, merged.max, merged.sum, merged.cpuHz) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	_print();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>	// memset
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+
+/** The buckets of the sketch, local to the measured CPU */
+uint64_t *sketch = NULL;
+uint64_t sketchOverflows = 0;
+double sketchScale = 1.0;
+
+/**
+ * Allocate the sketch on the node of the measured CPU
+ */
+int npt_sketch_init() {
+	sketchScale = 1.0e9 / multi;
+	if (sketch == NULL)
+		sketch = npt_alloc_local(sizeof(uint64_t) * NPT_SKETCH_BUCKETS, "sketch");
+	if (sketch == NULL) {
+		fprintf(stderr, "Error: unable to allocate the sketch.\n");
+		return EXIT_FAILURE;
+	}
+	npt_sketch_reset();
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Empty the sketch before a run
+ */
+void npt_sketch_reset() {
+	if (sketch == NULL) return;
+	memset(sketch, 0, sizeof(uint64_t) * NPT_SKETCH_BUCKETS);
+	sketchOverflows = 0;
+}
+
+/**
+ * Write the sketch of the run, with its exact extremes and sum
+ */
+int npt_sketch_write(const char *filename) {
+	if (sketch == NULL || filename == NULL) return EXIT_SUCCESS;
+
+	return npt_sketch_write_buckets(filename, sketch, sketchOverflows, minDuration * sketchScale,
+			maxDuration * sketchScale, sumDuration * sketchScale, globalArgs.cpuHz);
+}
+
+/**
+ * Free the sketch
+ */
+void npt_sketch_free() {
+	npt_free_local(sketch);
+	sketch = NULL;
+}
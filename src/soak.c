@@ -0,0 +1,445 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <dirent.h>	// scandir
+#include <errno.h>	// errno
+#include <fcntl.h>	// open
+#include <inttypes.h>	// PRIu64
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t, UINT64_MAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, memset, strncmp
+#include <time.h>	// time, localtime_r, strftime
+#include <unistd.h>	// fsync, unlink
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/numa.h>
+#include <npt/soak.h>
+
+/** The period currently filled by the loop */
+struct npt_period *soakPeriod = NULL;
+
+/** The two period slots */
+static struct npt_period soakSlots[2];
+
+/** Length of a period, and number of ticks of the next rotation */
+static uint64_t soakPeriodTicks;
+static uint64_t soakNextRotation;
+
+/** The checkpoint thread */
+static pthread_t soakThread;
+static int soakStopping;
+
+/**
+ * Summary of each closed period, to show the trend at the end of the run
+ */
+struct npt_soak_trend {
+	uint64_t index;
+	int64_t closedAt;
+	uint64_t loops;
+	uint64_t overruns;
+	double min, mean, max;
+};
+static struct npt_soak_trend *soakTrend = NULL;
+static size_t soakTrendSize = 0;
+
+/**
+ * Prepare a period slot to be filled by the loop
+ */
+static void _period_open(struct npt_period *p, uint64_t index) {
+	memset(&p->stats, 0, sizeof(p->stats));
+	p->stats.index = index;
+	p->stats.min = 99999.0;
+	p->stats.max = 0.0;
+	__atomic_store_n(&p->state, NPT_PERIOD_FILLING, __ATOMIC_RELEASE);
+}
+
+/**
+ * Close a period slot, snapshotting the cumulative statistics
+ */
+static void _period_close(struct npt_period *p) {
+	p->stats.closedAt = (int64_t)time(NULL);
+	p->stats.totalLoops = counter;
+	p->stats.totalSumTicks = sumTicks;
+	p->stats.totalOverruns = histogramOverruns;
+	p->stats.totalMin = minDuration;
+	p->stats.totalMax = maxDuration;
+	p->stats.totalMean = meanDuration;
+	p->stats.totalMeanSquared = meanSquared;
+	__atomic_store_n(&p->state, NPT_PERIOD_CLOSED, __ATOMIC_RELEASE);
+}
+
+/**
+ * Append a period to the trend
+ */
+static void _trend_add(struct npt_period_stats *stats, uint64_t cpuHz) {
+	struct npt_soak_trend *t;
+
+	t = realloc(soakTrend, sizeof(*soakTrend) * (soakTrendSize + 1));
+	if (t == NULL) return;
+	soakTrend = t;
+
+	t = &soakTrend[soakTrendSize++];
+	t->index = stats->index;
+	t->closedAt = stats->closedAt;
+	t->loops = stats->loops;
+	t->overruns = stats->overruns;
+	t->min = (stats->loops > 0) ? stats->min : 0.0;
+	t->max = stats->max;
+	t->mean = (stats->loops > 0) ?
+		(double)stats->sumTicks * (multi / (double)cpuHz) / (double)stats->loops
+		: 0.0;
+}
+
+/**
+ * Write a closed period in the checkpoint directory. The file is first
+ * written under a temporary name, synced, then renamed so that a crash
+ * never leaves a partial checkpoint.
+ */
+static int _period_write(struct npt_period *p) {
+	struct npt_checkpoint_header header;
+	struct npt_checkpoint_bucket bucket;
+	char *tmpname = NULL, *filename = NULL;
+	uint64_t hash = NPT_FNV1A_INIT;
+	FILE *fd;
+	int i, dirfd, ret = EXIT_FAILURE;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NPT_CHECKPOINT_MAGIC, sizeof(NPT_CHECKPOINT_MAGIC));
+	header.version = NPT_CHECKPOINT_VERSION;
+	header.unit = UNIT_INDEX(globalArgs.picoseconds, globalArgs.nanoseconds);
+	header.cpuHz = globalArgs.cpuHz;
+	header.stats = p->stats;
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++)
+		if (p->histogram[i] > 0) header.buckets++;
+
+	if (asprintf(&tmpname, "%s/.period-%06" PRIu64 ".tmp",
+			globalArgs.checkpoint, p->stats.index) < 0
+		|| asprintf(&filename, "%s/period-%06" PRIu64 ".npt",
+			globalArgs.checkpoint, p->stats.index) < 0)
+		goto end;
+
+	fd = fopen(tmpname, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in write mode, %s (%d)\n",
+				tmpname, strerror(errno), errno);
+		goto end;
+	}
+
+	fwrite(&header, sizeof(header), 1, fd);
+	hash = npt_fnv1a(hash, &header, sizeof(header));
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++) {
+		if (p->histogram[i] == 0) continue;
+		bucket.index = i;
+		bucket.count = p->histogram[i];
+		fwrite(&bucket, sizeof(bucket), 1, fd);
+		hash = npt_fnv1a(hash, &bucket, sizeof(bucket));
+	}
+	fwrite(&hash, sizeof(hash), 1, fd);
+
+	if (fflush(fd) != 0 || fsync(fileno(fd)) != 0) {
+		fprintf(stderr, "Error: unable to write '%s', %s (%d)\n",
+				tmpname, strerror(errno), errno);
+		fclose(fd);
+		unlink(tmpname);
+		goto end;
+	}
+	fclose(fd);
+
+	if (rename(tmpname, filename) != 0) {
+		fprintf(stderr, "Error: unable to rename '%s', %s (%d)\n",
+				tmpname, strerror(errno), errno);
+		unlink(tmpname);
+		goto end;
+	}
+
+	// Make the rename itself durable
+	dirfd = open(globalArgs.checkpoint, O_RDONLY | O_DIRECTORY);
+	if (dirfd >= 0) {
+		fsync(dirfd);
+		close(dirfd);
+	}
+	ret = EXIT_SUCCESS;
+
+end:
+	free(tmpname);
+	free(filename);
+	return ret;
+}
+
+/**
+ * Checkpoint thread: writes the closed periods and gives the slots
+ * back to the loop
+ */
+static void *_soak_thread(void *arg) {
+	int i, stopping;
+	(void)arg;
+
+	do {
+		stopping = __atomic_load_n(&soakStopping, __ATOMIC_ACQUIRE);
+
+		for (i = 0; i < 2; i++) {
+			struct npt_period *p = &soakSlots[i];
+			if (__atomic_load_n(&p->state, __ATOMIC_ACQUIRE) != NPT_PERIOD_CLOSED)
+				continue;
+
+			if (globalArgs.checkpoint != NULL)
+				_period_write(p);
+			_trend_add(&p->stats, globalArgs.cpuHz);
+
+			memset(p->histogram, 0, sizeof(uint64_t) * NPT_HISTOGRAM_SIZE);
+			__atomic_store_n(&p->state, NPT_PERIOD_FREE, __ATOMIC_RELEASE);
+		}
+
+		if (!stopping) npt_housekeeping_sleep(100);
+	} while (!stopping);
+
+	return NULL;
+}
+
+/**
+ * Only keep the checkpoint files when scanning the directory
+ */
+static int _checkpoint_filter(const struct dirent *entry) {
+	size_t len = strlen(entry->d_name);
+	return (strncmp(entry->d_name, "period-", 7) == 0
+		&& len > 4 && strcmp(entry->d_name + len - 4, ".npt") == 0);
+}
+
+/**
+ * Read one checkpoint file, adding its histogram to the main one
+ */
+static int _checkpoint_read(const char *filename, struct npt_checkpoint_header *header) {
+	struct npt_checkpoint_bucket bucket;
+	uint64_t i, hash = NPT_FNV1A_INIT, checksum;
+	FILE *fd;
+
+	fd = fopen(filename, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "Error: unable to open '%s' in read mode.\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(header, sizeof(*header), 1, fd) != 1
+		|| strncmp(header->magic, NPT_CHECKPOINT_MAGIC, sizeof(header->magic)) != 0
+		|| header->version != NPT_CHECKPOINT_VERSION) {
+		fprintf(stderr, "Error: '%s' is not a valid checkpoint file.\n", filename);
+		goto err;
+	}
+	if (header->unit != (uint32_t)UNIT_INDEX(globalArgs.picoseconds, globalArgs.nanoseconds)) {
+		fprintf(stderr, "Error: '%s' was not recorded in %s.\n", filename,
+				UNITE(globalArgs.picoseconds, globalArgs.nanoseconds));
+		goto err;
+	}
+	hash = npt_fnv1a(hash, header, sizeof(*header));
+
+	for (i = 0; i < header->buckets; i++) {
+		if (fread(&bucket, sizeof(bucket), 1, fd) != 1
+			|| bucket.index >= NPT_HISTOGRAM_SIZE) {
+			fprintf(stderr, "Error: '%s' is truncated or corrupted.\n", filename);
+			goto err;
+		}
+		hash = npt_fnv1a(hash, &bucket, sizeof(bucket));
+		histogram[bucket.index] += bucket.count;
+	}
+
+	if (fread(&checksum, sizeof(checksum), 1, fd) != 1 || checksum != hash) {
+		fprintf(stderr, "Error: '%s' has an invalid checksum.\n", filename);
+		goto err;
+	}
+
+	fclose(fd);
+	return EXIT_SUCCESS;
+
+err:
+	fclose(fd);
+	return EXIT_FAILURE;
+}
+
+/**
+ * Reload the statistics and histogram from the checkpoint directory,
+ * and return the index of the next period
+ */
+static int _soak_resume(uint64_t *nextIndex) {
+	struct dirent **entries;
+	struct npt_checkpoint_header header;
+	char *filename;
+	int i, n, ret = EXIT_SUCCESS;
+	bool found = false;
+
+	n = scandir(globalArgs.checkpoint, &entries, _checkpoint_filter, alphasort);
+	if (n < 0) {
+		fprintf(stderr, "Error: unable to read the checkpoint directory '%s', %s (%d)\n",
+				globalArgs.checkpoint, strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (ret == EXIT_SUCCESS) {
+			if (asprintf(&filename, "%s/%s", globalArgs.checkpoint, entries[i]->d_name) < 0) {
+				ret = EXIT_FAILURE;
+			} else {
+				ret = _checkpoint_read(filename, &header);
+				free(filename);
+			}
+
+			if (ret == EXIT_SUCCESS) {
+				found = true;
+				_trend_add(&header.stats, header.cpuHz);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	if (ret != EXIT_SUCCESS) return ret;
+	if (!found) {
+		printf("# No checkpoint found in '%s', starting a new run\n", globalArgs.checkpoint);
+		*nextIndex = 0;
+		return EXIT_SUCCESS;
+	}
+
+	// The statistics are the ones of the last closed period
+	counter = header.stats.totalLoops;
+	sumTicks = header.stats.totalSumTicks;
+	histogramOverruns = header.stats.totalOverruns;
+	minDuration = header.stats.totalMin;
+	maxDuration = header.stats.totalMax;
+	meanDuration = header.stats.totalMean;
+	meanSquared = header.stats.totalMeanSquared;
+	*nextIndex = header.stats.index + 1;
+
+	// The ticks are only exact for the same CPU frequency
+	if (header.cpuHz != globalArgs.cpuHz) {
+		printf("# Checkpoint recorded at %.02f MHz, rescaling to %.02f MHz\n",
+				header.cpuHz / 1e6, globalArgs.cpuHz / 1e6);
+		sumTicks = (uint64_t)((double)sumTicks
+				* ((double)globalArgs.cpuHz / (double)header.cpuHz));
+	}
+	wallTicks = sumTicks;
+
+	printf("# Resuming after period %" PRIu64 " (%" PRIu64 " loops already done)\n",
+			header.stats.index, counter);
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Prepare the soak mode: allocate the period slots, reload the
+ * checkpoints if we resume a run and start the checkpoint thread
+ */
+int npt_soak_init() {
+	uint64_t index = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		soakSlots[i].histogram = npt_alloc_local(sizeof(uint64_t) * NPT_HISTOGRAM_SIZE,
+				"soak histogram");
+		if (soakSlots[i].histogram == NULL) {
+			fprintf(stderr, "Error: unable to allocate the soak histograms.\n");
+			return EXIT_FAILURE;
+		}
+		soakSlots[i].state = NPT_PERIOD_FREE;
+	}
+
+	if (globalArgs.resume && _soak_resume(&index) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	soakPeriodTicks = globalArgs.soak_period * globalArgs.cpuHz;
+	soakNextRotation = npt_elapsed_ticks() + soakPeriodTicks;
+	_period_open(&soakSlots[0], index);
+	soakPeriod = &soakSlots[0];
+
+	soakStopping = 0;
+	if (npt_housekeeping_start(&soakThread, "npt-checkpoint", _soak_thread, NULL) != EXIT_SUCCESS) {
+		soakPeriod = NULL;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Close the current period and open the next one, called from the loop.
+ * If the checkpoint thread did not free the other slot yet, the current
+ * period is extended rather than blocking the loop.
+ */
+uint64_t npt_soak_rotate(uint64_t now) {
+	struct npt_period *next = (soakPeriod == &soakSlots[0]) ? &soakSlots[1] : &soakSlots[0];
+
+	if (now < soakNextRotation) return soakNextRotation;
+	while (soakNextRotation <= now)
+		soakNextRotation += soakPeriodTicks;
+
+	if (__atomic_load_n(&next->state, __ATOMIC_ACQUIRE) == NPT_PERIOD_FREE) {
+		uint64_t index = soakPeriod->stats.index + 1;
+		_period_close(soakPeriod);
+		_period_open(next, index);
+		soakPeriod = next;
+	}
+
+	return soakNextRotation;
+}
+
+/**
+ * Close the last period and wait for the checkpoint thread to write it
+ */
+void npt_soak_stop() {
+	int i;
+
+	if (soakPeriod == NULL) return;
+
+	if (soakPeriod->stats.loops > 0)
+		_period_close(soakPeriod);
+	soakPeriod = NULL;
+
+	__atomic_store_n(&soakStopping, 1, __ATOMIC_RELEASE);
+	npt_housekeeping_join(soakThread);
+
+	for (i = 0; i < 2; i++) {
+		npt_free_local(soakSlots[i].histogram);
+		soakSlots[i].histogram = NULL;
+	}
+}
+
+/**
+ * Print the trend of the soak periods
+ */
+void npt_soak_print(FILE *fd, const char *prefix) {
+	char date[32];
+	struct tm tm;
+	time_t closedAt;
+	size_t i;
+
+	if (soakTrendSize == 0) return;
+
+	fprintf(fd, "%sSoak periods:\n", prefix);
+	fprintf(fd, "%s	period	closed at		loops		min		mean		max		overruns\n", prefix);
+	for (i = 0; i < soakTrendSize; i++) {
+		closedAt = (time_t)soakTrend[i].closedAt;
+		localtime_r(&closedAt, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+		fprintf(fd, "%s	%" PRIu64 "	%s	%" PRIu64 "	%.6f	%.6f	%.6f	%" PRIu64 "\n",
+				prefix, soakTrend[i].index, date, soakTrend[i].loops,
+				soakTrend[i].min, soakTrend[i].mean, soakTrend[i].max,
+				soakTrend[i].overruns);
+	}
+}
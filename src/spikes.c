@@ -0,0 +1,333 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// cos, sin, atan2, sqrt, round
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t, UINT64_MAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// memset
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+#include <npt/spikes.h>
+
+/** The spikes buffer */
+struct npt_spike *spikes = NULL;
+uint64_t spikesSize = 0;
+uint64_t spikesCount = 0;
+
+/** Threshold in ticks */
+uint64_t spikeTicks = UINT64_MAX;
+
+/**
+ * Minimum normalized autocorrelation for a lag to be a candidate period
+ */
+#define NPT_PERIODICITY_MIN	0.05
+
+/**
+ * Maximum number of spikes used to refine each period
+ */
+#define NPT_PERIODICITY_REFINE	65536
+
+/**
+ * A candidate period
+ */
+struct npt_period_candidate {
+	double lag;		/* in bins */
+	double strength;	/* normalized autocorrelation */
+	double period;		/* in ticks */
+	double coherence;	/* length of the mean resultant */
+	double phase;		/* in ticks */
+};
+
+/**
+ * Prepare the spikes buffer, if a threshold was given
+ */
+int npt_spikes_init() {
+	// Release the buffer of a previous run
+	if (globalArgs.threshold == 0) {
+		npt_spikes_free();
+		return EXIT_SUCCESS;
+	}
+
+	spikeTicks = (uint64_t)((double)globalArgs.threshold / globalArgs.cpuPeriod);
+
+	// Resize the buffer of a previous run
+	if (spikes != NULL && spikesSize != globalArgs.max_spikes)
+		npt_spikes_free();
+	if (spikes == NULL) {
+		spikesSize = globalArgs.max_spikes;
+		spikes = npt_alloc_local(sizeof(struct npt_spike) * spikesSize, "spikes");
+		if (spikes == NULL) {
+			fprintf(stderr, "Error: unable to allocate the buffer of %" PRIu64 " spikes.\n",
+					spikesSize);
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Free the spikes buffer
+ */
+void npt_spikes_free() {
+	npt_free_local(spikes);
+	spikes = NULL;
+	spikesSize = 0;
+	spikeTicks = UINT64_MAX;
+}
+
+/**
+ * In-place radix-2 FFT, n being a power of two. The twiddle factors are
+ * given for the size n, as cos/sin(2*pi*k/n) for k < n/2.
+ */
+static void _fft(double *re, double *im, size_t n, const double *twr, const double *twi, bool inverse) {
+	size_t i, j, k, bit, len, step;
+	double tr, ti, ur, ui, wr, wi;
+
+	// Bit reversal permutation
+	for (i = 1, j = 0; i < n; i++) {
+		for (bit = n >> 1; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			tr = re[i]; re[i] = re[j]; re[j] = tr;
+			ti = im[i]; im[i] = im[j]; im[j] = ti;
+		}
+	}
+
+	// Butterflies
+	for (len = 2; len <= n; len <<= 1) {
+		step = n / len;
+		for (i = 0; i < n; i += len) {
+			for (k = 0; k < len / 2; k++) {
+				wr = twr[k * step];
+				wi = inverse ? twi[k * step] : -twi[k * step];
+				ur = re[i + k];
+				ui = im[i + k];
+				tr = re[i + k + len/2] * wr - im[i + k + len/2] * wi;
+				ti = re[i + k + len/2] * wi + im[i + k + len/2] * wr;
+				re[i + k] = ur + tr;
+				im[i + k] = ui + ti;
+				re[i + k + len/2] = ur - tr;
+				im[i + k + len/2] = ui - ti;
+			}
+		}
+	}
+}
+
+/**
+ * Whether a is close to an integer multiple (>= 2) of b, both in bins
+ */
+static bool _is_multiple(double a, double b) {
+	double m = round(a / b);
+	return (m >= 2 && fabs(a - m * b) <= 1.5 + 0.01 * a);
+}
+
+/**
+ * Sort candidates by decreasing strength
+ */
+static int _candidate_cmp(const void *a, const void *b) {
+	double sa = ((const struct npt_period_candidate *)a)->strength;
+	double sb = ((const struct npt_period_candidate *)b)->strength;
+	return (sa < sb) - (sa > sb);
+}
+
+/**
+ * Coherence and phase of the spikes for a given period in ticks,
+ * computed from the mean resultant of their angles
+ */
+static double _coherence(uint64_t n, uint64_t stride, double period, double *phase) {
+	double c = 0.0, s = 0.0, angle;
+	uint64_t i, used = 0;
+
+	for (i = 0; i < n; i += stride) {
+		angle = 2.0 * M_PI * fmod((double)spikes[i].at, period) / period;
+		c += cos(angle);
+		s += sin(angle);
+		used++;
+	}
+
+	if (phase != NULL) {
+		angle = atan2(s, c);
+		if (angle < 0) angle += 2.0 * M_PI;
+		*phase = angle / (2.0 * M_PI) * period;
+	}
+	return sqrt(c * c + s * s) / (double)used;
+}
+
+/**
+ * Find the dominant periods of the spikes: the spike series is binned,
+ * the power spectra of its segments are averaged and transformed back
+ * into an autocorrelation, whose peaks are the candidate periods.
+ * Multiples of a stronger period are its harmonics and are dropped.
+ */
+static int _periodicity(struct npt_period_candidate *top, double *binUnits) {
+	struct npt_period_candidate *candidates = NULL, *c;
+	double *re = NULL, *im = NULL, *power = NULL, *twr = NULL, *twi = NULL;
+	double binTicks, mean, *r;
+	uint64_t n = (spikesCount < spikesSize) ? spikesCount : spikesSize;
+	uint64_t nbins, start, i, stride, bin;
+	size_t L = NPT_PERIODICITY_SEGMENT, size, k, ncandidates = 0, ntop = 0, t;
+	int step;
+
+	binTicks = (double)globalArgs.spike_bin / globalArgs.cpuPeriod;
+	if (binTicks < 1.0) binTicks = 1.0;
+	*binUnits = binTicks * globalArgs.cpuPeriod;
+
+	nbins = (uint64_t)((double)spikes[n-1].at / binTicks) + 1;
+	if (nbins < L) {
+		for (L = 16; L < nbins; L <<= 1);
+	}
+	size = 2 * L;
+	mean = (double)n / (double)nbins;
+
+	re = malloc(sizeof(double) * size);
+	im = malloc(sizeof(double) * size);
+	power = calloc(size, sizeof(double));
+	twr = malloc(sizeof(double) * size / 2);
+	twi = malloc(sizeof(double) * size / 2);
+	candidates = malloc(sizeof(*candidates) * (L / 2));
+	if (re == NULL || im == NULL || power == NULL || twr == NULL
+			|| twi == NULL || candidates == NULL) {
+		fprintf(stderr, "Error: unable to allocate the periodicity analysis buffers.\n");
+		goto end;
+	}
+	for (k = 0; k < size / 2; k++) {
+		twr[k] = cos(2.0 * M_PI * (double)k / (double)size);
+		twi[k] = sin(2.0 * M_PI * (double)k / (double)size);
+	}
+
+	// Average the power spectra of the zero-padded segments
+	for (start = 0, i = 0; start < nbins; start += L) {
+		memset(re, 0, sizeof(double) * size);
+		memset(im, 0, sizeof(double) * size);
+		for (k = 0; k < L && start + k < nbins; k++) re[k] = -mean;
+		for (; i < n; i++) {
+			bin = (uint64_t)((double)spikes[i].at / binTicks);
+			if (bin >= start + L) break;
+			re[bin - start] += 1.0;
+		}
+
+		_fft(re, im, size, twr, twi, false);
+		for (k = 0; k < size; k++)
+			power[k] += re[k] * re[k] + im[k] * im[k];
+	}
+
+	// Back to the autocorrelation
+	memset(im, 0, sizeof(double) * size);
+	_fft(power, im, size, twr, twi, true);
+	r = power;
+	if (r[0] <= 0.0) goto end;
+	for (k = L / 2; k > 0; k--)
+		r[k] = r[k] / r[0] * (double)L / (double)(L - k);
+	r[0] = 1.0;
+
+	// Peaks of the autocorrelation, refined by parabolic interpolation
+	for (k = 2; k < L / 2 - 1; k++) {
+		if (r[k] > NPT_PERIODICITY_MIN && r[k] > r[k-1] && r[k] >= r[k+1]) {
+			double den = r[k-1] - 2.0 * r[k] + r[k+1];
+			c = &candidates[ncandidates++];
+			c->lag = (double)k + ((den != 0.0) ? 0.5 * (r[k-1] - r[k+1]) / den : 0.0);
+			c->strength = r[k];
+		}
+	}
+	qsort(candidates, ncandidates, sizeof(*candidates), _candidate_cmp);
+
+	// Keep the strongest ones which are not harmonics of another one
+	for (k = 0; k < ncandidates; k++) {
+		bool harmonic = false;
+		for (t = 0; t < ntop && !harmonic; t++) {
+			if (_is_multiple(candidates[k].lag, top[t].lag))
+				harmonic = true;
+			else if (_is_multiple(top[t].lag, candidates[k].lag)
+					&& candidates[k].strength >= 0.7 * top[t].strength) {
+				// We found the fundamental of a kept period
+				top[t] = candidates[k];
+				harmonic = true;
+			}
+		}
+		if (!harmonic && ntop < NPT_PERIODICITY_TOP)
+			top[ntop++] = candidates[k];
+	}
+
+	// Refine each period on the spikes themselves
+	stride = n / NPT_PERIODICITY_REFINE + 1;
+	for (t = 0; t < ntop; t++) {
+		double best = top[t].lag * binTicks, coherence, period;
+		top[t].coherence = _coherence(n, stride, best, NULL);
+		for (step = -32; step <= 32; step++) {
+			period = (top[t].lag + step / 32.0) * binTicks;
+			if (period <= 0.0) continue;
+			coherence = _coherence(n, stride, period, NULL);
+			if (coherence > top[t].coherence) {
+				top[t].coherence = coherence;
+				best = period;
+			}
+		}
+		top[t].period = best;
+		top[t].coherence = _coherence(n, stride, best, &top[t].phase);
+	}
+
+end:
+	free(re);
+	free(im);
+	free(power);
+	free(twr);
+	free(twi);
+	free(candidates);
+	return ntop;
+}
+
+/**
+ * Print the spikes statistics and their dominant periods
+ */
+void npt_periodicity_print(FILE *fd, const char *prefix) {
+	struct npt_period_candidate top[NPT_PERIODICITY_TOP];
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	uint64_t n = (spikesCount < spikesSize) ? spikesCount : spikesSize;
+	double binUnits;
+	int i, ntop;
+
+	if (spikes == NULL) return;
+
+	fprintf(fd, "%sSpikes over %" PRIu64 " %s: %" PRIu64, prefix,
+			globalArgs.threshold, unit, spikesCount);
+	if (spikesCount > spikesSize)
+		fprintf(fd, " (only the first %" PRIu64 " analyzed)", spikesSize);
+	fprintf(fd, "\n");
+	if (n < 3) return;
+
+	ntop = _periodicity(top, &binUnits);
+	if (ntop == 0) {
+		fprintf(fd, "%s	no periodicity found (bins of %.3f %s)\n", prefix, binUnits, unit);
+		return;
+	}
+
+	fprintf(fd, "%sSpike periodicity (bins of %.3f %s):\n", prefix, binUnits, unit);
+	fprintf(fd, "%s	period (%s)	strength	coherence	phase (%s)\n", prefix, unit, unit);
+	for (i = 0; i < ntop; i++) {
+		fprintf(fd, "%s	%.6f	%.3f		%.3f		%.6f\n", prefix,
+				top[i].period * globalArgs.cpuPeriod, top[i].strength,
+				top[i].coherence, top[i].phase * globalArgs.cpuPeriod);
+	}
+}
@@ -0,0 +1,188 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <inttypes.h>	// PRIu64
+#include <stdint.h>	// uint64_t, UINT64_MAX
+#include <stdio.h>
+#include <string.h>	// memset
+
+#include <npt/npt.h>
+#include <npt/spikes.h>
+#include <npt/stolen.h>
+
+/** The slow loops, and the burst in progress */
+uint64_t stolenSlowTicks = UINT64_MAX;
+uint64_t stolenBurstLoops = 0;
+static uint64_t stolenBurstTicks;
+
+/** The shortest loop, and the slow loops of the run */
+static uint64_t stolenBaseline;
+static uint64_t stolenLoops, stolenTicks;
+
+/** The interval in progress, and the fractions of the closed ones */
+static uint64_t stolenIntervalTicks, stolenIntervalStart;
+static uint64_t stolenIntervalLoops, stolenIntervalSum;
+static uint64_t stolenIntervals, stolenWorstInterval;
+static double stolenFractions, stolenWorst;
+
+/** The bursts of slow loops */
+static uint64_t stolenBursts, stolenBurstsLoops, stolenBurstsExcess;
+static uint64_t stolenBurstMaxLoops, stolenBurstMaxExcess;
+static uint64_t stolenBurstBins[NPT_STOLEN_BURST_BINS];
+
+/**
+ * Reset the accounting before a run
+ */
+void npt_stolen_reset() {
+	stolenSlowTicks = UINT64_MAX;
+	stolenBurstLoops = stolenBurstTicks = 0;
+	stolenBaseline = UINT64_MAX;
+	stolenLoops = stolenTicks = 0;
+	stolenIntervalTicks = stolenIntervalStart = 0;
+	stolenIntervalLoops = stolenIntervalSum = 0;
+	stolenIntervals = stolenWorstInterval = 0;
+	stolenFractions = stolenWorst = 0.0;
+	stolenBursts = stolenBurstsLoops = stolenBurstsExcess = 0;
+	stolenBurstMaxLoops = stolenBurstMaxExcess = 0;
+	memset(stolenBurstBins, 0, sizeof(stolenBurstBins));
+}
+
+/**
+ * Length of the intervals in ticks, once the frequency is known
+ */
+static uint64_t _interval_ticks() {
+	if (stolenIntervalTicks == 0)
+		stolenIntervalTicks = (uint64_t)((double)globalArgs.stolen_interval * 1.0e-6 * globalArgs.cpuHz);
+	if (stolenIntervalTicks == 0) stolenIntervalTicks = 1;
+	return stolenIntervalTicks;
+}
+
+/**
+ * Lower the baseline to a shorter loop, and the slow loops with it
+ * unless a threshold was given
+ */
+void npt_stolen_baseline(uint64_t ticks) {
+	if (ticks >= stolenBaseline) return;
+	stolenBaseline = ticks;
+	stolenSlowTicks = (spikeTicks != UINT64_MAX) ? spikeTicks
+		: NPT_STOLEN_FACTOR * ((ticks > 0) ? ticks : 1);
+}
+
+/**
+ * Account a slow loop
+ */
+void npt_stolen_slow(uint64_t ticks) {
+	stolenLoops++;
+	stolenTicks += ticks;
+	stolenIntervalLoops++;
+	stolenIntervalSum += ticks;
+	stolenBurstLoops++;
+	stolenBurstTicks += ticks;
+}
+
+/**
+ * Close the burst of slow loops in progress
+ */
+void npt_stolen_burst_end() {
+	uint64_t excess = stolenBurstTicks - stolenBurstLoops * stolenBaseline;
+	int bin = 63 - __builtin_clzll(stolenBurstLoops);
+
+	stolenBursts++;
+	stolenBurstBins[(bin < NPT_STOLEN_BURST_BINS) ? bin : NPT_STOLEN_BURST_BINS - 1]++;
+	stolenBurstsLoops += stolenBurstLoops;
+	stolenBurstsExcess += excess;
+	if (stolenBurstLoops > stolenBurstMaxLoops) stolenBurstMaxLoops = stolenBurstLoops;
+	if (excess > stolenBurstMaxExcess) stolenBurstMaxExcess = excess;
+	stolenBurstLoops = stolenBurstTicks = 0;
+}
+
+/**
+ * Close the interval in progress at the given ticks
+ */
+static void _interval_close(uint64_t now) {
+	double fraction = (double)(stolenIntervalSum - stolenIntervalLoops * stolenBaseline)
+		/ (double)(now - stolenIntervalStart);
+
+	stolenIntervals++;
+	stolenFractions += fraction;
+	if (stolenIntervals == 1 || fraction > stolenWorst) {
+		stolenWorst = fraction;
+		stolenWorstInterval = stolenIntervals;
+	}
+	stolenIntervalStart = now;
+	stolenIntervalLoops = stolenIntervalSum = 0;
+}
+
+/**
+ * Close the interval once it is over, and return the number of ticks
+ * at which the next one is over
+ */
+uint64_t npt_stolen_event(uint64_t now) {
+	if (now >= stolenIntervalStart + _interval_ticks()) _interval_close(now);
+	return stolenIntervalStart + _interval_ticks();
+}
+
+/**
+ * Close the burst in progress and the last interval at the end of the
+ * run, the latter only if it lasted half an interval
+ */
+void npt_stolen_finish(uint64_t now) {
+	if (stolenBurstLoops > 0) npt_stolen_burst_end();
+	if (now - stolenIntervalStart >= _interval_ticks() / 2 && now > stolenIntervalStart)
+		_interval_close(now);
+}
+
+/**
+ * Print the time stolen from the loop, per interval and by burst
+ */
+void npt_stolen_print(FILE *fd, const char *prefix) {
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	uint64_t excess, elapsed;
+	int i;
+
+	if (counter == 0 || stolenBaseline == UINT64_MAX) return;
+	excess = stolenTicks - stolenLoops * stolenBaseline;
+	elapsed = npt_elapsed_ticks();
+
+	fprintf(fd, "%sStolen time (loops over %.3f %s, baseline %.3f %s):\n", prefix,
+			stolenSlowTicks * globalArgs.cpuPeriod, unit, stolenBaseline * globalArgs.cpuPeriod, unit);
+	fprintf(fd, "%s	total:		%.3f %s (%.4f%% of the run) in %" PRIu64 " slow loop(s)\n", prefix,
+			excess * globalArgs.cpuPeriod, unit,
+			(elapsed > 0) ? 100.0 * excess / elapsed : 0.0, stolenLoops);
+	if (stolenIntervals > 0)
+		fprintf(fd, "%s	per interval:	mean %.4f%%, worst %.4f%% (interval %" PRIu64 " of %" PRIu64
+				", %g s each)\n", prefix, 100.0 * stolenFractions / stolenIntervals,
+				100.0 * stolenWorst, stolenWorstInterval, stolenIntervals,
+				globalArgs.stolen_interval * 1.0e-6);
+	if (stolenBursts == 0) return;
+
+	fprintf(fd, "%s	bursts:		%" PRIu64 ", mean %.1f loops / %.3f %s, max %" PRIu64
+			" loops / %.3f %s\n", prefix, stolenBursts,
+			(double)stolenBurstsLoops / stolenBursts,
+			stolenBurstsExcess * globalArgs.cpuPeriod / stolenBursts, unit,
+			stolenBurstMaxLoops, stolenBurstMaxExcess * globalArgs.cpuPeriod, unit);
+	fprintf(fd, "%s	burst loops:	", prefix);
+	for (i = 0; i < NPT_STOLEN_BURST_BINS; i++) {
+		if (stolenBurstBins[i] == 0) continue;
+		if (i == 0) fprintf(fd, "1: %" PRIu64 " ", stolenBurstBins[i]);
+		else fprintf(fd, "%llu-%llu: %" PRIu64 " ", 1ULL << i, (2ULL << i) - 1, stolenBurstBins[i]);
+	}
+	fprintf(fd, "\n");
+}
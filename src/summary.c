@@ -0,0 +1,67 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <inttypes.h>	// PRIu64
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+
+#include <npt/npt.h>
+#include <npt/summary.h>
+
+/** Quantiles compared between the runs */
+static const double summaryQuantiles[NPT_SUMMARY_QUANTILES] = { 0.99, 0.9999, 0.999999 };
+
+/**
+ * Keep the results of the run which just ended
+ */
+void npt_summary_fill(struct npt_summary *s) {
+	s->loops = counter;
+	s->overruns = histogramOverruns;
+	s->min = minDuration;
+	s->mean = meanDuration;
+	s->max = maxDuration;
+	s->stdDeviation = stdDeviation;
+	npt_histogram_percentiles(summaryQuantiles, s->quantiles, NPT_SUMMARY_QUANTILES);
+}
+
+/**
+ * Print the columns of the results, which end the lines of the
+ * comparisons
+ */
+void npt_summary_print_header(FILE *fd) {
+	int j;
+
+	fprintf(fd, "loops		min		mean		");
+	for (j = 0; j < NPT_SUMMARY_QUANTILES; j++)
+		fprintf(fd, "p%g	", summaryQuantiles[j] * 100.0);
+	fprintf(fd, "max		overruns\n");
+}
+
+/**
+ * Print the results of a run, in the columns of npt_summary_print_header
+ */
+void npt_summary_print(FILE *fd, const struct npt_summary *s) {
+	int j;
+
+	fprintf(fd, "%" PRIu64 "	%.6f	%.6f	", s->loops, s->min, s->mean);
+	for (j = 0; j < NPT_SUMMARY_QUANTILES; j++)
+		fprintf(fd, "%.0f	", s->quantiles[j]);
+	fprintf(fd, "%.6f	%" PRIu64 "\n", s->max, s->overruns);
+}
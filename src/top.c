@@ -0,0 +1,264 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <dirent.h>	// opendir, readdir
+#include <errno.h>	// errno, ESRCH
+#include <fcntl.h>	// O_RDONLY
+#include <getopt.h>	// getopt_long
+#include <inttypes.h>	// PRIu64
+#include <limits.h>	// NAME_MAX
+#include <math.h>	// ceil
+#include <signal.h>	// kill
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// qsort
+#include <string.h>	// strncmp
+#include <sys/mman.h>	// shm_open, mmap, munmap
+#include <sys/stat.h>	// fstat
+#include <time.h>	// clock_gettime, nanosleep
+#include <unistd.h>	// isatty, close
+
+#include <npt/npt.h>
+#include <npt/shm.h>
+#include <version.h>
+
+/**
+ * Most instances shown, and percentiles of each
+ */
+#define NPT_TOP_MAX_INSTANCES	256
+#define NPT_TOP_PERCENTILES	3
+
+/**
+ * An instance, as read at the last refresh
+ */
+struct npt_top_instance {
+	struct npt_shm shm;
+	int alive;
+	double rate;
+};
+
+static struct npt_top_instance topInstances[NPT_TOP_MAX_INSTANCES];
+static int topInstancesCount = 0;
+
+/** The loops of each instance at the previous refresh, to get their rate */
+static struct {
+	int32_t pid;
+	uint64_t loops;
+} topPrevious[NPT_TOP_MAX_INSTANCES];
+static int topPreviousCount = 0;
+
+static const double topPercentiles[NPT_TOP_PERCENTILES] = { 50, 99, 99.99 };
+
+/**
+ * Show help message
+ */
+static void _help() {
+	printf("npt live statistics (npt-top) %s\n", FULL_VERSION);
+	printf(	"usage: npt-top <options>\n\n"
+		"Show the live statistics of the npt instances started with --shm,\n"
+		"refreshed every second. The percentiles are the upper bounds of their\n"
+		"bucket, at most 1/8 over the exact ones.\n\n"
+		"	-h		--help			show this message\n"
+		"	-n NB		--iterations=NB		stop after NB refreshes\n"
+		"	-V		--version		show the tool version\n"
+	      );
+}
+
+/**
+ * Read the segment of an instance
+ */
+static int _top_read(const char *name, struct npt_top_instance *instance) {
+	struct npt_shm *shm;
+	struct stat st;
+	char path[NAME_MAX + 2];
+	int fd, ret = EXIT_FAILURE;
+
+	snprintf(path, sizeof(path), "/%s", name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0) return EXIT_FAILURE;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct npt_shm)) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	shm = mmap(NULL, sizeof(struct npt_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) return EXIT_FAILURE;
+
+	if (npt_shm_snapshot(shm, &instance->shm) == 0
+		&& strncmp(instance->shm.magic, NPT_SHM_MAGIC, sizeof(instance->shm.magic)) == 0
+		&& instance->shm.version == NPT_SHM_VERSION) {
+		instance->alive = (kill(instance->shm.pid, 0) == 0 || errno != ESRCH);
+		ret = EXIT_SUCCESS;
+	}
+	munmap(shm, sizeof(struct npt_shm));
+	return ret;
+}
+
+static int _top_compare(const void *a, const void *b) {
+	const struct npt_shm *x = &((const struct npt_top_instance *)a)->shm;
+	const struct npt_shm *y = &((const struct npt_top_instance *)b)->shm;
+
+	if (x->cpu != y->cpu) return (x->cpu < y->cpu) ? -1 : 1;
+	return (x->pid < y->pid) ? -1 : (x->pid > y->pid);
+}
+
+/**
+ * Read the segments of all the instances, and the rate of their loops
+ * since the previous refresh
+ */
+static void _top_scan(double elapsed) {
+	struct npt_top_instance *instance;
+	struct dirent *entry;
+	DIR *dir;
+	int i, j;
+
+	topInstancesCount = 0;
+	dir = opendir("/dev/shm");
+	if (dir == NULL) return;
+	while ((entry = readdir(dir)) != NULL && topInstancesCount < NPT_TOP_MAX_INSTANCES) {
+		if (strncmp(entry->d_name, NPT_SHM_PREFIX, strlen(NPT_SHM_PREFIX)) != 0) continue;
+		instance = &topInstances[topInstancesCount];
+		if (_top_read(entry->d_name, instance) != EXIT_SUCCESS) continue;
+
+		instance->rate = -1.0;
+		for (j = 0; j < topPreviousCount && elapsed > 0.0; j++)
+			if (topPrevious[j].pid == instance->shm.pid && instance->shm.loops >= topPrevious[j].loops)
+				instance->rate = (double)(instance->shm.loops - topPrevious[j].loops) / elapsed;
+		topInstancesCount++;
+	}
+	closedir(dir);
+
+	qsort(topInstances, topInstancesCount, sizeof(topInstances[0]), _top_compare);
+	for (i = 0; i < topInstancesCount; i++) {
+		topPrevious[i].pid = topInstances[i].shm.pid;
+		topPrevious[i].loops = topInstances[i].shm.loops;
+	}
+	topPreviousCount = topInstancesCount;
+}
+
+/**
+ * Return the upper bound in ticks of the bucket of a percentile
+ */
+static uint64_t _top_percentile(const struct npt_shm *shm, double percentile) {
+	uint64_t total = 0, cumulated = 0, rank;
+	int i;
+
+	for (i = 0; i < NPT_SHM_BUCKETS; i++) total += shm->buckets[i];
+	if (total == 0) return 0;
+	rank = (uint64_t)ceil(percentile / 100.0 * (double)total);
+	if (rank == 0) rank = 1;
+	for (i = 0; i < NPT_SHM_BUCKETS; i++) {
+		cumulated += shm->buckets[i];
+		if (cumulated >= rank) return npt_shm_bound(i);
+	}
+	return npt_shm_bound(NPT_SHM_BUCKETS - 1);
+}
+
+/**
+ * Print the table of the instances
+ */
+static void _top_print() {
+	const struct npt_shm *shm;
+	double toMicro;
+	int i, j;
+
+	printf("npt-top - %d instance(s), durations in us\n\n", topInstancesCount);
+	printf("    PID	CPU	STATE	LOOPS		LOOPS/S		");
+	for (j = 0; j < NPT_TOP_PERCENTILES; j++) printf("P%g	", topPercentiles[j]);
+	printf("MAX\n");
+
+	for (i = 0; i < topInstancesCount; i++) {
+		shm = &topInstances[i].shm;
+		toMicro = (shm->cpuHz > 0) ? 1.0e6 / (double)shm->cpuHz : 0.0;
+		printf("%7d	%u	%s	%-15" PRIu64 "	", shm->pid, shm->cpu,
+				!topInstances[i].alive ? "exited"
+				: (shm->state == NPT_SHM_RUNNING) ? "running" : "idle",
+				shm->loops);
+		if (topInstances[i].rate >= 0.0) printf("%-15.0f	", topInstances[i].rate);
+		else printf("-		");
+		for (j = 0; j < NPT_TOP_PERCENTILES; j++)
+			printf("%.3f	", (double)_top_percentile(shm, topPercentiles[j]) * toMicro);
+		printf("%.3f\n", (double)shm->maxTicks * toMicro);
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	struct timespec now, last, interval = { 1, 0 };
+	unsigned long iterations = 0, i;
+	double elapsed = 0.0;
+	int c, tty = isatty(STDOUT_FILENO);
+
+	for (;;) {
+		static struct option long_options[] = {
+			{"help",		no_argument,		0,	'h'},
+			{"iterations",		required_argument,	0,	'n'},
+			{"version",		no_argument,		0,	'V'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+
+		c = getopt_long(argc, argv, "hn:V", long_options, &option_index);
+		if (c == -1) break;
+
+		switch (c) {
+			// Option -h, --help
+			case 'h':
+				_help();
+				return EXIT_SUCCESS;
+
+			// Option -n, --iterations
+			case 'n':
+				if (sscanf(optarg, "%lu", &iterations) != 1 || iterations == 0) {
+					fprintf(stderr, "--iterations: argument must be a positive integer\n");
+					return EXIT_FAILURE;
+				}
+				break;
+
+			// Option -V, --version
+			case 'V':
+				printf("npt live statistics (npt-top) %s\n", FULL_VERSION);
+				return EXIT_SUCCESS;
+
+			case '?':
+				/* getopt_long already printed an error message. */
+				return EXIT_FAILURE;
+
+			default:
+				abort();
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	for (i = 0; iterations == 0 || i < iterations; i++) {
+		if (i > 0) {
+			nanosleep(&interval, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (double)(now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) * 1.0e-9;
+			last = now;
+		}
+		_top_scan(elapsed);
+		if (tty) printf("\033[H\033[2J");
+		else if (i > 0) printf("\n");
+		_top_print();
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <math.h>	// fabs
+#include <pthread.h>	// pthread_*
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// realloc, free
+#include <string.h>	// strstr, strcspn
+#include <time.h>	// nanosleep
+
+#include <npt/npt.h>
+#include <npt/housekeeping.h>
+#include <npt/tsc.h>
+#include <npt/workload.h>
+
+/**
+ * Longest wait for the end of a loop before a pairing (nanoseconds):
+ * the loop is not running if it takes longer
+ */
+#define NPT_TSC_WAIT_MAX	1000000
+
+/** Length of the calibration of the TSC (nanoseconds) */
+#define NPT_TSC_CALIBRATION	200000000
+
+/** Frequency of the TSC against CLOCK_MONOTONIC_RAW, 0 if not calibrated */
+double tscHz = 0.0;
+
+/** The monitor thread */
+static pthread_t tscThread;
+static int tscStopping;
+static bool tscStarted = false;
+
+/** The pairings of the current run */
+static struct npt_tsc_sample *tscSamples = NULL;
+static size_t tscCount = 0, tscSize = 0;
+
+/** Intervals beyond the tolerance, and if the last one was */
+static unsigned int tscFlagged = 0;
+static bool tscDrifting = false;
+
+/** Summary of the intervals of the run, computed when it stops */
+static unsigned int tscIntervals = 0;
+static double tscMinHz, tscMaxHz, tscMeanHz, tscMaxDrift, tscFactor = 1.0;
+
+/**
+ * Measure the frequency of the TSC against the raw monotonic clock, on
+ * the calling thread. It is the reference of the drift and of the
+ * effective frequency of the MSRs, the frequency of /proc/cpuinfo being
+ * the one of the core rather than the one of its TSC.
+ */
+double npt_tsc_calibrate() {
+	struct timespec req = { 0, NPT_TSC_CALIBRATION };
+	uint64_t t0, t1, ns0, ns1;
+
+	ns0 = npt_housekeeping_raw_ns();
+	t0 = rdtsc();
+	nanosleep(&req, NULL);
+	t1 = rdtsc();
+	ns1 = npt_housekeeping_raw_ns();
+
+	tscHz = (ns1 > ns0) ? (double)(t1 - t0) * 1.0e9 / (double)(ns1 - ns0) : 0.0;
+	return tscHz;
+}
+
+/**
+ * Reference of the drift: the calibrated frequency, else the nominal one
+ */
+static double _tsc_reference() {
+	return (tscHz > 0.0) ? tscHz : (double)globalArgs.cpuHz;
+}
+
+/**
+ * Frequency of the measured TSC over an interval, 0 if the loop was
+ * not counting at both of its ends
+ */
+static double _interval_hz(const struct npt_tsc_sample *a, const struct npt_tsc_sample *b) {
+	if (a->loops == 0 || b->loops <= a->loops || b->ticks <= a->ticks || b->ns <= a->ns)
+		return 0.0;
+	return (double)(b->ticks - a->ticks) * 1.0e9 / (double)(b->ns - a->ns);
+}
+
+/**
+ * Factor converting the ticks of an interval to the reference frequency:
+ * 1 unless the interval drifted beyond the tolerance
+ */
+static double _interval_scale(const struct npt_tsc_sample *a, const struct npt_tsc_sample *b) {
+	double hz = _interval_hz(a, b);
+
+	if (hz == 0.0 || fabs(hz - _tsc_reference()) / _tsc_reference() * 1.0e6
+			<= globalArgs.tsc_tolerance)
+		return 1.0;
+	return _tsc_reference() / hz;
+}
+
+/**
+ * Pair the ticks summed by the loop, which are the ones of the measured
+ * CPU, with the raw monotonic clock. The pairing is done right after the
+ * end of a loop, so that the loop in progress is negligible.
+ */
+static void _tsc_sample() {
+	struct npt_tsc_sample s;
+	uint64_t loops, start, before, after;
+
+	loops = __atomic_load_n(&counter, __ATOMIC_RELAXED);
+	start = npt_housekeeping_raw_ns();
+	while (__atomic_load_n(&counter, __ATOMIC_RELAXED) == loops
+			&& npt_housekeeping_raw_ns() - start < NPT_TSC_WAIT_MAX);
+
+	before = npt_housekeeping_raw_ns();
+	s.ticks = __atomic_load_n(&sumTicks, __ATOMIC_RELAXED);
+	s.loops = __atomic_load_n(&counter, __ATOMIC_RELAXED);
+	after = npt_housekeeping_raw_ns();
+	s.ns = before + (after - before) / 2;
+	if (s.loops == loops) s.loops = 0;
+
+	npt_tsc_record(&s);
+}
+
+/**
+ * Keep a pairing, and flag the drift of the interval it closes from the
+ * calibrated frequency, once until the frequency is back
+ */
+void npt_tsc_record(const struct npt_tsc_sample *s) {
+	struct npt_tsc_sample *samples;
+	double hz, drift;
+
+	if (tscCount == tscSize) {
+		samples = realloc(tscSamples, sizeof(*samples) * (tscSize ? 2 * tscSize : 64));
+		if (samples == NULL) return;
+		tscSamples = samples;
+		tscSize = tscSize ? 2 * tscSize : 64;
+	}
+	tscSamples[tscCount++] = *s;
+	if (tscCount < 2) return;
+
+	hz = _interval_hz(&tscSamples[tscCount - 2], &tscSamples[tscCount - 1]);
+	if (hz == 0.0) return;
+	drift = (hz - _tsc_reference()) / _tsc_reference() * 1.0e6;
+	if (fabs(drift) > globalArgs.tsc_tolerance) {
+		if (!tscDrifting)
+			fprintf(stderr, "# TSC drift of %+.1f ppm from the calibrated frequency\n", drift);
+		tscDrifting = true;
+		tscFlagged++;
+	} else tscDrifting = false;
+}
+
+static void *_tsc_thread(void *arg) {
+	(void)arg;
+
+	npt_housekeeping_every(globalArgs.tsc_interval * 1000, &tscStopping, _tsc_sample);
+	return NULL;
+}
+
+/**
+ * Start the monitor of the TSC frequency for a run. The ticks of the
+ * plugin workloads only count the calls of the plugin, they cannot be
+ * paired with a clock.
+ */
+int npt_tsc_start() {
+	tscCount = 0;
+	tscFlagged = 0;
+	tscDrifting = false;
+	tscIntervals = 0;
+	tscFactor = 1.0;
+	if (globalArgs.tsc_interval == 0 || workloadFunction != NULL) return EXIT_SUCCESS;
+	if (tscHz == 0.0) npt_tsc_calibrate();
+
+	tscStopping = 0;
+	if (npt_housekeeping_start(&tscThread, "npt-tsc", _tsc_thread, NULL) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	tscStarted = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Stop the monitor, summarize the frequency measured in the intervals of
+ * the run, and if some drifted, rescale the statistics: the ticks of each
+ * drifting interval are converted with the frequency measured in it, the
+ * other ones keep the reference frequency. The sum and the mean are
+ * exact, the other statistics are scaled by the resulting factor. The
+ * histogram cannot be converted per interval, its percentiles are not.
+ */
+void npt_tsc_stop() {
+	double hz, sumHz = 0.0, scaled = 0.0;
+	uint64_t ticks = 0;
+	size_t i;
+
+	if (tscStarted) {
+		__atomic_store_n(&tscStopping, 1, __ATOMIC_RELEASE);
+		npt_housekeeping_join(tscThread);
+		tscStarted = false;
+	}
+
+	for (i = 1; i < tscCount; i++) {
+		hz = _interval_hz(&tscSamples[i - 1], &tscSamples[i]);
+		if (hz == 0.0) continue;
+		if (tscIntervals == 0 || hz < tscMinHz) tscMinHz = hz;
+		if (tscIntervals == 0 || hz > tscMaxHz) tscMaxHz = hz;
+		if (tscIntervals == 0 || fabs(hz - _tsc_reference()) > fabs(tscMaxDrift))
+			tscMaxDrift = hz - _tsc_reference();
+		sumHz += hz;
+		tscIntervals++;
+		ticks += tscSamples[i].ticks - tscSamples[i - 1].ticks;
+		scaled += (double)(tscSamples[i].ticks - tscSamples[i - 1].ticks)
+			* _interval_scale(&tscSamples[i - 1], &tscSamples[i]);
+	}
+	if (tscIntervals == 0) return;
+	tscMeanHz = sumHz / tscIntervals;
+	tscMaxDrift = tscMaxDrift / _tsc_reference() * 1.0e6;
+
+	if (tscFlagged == 0 || sumTicks == 0 || ticks > sumTicks) return;
+	tscFactor = (scaled + (double)(sumTicks - ticks)) / (double)sumTicks;
+	minDuration *= tscFactor;
+	maxDuration *= tscFactor;
+	meanDuration *= tscFactor;
+	sumDuration *= tscFactor;
+	meanSquared *= tscFactor * tscFactor;
+	variance_n *= tscFactor * tscFactor;
+	stdDeviation *= tscFactor;
+}
+
+/**
+ * Factor converting the ticks of a spike, given the elapsed ticks at its
+ * end, to the reference frequency: the one of the interval it is in
+ */
+double npt_tsc_scale(uint64_t at) {
+	size_t low = 1, high = tscCount, middle;
+
+	if (tscFactor == 1.0 || tscCount < 2) return 1.0;
+
+	// First pairing at or after the spike
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (tscSamples[middle].ticks < at) low = middle + 1;
+		else high = middle;
+	}
+	if (low == tscCount || tscSamples[low - 1].ticks >= at) return 1.0;
+	return _interval_scale(&tscSamples[low - 1], &tscSamples[low]);
+}
+
+/**
+ * Free the pairings, at the end
+ */
+void npt_tsc_free() {
+	free(tscSamples);
+	tscSamples = NULL;
+	tscCount = 0;
+	tscSize = 0;
+}
+
+/**
+ * Read the clocksource and if the TSC is invariant
+ */
+static void _tsc_host(char *clocksource, size_t size, bool *invariant) {
+	char line[4096];
+	FILE *fd;
+
+	snprintf(clocksource, size, "unknown");
+	fd = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+	if (fd != NULL) {
+		if (fgets(clocksource, size, fd) != NULL) clocksource[strcspn(clocksource, "\n")] = '\0';
+		fclose(fd);
+	}
+
+	*invariant = false;
+	fd = fopen("/proc/cpuinfo", "r");
+	if (fd == NULL) return;
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		if (strncmp(line, "flags", 5) != 0) continue;
+		*invariant = strstr(line, " constant_tsc") != NULL && strstr(line, " nonstop_tsc") != NULL;
+		break;
+	}
+	fclose(fd);
+}
+
+/**
+ * Print the frequency measured during the run
+ */
+void npt_tsc_print(FILE *fd, const char *prefix) {
+	char clocksource[64];
+	bool invariant;
+
+	if (tscIntervals == 0) return;
+
+	_tsc_host(clocksource, sizeof(clocksource), &invariant);
+	fprintf(fd, "%sTSC:	calibrated %.3f MHz (nominal %.3f MHz), measured %.3f MHz over %u"
+			" interval(s) (min %.3f, max %.3f), max drift %+.1f ppm\n", prefix,
+			_tsc_reference() / 1e6, globalArgs.cpuHz / 1e6, tscMeanHz / 1e6, tscIntervals,
+			tscMinHz / 1e6, tscMaxHz / 1e6, tscMaxDrift);
+	fprintf(fd, "%s	clocksource %s, %s TSC\n", prefix, clocksource,
+			invariant ? "invariant" : "not invariant");
+	if (tscFlagged > 0)
+		fprintf(fd, "%sTSC drift:	%u interval(s) beyond %g ppm, durations and spikes rescaled"
+				" by %.9f overall, the percentiles are not (error within %.1f ppm)\n", prefix,
+				tscFlagged, globalArgs.tsc_tolerance, tscFactor, fabs(tscMaxDrift));
+}
@@ -0,0 +1,350 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno, EINTR
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// ceil
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strerror, strcmp, strdup, strtok_r, memset
+#include <sys/epoll.h>	// epoll_create1, epoll_ctl, epoll_wait
+#include <sys/resource.h>	// getrusage, RUSAGE_THREAD
+#include <sys/timerfd.h>	// timerfd_create, timerfd_settime
+#include <time.h>	// clock_gettime, clock_nanosleep
+#include <unistd.h>	// read, close
+
+#include <npt/npt.h>
+#include <npt/numa.h>
+#include <npt/signals.h>
+#include <npt/sketch.h>
+#include <npt/wait.h>
+
+static const char *waitNames[NPT_WAIT_STRATEGIES] = { "busy", "spin", "sleep", "timerfd", "epoll" };
+static const double waitQuantiles[NPT_WAIT_QUANTILES] = { 0.5, 0.99, 0.999, 0.9999 };
+
+/** The runs of the wait strategies mode */
+static struct npt_wait_run waitRuns[NPT_WAIT_MAX_RUNS];
+static int waitRunsCount = 0;
+
+/** The response latencies of the current run, in the buckets of the sketch */
+static uint64_t *waitBuckets = NULL;
+static uint64_t waitOverflows;
+
+/** The timer of the blocking strategies, and the epoll set watching it */
+static int waitTimer = -1;
+static int waitEpoll = -1;
+
+/**
+ * Prepare the runs of the wait strategies mode, one per strategy of the
+ * comma separated list, in its order
+ */
+int npt_wait_init() {
+	char *copy, *name, *saveptr = NULL;
+	int s, ret = EXIT_SUCCESS;
+
+	waitRunsCount = 0;
+	if (globalArgs.wait == NULL) return EXIT_SUCCESS;
+
+	copy = strdup(globalArgs.wait);
+	if (copy == NULL) return EXIT_FAILURE;
+	for (name = strtok_r(copy, ",", &saveptr); name != NULL && ret == EXIT_SUCCESS;
+			name = strtok_r(NULL, ",", &saveptr)) {
+		for (s = 0; s < NPT_WAIT_STRATEGIES && strcmp(name, waitNames[s]) != 0; s++);
+		if (s == NPT_WAIT_STRATEGIES) {
+			fprintf(stderr, "--wait: unknown strategy '%s'\n", name);
+			ret = EXIT_FAILURE;
+		} else if (waitRunsCount == NPT_WAIT_MAX_RUNS) {
+			fprintf(stderr, "--wait: too many strategies (max. %d)\n", NPT_WAIT_MAX_RUNS);
+			ret = EXIT_FAILURE;
+		} else {
+			memset(&waitRuns[waitRunsCount], 0, sizeof(waitRuns[0]));
+			waitRuns[waitRunsCount++].strategy = s;
+		}
+	}
+	free(copy);
+
+	if (ret == EXIT_SUCCESS && waitRunsCount == 0) {
+		fprintf(stderr, "--wait: no strategy given\n");
+		ret = EXIT_FAILURE;
+	}
+	return ret;
+}
+
+/**
+ * Number of runs of the wait strategies mode, 0 if it is not used
+ */
+int npt_wait_runs() {
+	return waitRunsCount;
+}
+
+const char *npt_wait_name(int strategy) {
+	return waitNames[strategy];
+}
+
+const struct npt_wait_run *npt_wait_result(int run) {
+	return &waitRuns[run];
+}
+
+/**
+ * Current time of the clock of the events, in nanoseconds
+ */
+static __inline__ uint64_t _wait_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Arm the timer of the blocking strategies on the events of the run,
+ * and watch it in an epoll set for the epoll strategy
+ */
+static int _wait_timer_start(int strategy, uint64_t first, uint64_t period) {
+	struct itimerspec its;
+	struct epoll_event event;
+
+	waitTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (waitTimer < 0) {
+		fprintf(stderr, "Error: unable to create the timer, %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	its.it_value.tv_sec = first / 1000000000ULL;
+	its.it_value.tv_nsec = first % 1000000000ULL;
+	its.it_interval.tv_sec = period / 1000000000ULL;
+	its.it_interval.tv_nsec = period % 1000000000ULL;
+	if (timerfd_settime(waitTimer, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+		fprintf(stderr, "Error: unable to arm the timer, %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	if (strategy != NPT_WAIT_EPOLL) return EXIT_SUCCESS;
+	waitEpoll = epoll_create1(EPOLL_CLOEXEC);
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	if (waitEpoll < 0 || epoll_ctl(waitEpoll, EPOLL_CTL_ADD, waitTimer, &event) != 0) {
+		fprintf(stderr, "Error: unable to watch the timer, %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static void _wait_timer_stop() {
+	if (waitEpoll >= 0) close(waitEpoll);
+	if (waitTimer >= 0) close(waitTimer);
+	waitEpoll = waitTimer = -1;
+}
+
+/**
+ * Wait for the event of deadline with a strategy, and return the number
+ * of events that happened since the previous one, the ones that were
+ * missed being merged in it as a timer does, or 0 on error
+ */
+static uint64_t _wait_event(int strategy, uint64_t deadline, uint64_t period,
+		uint64_t spinEnd, uint64_t *now) {
+	struct epoll_event event;
+	struct timespec ts;
+	uint64_t expirations;
+
+	switch (strategy) {
+		case NPT_WAIT_SPIN:
+			// Poll until the event or the end of the spin
+			while ((*now = _wait_now()) < deadline && *now < spinEnd);
+			if (*now >= deadline) break;
+			// Fall through
+
+		case NPT_WAIT_SLEEP:
+			ts.tv_sec = deadline / 1000000000ULL;
+			ts.tv_nsec = deadline % 1000000000ULL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+			*now = _wait_now();
+			break;
+
+		case NPT_WAIT_EPOLL:
+			while (epoll_wait(waitEpoll, &event, 1, -1) < 0)
+				if (errno != EINTR) return 0;
+			// Fall through
+
+		case NPT_WAIT_TIMERFD:
+			if (read(waitTimer, &expirations, sizeof(expirations)) != sizeof(expirations))
+				return 0;
+			*now = _wait_now();
+			return expirations;
+
+		default:
+			while ((*now = _wait_now()) < deadline);
+			break;
+	}
+
+	return (*now - deadline) / period + 1;
+}
+
+/**
+ * Latency of a quantile of the current run, the value of its bucket
+ * bounded by the longest latency
+ */
+static double _wait_quantile(uint64_t events, double quantile, double max) {
+	uint64_t rank = (uint64_t)ceil(quantile * (double)events), seen = 0;
+	int64_t i;
+
+	if (rank == 0) rank = 1;
+	for (i = 0; i < NPT_SKETCH_BUCKETS; i++) {
+		seen += waitBuckets[i];
+		if (seen >= rank) return (npt_sketch_value(i) < max) ? npt_sketch_value(i) : max;
+	}
+	return max;
+}
+
+/**
+ * Run the periodic event through a strategy, for the duration or for
+ * LOOPS events, and measure the response latency of each event and the
+ * CPU time that the waiting thread used
+ */
+static int _wait_run(int run) {
+	struct npt_wait_run *r = &waitRuns[run];
+	uint64_t period = globalArgs.wait_period * 1000, spin = globalArgs.wait_spin * 1000;
+	uint64_t start, end = 0, deadline, now, last, latency, n, sum = 0, max = 0;
+	struct rusage ru0, ru1;
+	int64_t index;
+	double cpu;
+	int j, ret = EXIT_SUCCESS;
+
+	memset(waitBuckets, 0, sizeof(uint64_t) * NPT_SKETCH_BUCKETS);
+	waitOverflows = 0;
+	r->done = true;
+
+	getrusage(RUSAGE_THREAD, &ru0);
+	start = _wait_now();
+	if (globalArgs.duration > 0)
+		end = start + (uint64_t)((double)globalArgs.duration / multi * 1.0e9);
+	deadline = start + period;
+	if ((r->strategy == NPT_WAIT_TIMERFD || r->strategy == NPT_WAIT_EPOLL)
+		&& _wait_timer_start(r->strategy, deadline, period) != EXIT_SUCCESS) {
+		_wait_timer_stop();
+		r->error = true;
+		return EXIT_FAILURE;
+	}
+
+	now = last = start;
+	while ((end > 0) ? deadline <= end : r->events + r->missed < globalArgs.loops) {
+		if (signalStopped != 0) break;
+
+		n = _wait_event(r->strategy, deadline, period, last + spin, &now);
+		if (n == 0) {
+			fprintf(stderr, "Error: unable to wait for the timer, %s (%d)\n",
+					strerror(errno), errno);
+			r->error = true;
+			ret = EXIT_FAILURE;
+			break;
+		}
+
+		latency = now - deadline;
+		index = npt_sketch_index((double)latency);
+		if (index < 0) index = 0;
+		if (index < NPT_SKETCH_BUCKETS) waitBuckets[index]++;
+		else waitOverflows++;
+		sum += latency;
+		if (latency > max) max = latency;
+
+		r->events++;
+		r->missed += n - 1;
+		deadline += n * period;
+		last = now;
+	}
+
+	now = _wait_now();
+	getrusage(RUSAGE_THREAD, &ru1);
+	_wait_timer_stop();
+
+	cpu = (double)(ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec + ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec)
+		+ (double)(ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec
+			+ ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec) * 1.0e-6;
+	r->wall = (double)(now - start) * 1.0e-9;
+	r->cpu = (r->wall > 0.0) ? cpu / r->wall : 0.0;
+	r->wakeups = (uint64_t)(ru1.ru_nvcsw - ru0.ru_nvcsw);
+	r->max = (double)max;
+	if (r->events > 0) {
+		r->mean = (double)sum / (double)r->events;
+		for (j = 0; j < NPT_WAIT_QUANTILES; j++)
+			r->quantiles[j] = _wait_quantile(r->events, waitQuantiles[j], r->max);
+	}
+	return ret;
+}
+
+/**
+ * Run the wait strategies mode, on the CPU and with the policy of the
+ * loop, instead of the loop
+ */
+int npt_wait_cycle() {
+	int run, ret = EXIT_SUCCESS;
+
+	waitBuckets = npt_alloc_local(sizeof(uint64_t) * NPT_SKETCH_BUCKETS, "wait latencies");
+	if (waitBuckets == NULL) return EXIT_FAILURE;
+
+	// The blocking strategies are woken up by interrupts
+	CLI_STI_OPTION_COND { sti(); }
+
+	for (run = 0; run < waitRunsCount && ret == EXIT_SUCCESS && signalStopped == 0; run++) {
+		printf("# Wait strategy %d/%d: %s\n", run + 1, waitRunsCount,
+				waitNames[waitRuns[run].strategy]);
+		ret = _wait_run(run);
+	}
+
+	CLI_STI_OPTION_COND { cli(); }
+
+	npt_free_local(waitBuckets);
+	waitBuckets = NULL;
+	return ret;
+}
+
+/**
+ * Compare the response latency and the CPU usage of the strategies
+ */
+void npt_wait_print(FILE *fd, const char *prefix) {
+	const char *unit = UNITE(globalArgs.picoseconds, globalArgs.nanoseconds);
+	double scale = multi * 1.0e-9;
+	struct npt_wait_run *r;
+	int i, j;
+
+	if (waitRunsCount == 0) return;
+
+	fprintf(fd, "%sWait strategies comparison (period %" PRIu64 "us, spin %" PRIu64 "us, latency in %s):\n",
+			prefix, globalArgs.wait_period, globalArgs.wait_spin, unit);
+	fprintf(fd, "%s	strategy	events	missed	wakeups	CPU	mean		", prefix);
+	for (j = 0; j < NPT_WAIT_QUANTILES; j++)
+		fprintf(fd, "p%g		", waitQuantiles[j] * 100.0);
+	fprintf(fd, "max\n");
+
+	for (i = 0; i < waitRunsCount; i++) {
+		r = &waitRuns[i];
+		if (!r->done) continue;
+		fprintf(fd, "%s	%s		", prefix, waitNames[r->strategy]);
+		if (r->error) {
+			fprintf(fd, "failed\n");
+			continue;
+		}
+		fprintf(fd, "%" PRIu64 "	%" PRIu64 "	%" PRIu64 "	%.1f%%	%.3f	", r->events, r->missed,
+				r->wakeups, r->cpu * 100.0, r->mean * scale);
+		for (j = 0; j < NPT_WAIT_QUANTILES; j++)
+			fprintf(fd, "%.3f		", r->quantiles[j] * scale);
+		fprintf(fd, "%.3f\n", r->max * scale);
+	}
+}
@@ -0,0 +1,133 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <dlfcn.h>	// dlopen, dlsym, dlclose
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	// strrchr
+
+#include <npt/npt.h>
+#include <npt/workload.h>
+
+/** The measured function and its context */
+npt_plugin_workload_t workloadFunction = NULL;
+void *workloadContext = NULL;
+
+/** The plugin and its hooks */
+static void *workloadHandle = NULL;
+static npt_plugin_hook_t workloadWarmup = NULL;
+static npt_plugin_hook_t workloadTeardown = NULL;
+static char *workloadLibrary = NULL;
+static char *workloadSymbol = NULL;
+
+/**
+ * Find a hook of the plugin, which is optional
+ */
+static void *_workload_hook(const char *suffix) {
+	char *name = NULL;
+	void *hook;
+
+	if (asprintf(&name, "%s%s", workloadSymbol, suffix) < 0) return NULL;
+	hook = dlsym(workloadHandle, name);
+	free(name);
+	return hook;
+}
+
+/**
+ * Load the plugin given as LIB:SYMBOL and call its init hook. Done
+ * before entering RT mode, as loading a library is anything but
+ * deterministic.
+ */
+int npt_workload_init() {
+	npt_plugin_init_t init;
+	char *colon;
+
+	workloadLibrary = strdup(globalArgs.workload);
+	if (workloadLibrary == NULL) return EXIT_FAILURE;
+	colon = strrchr(workloadLibrary, ':');
+	if (colon == NULL || colon == workloadLibrary || colon[1] == '\0') {
+		fprintf(stderr, "--workload: argument must be LIB:SYMBOL\n");
+		goto err;
+	}
+	*colon = '\0';
+	workloadSymbol = colon + 1;
+
+	// Resolve everything now, nothing must be resolved in the loop
+	workloadHandle = dlopen(workloadLibrary, RTLD_NOW | RTLD_LOCAL);
+	if (workloadHandle == NULL) {
+		fprintf(stderr, "Error: unable to load the workload plugin, %s\n", dlerror());
+		goto err;
+	}
+
+	*(void **)&workloadFunction = dlsym(workloadHandle, workloadSymbol);
+	if (workloadFunction == NULL) {
+		fprintf(stderr, "Error: '%s' not found in '%s'\n", workloadSymbol, workloadLibrary);
+		goto err;
+	}
+	*(void **)&init = _workload_hook(NPT_PLUGIN_INIT_SUFFIX);
+	*(void **)&workloadWarmup = _workload_hook(NPT_PLUGIN_WARMUP_SUFFIX);
+	*(void **)&workloadTeardown = _workload_hook(NPT_PLUGIN_TEARDOWN_SUFFIX);
+
+	if (init != NULL && init(&workloadContext) != 0) {
+		fprintf(stderr, "Error: the init hook of '%s' failed\n", workloadSymbol);
+		workloadTeardown = NULL;
+		goto err;
+	}
+
+	return EXIT_SUCCESS;
+
+err:
+	npt_workload_free();
+	return EXIT_FAILURE;
+}
+
+/**
+ * Call the warm-up hook of the plugin, before a run of the loop
+ */
+void npt_workload_warmup() {
+	if (workloadWarmup != NULL) workloadWarmup(workloadContext);
+}
+
+/**
+ * Call the teardown hook of the plugin and unload it
+ */
+void npt_workload_free() {
+	if (workloadTeardown != NULL) workloadTeardown(workloadContext);
+	if (workloadHandle != NULL) dlclose(workloadHandle);
+
+	workloadHandle = NULL;
+	workloadFunction = NULL;
+	workloadContext = NULL;
+	workloadWarmup = NULL;
+	workloadTeardown = NULL;
+	free(workloadLibrary);
+	workloadLibrary = NULL;
+	workloadSymbol = NULL;
+}
+
+/**
+ * Print the workload plugin in use
+ */
+void npt_workload_print(FILE *fd, const char *prefix) {
+	if (workloadFunction == NULL) return;
+
+	fprintf(fd, "%sWorkload:	%s from %s, the durations are the ones of its calls\n",
+			prefix, workloadSymbol, workloadLibrary);
+}
@@ -0,0 +1,266 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno
+#include <inttypes.h>	// PRIu64
+#include <sched.h>	// sched_setaffinity, sched_getcpu
+#include <stdbool.h>	// bool, true, false
+#include <stdint.h>	// uint64_t
+#include <stdio.h>
+#include <stdlib.h>	// getenv, atof
+#include <string.h>	// strcmp, strerror
+#include <unistd.h>	// getopt
+
+#include <npt/npt.h>
+#include <npt/chase.h>
+#include <npt/numa.h>
+#include <npt/replay.h>
+#include <npt/shm.h>
+#include <npt/sketch.h>
+#include <npt/soak.h>
+#include <npt/tsc.h>
+#include <npt/workload.h>
+
+/** The options, normally defined by npt.c */
+struct globalArgs_t globalArgs;
+
+/** Default number of loops per run, and runs per variant */
+#define BENCH_LOOPS	20000000ULL
+#define BENCH_RUNS	5
+
+/** Default accepted regression, in percent */
+#define BENCH_TOLERANCE	10.0
+
+/**
+ * A loop variant to benchmark
+ */
+struct bench_variant {
+	const char *name;
+	int (*setup)();
+	void (*teardown)();
+	double cycles;
+	double baseline;
+};
+
+static int _setup_loops() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	return EXIT_SUCCESS;
+}
+
+static int _setup_duration() {
+	// As long as the loops variant, in ticks
+	globalArgs.duration = BENCH_LOOPS * 40;
+	return EXIT_SUCCESS;
+}
+
+static int _setup_soak() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	globalArgs.soak_period = 1;
+	return npt_soak_init();
+}
+
+static void _teardown_soak() {
+	npt_soak_stop();
+	globalArgs.soak_period = 0;
+}
+
+static int _setup_raw_dump() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	return npt_raw_dump_init();
+}
+
+static void _teardown_raw_dump() {
+	npt_free_local(rawDump);
+	rawDump = NULL;
+}
+
+static int _setup_chase() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	globalArgs.pointer_chase = 16 << 10;
+	globalArgs.chase_hops = 1;
+	return npt_chase_init();
+}
+
+static void _teardown_chase() {
+	npt_chase_free();
+	globalArgs.pointer_chase = 0;
+}
+
+static int _setup_sketch() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	return npt_sketch_init();
+}
+
+static void _teardown_sketch() {
+	npt_sketch_free();
+}
+
+/**
+ * The live statistics are published in one segment over the runs, its
+ * start printing its name
+ */
+static int shmRuns = 0;
+
+static int _setup_shm() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	globalArgs.shm = 1;
+	return (shmBuckets != NULL) ? EXIT_SUCCESS : npt_shm_start();
+}
+
+static void _teardown_shm() {
+	if (++shmRuns < BENCH_RUNS) return;
+	npt_shm_stop();
+	globalArgs.shm = 0;
+}
+
+/**
+ * The no-op function of the plugin of the engine checks, built next to
+ * the benchmark: only its calls are timed
+ */
+static void *pluginContext = NULL;
+
+static int _setup_plugin() {
+	globalArgs.loops = BENCH_LOOPS;
+	globalArgs.duration = 0;
+	globalArgs.workload = "./test_plugin.so:npt_test_workload";
+	if (npt_workload_init() != EXIT_SUCCESS) return EXIT_FAILURE;
+	pluginContext = workloadContext;
+	return EXIT_SUCCESS;
+}
+
+static void _teardown_plugin() {
+	// The context of the test plugin outlives its teardown
+	npt_workload_free();
+	free(pluginContext);
+	pluginContext = NULL;
+	globalArgs.workload = NULL;
+}
+
+static struct bench_variant variants[] = {
+	{ "loops",	_setup_loops,		NULL,		0.0, 0.0 },
+	{ "duration",	_setup_duration,	NULL,		0.0, 0.0 },
+	{ "soak",	_setup_soak,		_teardown_soak,	0.0, 0.0 },
+	{ "raw-dump",	_setup_raw_dump,	_teardown_raw_dump,	0.0, 0.0 },
+	{ "chase-16k",	_setup_chase,		_teardown_chase,	0.0, 0.0 },
+	{ "sketch",	_setup_sketch,		_teardown_sketch,	0.0, 0.0 },
+	{ "shm",	_setup_shm,		_teardown_shm,	0.0, 0.0 },
+	{ "plugin",	_setup_plugin,		_teardown_plugin,	0.0, 0.0 },
+	{ NULL, NULL, NULL, 0.0, 0.0 }
+};
+
+/**
+ * Read the baseline of a variant, returns 0 if there is none
+ */
+static double _baseline(const char *filename, const char *name) {
+	char variant[64];
+	double cycles, ret = 0.0;
+	FILE *fd = fopen(filename, "r");
+
+	if (fd == NULL) return 0.0;
+	while (fscanf(fd, "%63s %lf", variant, &cycles) == 2)
+		if (strcmp(variant, name) == 0) ret = cycles;
+	fclose(fd);
+
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	struct bench_variant *v;
+	cpu_set_t cpuMask;
+	bool update = false, missing = false;
+	double tolerance = BENCH_TOLERANCE;
+	const char *filename;
+	int c, run, ret = EXIT_SUCCESS;
+	FILE *fd;
+
+	while ((c = getopt(argc, argv, "u")) != -1) {
+		if (c == 'u') update = true;
+		else return 2;
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-u] BASELINE\n", argv[0]);
+		return 2;
+	}
+	filename = argv[optind];
+	if (getenv("NPT_BENCH_TOLERANCE") != NULL)
+		tolerance = atof(getenv("NPT_BENCH_TOLERANCE"));
+
+	// Stay on the current CPU to avoid migrations
+	memset(&globalArgs, 0, sizeof(globalArgs));
+	globalArgs.affinity = sched_getcpu();
+	CPU_ZERO(&cpuMask);
+	CPU_SET(globalArgs.affinity, &cpuMask);
+	sched_setaffinity(0, sizeof(cpuMask), &cpuMask);
+	if (npt_histogram_init() != EXIT_SUCCESS) return 2;
+
+	// One unit is one tick so that the loop cost is read directly
+	globalArgs.cpuHz = npt_tsc_calibrate();
+	multi = (double)globalArgs.cpuHz;
+	globalArgs.cpuPeriod = 1.0;
+
+	printf("%-12s %12s %12s %10s\n", "variant", "cycles/loop", "baseline", "change");
+	for (v = variants; v->name != NULL; v++) {
+		// Keep the best run, the others were disturbed
+		for (run = 0; run < BENCH_RUNS; run++) {
+			reset_statistics();
+			if (v->setup() != EXIT_SUCCESS) return 2;
+			cycle();
+			if (v->teardown != NULL) v->teardown();
+
+			double cycles = (double)sumTicks / (double)counter;
+			if (run == 0 || cycles < v->cycles) v->cycles = cycles;
+		}
+
+		v->baseline = _baseline(filename, v->name);
+		if (v->baseline > 0.0) {
+			double change = (v->cycles - v->baseline) / v->baseline * 100.0;
+			printf("%-12s %12.3f %12.3f %+9.1f%%%s\n", v->name, v->cycles,
+					v->baseline, change, (change > tolerance) ? "  REGRESSION" : "");
+			if (change > tolerance && !update) ret = EXIT_FAILURE;
+		} else {
+			printf("%-12s %12.3f %12s %10s\n", v->name, v->cycles, "-", "-");
+			missing = true;
+		}
+	}
+
+	// Record all the variants with -u, else only the missing ones, the
+	// others keeping their baseline
+	if (update || missing) {
+		fd = fopen(filename, "w");
+		if (fd == NULL) {
+			fprintf(stderr, "Error: unable to write '%s', %s (%d)\n",
+					filename, strerror(errno), errno);
+			return 2;
+		}
+		for (v = variants; v->name != NULL; v++)
+			fprintf(fd, "%s %.3f\n", v->name,
+					(update || v->baseline <= 0.0) ? v->cycles : v->baseline);
+		fclose(fd);
+		printf("Baseline written to %s\n", filename);
+	}
+
+	return ret;
+}
@@ -0,0 +1,87 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <stdint.h>	// uint64_t
+#include <string.h>	// memset
+
+#include "synthetic.h"
+
+/** The current source and its state */
+static struct npt_synthetic synthetic;
+static uint64_t syntheticNow;
+static uint64_t syntheticIndex;
+static uint64_t syntheticRandom;
+
+/**
+ * xorshift64* pseudo-random generator, which gives the same sequence
+ * on every host for a given seed
+ */
+static uint64_t _xorshift64star() {
+	syntheticRandom ^= syntheticRandom >> 12;
+	syntheticRandom ^= syntheticRandom << 25;
+	syntheticRandom ^= syntheticRandom >> 27;
+	return syntheticRandom * 2685821657736338717ULL;
+}
+
+void npt_synthetic_set(const struct npt_synthetic *source) {
+	synthetic = *source;
+	npt_synthetic_reset();
+}
+
+void npt_synthetic_reset() {
+	syntheticNow = synthetic.start;
+	syntheticIndex = 0;
+	syntheticRandom = (synthetic.seed != 0) ? synthetic.seed : 88172645463325252ULL;
+}
+
+uint64_t npt_synthetic_next_delta() {
+	uint64_t delta;
+
+	switch (synthetic.distribution) {
+		case NPT_SYNTHETIC_PATTERN:
+			delta = synthetic.pattern[syntheticIndex % synthetic.patternSize];
+			break;
+		case NPT_SYNTHETIC_UNIFORM:
+			delta = synthetic.base + ((synthetic.spread > 0) ?
+				_xorshift64star() % synthetic.spread : 0);
+			break;
+		case NPT_SYNTHETIC_SPIKES:
+			delta = synthetic.base;
+			if (synthetic.every > 0 && (syntheticIndex+1) % synthetic.every == 0)
+				delta += synthetic.spread;
+			break;
+		case NPT_SYNTHETIC_CONSTANT:
+		default:
+			delta = synthetic.base;
+			break;
+	}
+	syntheticIndex++;
+
+	return delta;
+}
+
+/**
+ * The timestamp source used by the loop when built with
+ * NPT_SYNTHETIC_TIMESTAMP
+ */
+uint64_t npt_synthetic_timestamp() {
+	syntheticNow += npt_synthetic_next_delta();
+	return syntheticNow;
+}
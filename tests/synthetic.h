@@ -0,0 +1,64 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NPT_TESTS_SYNTHETIC_H
+#define NPT_TESTS_SYNTHETIC_H
+
+#include <stddef.h>	// size_t
+#include <stdint.h>	// uint64_t
+
+/**
+ * Distributions of the loop durations generated by the synthetic
+ * timestamp source
+ */
+#define NPT_SYNTHETIC_CONSTANT	0	/* always base */
+#define NPT_SYNTHETIC_PATTERN	1	/* cycle through pattern[] */
+#define NPT_SYNTHETIC_UNIFORM	2	/* uniform in [base, base+spread[ */
+#define NPT_SYNTHETIC_SPIKES	3	/* base, and base+spread every loops */
+
+/**
+ * Description of a synthetic timestamp source
+ */
+struct npt_synthetic {
+	int distribution;
+	uint64_t start;		/* first timestamp */
+	uint64_t base;
+	uint64_t spread;
+	uint64_t every;
+	const uint64_t *pattern;
+	size_t patternSize;
+	uint64_t seed;
+};
+
+/**
+ * Select the source used by npt_synthetic_timestamp(), and restart it
+ */
+void npt_synthetic_set(const struct npt_synthetic *source);
+
+/**
+ * Restart the current source from its first timestamp
+ */
+void npt_synthetic_reset();
+
+/**
+ * Return the next difference between two timestamps, as the loop
+ * will see it: used to compute the expected results
+ */
+uint64_t npt_synthetic_next_delta();
+
+#endif /* NPT_TESTS_SYNTHETIC_H */
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Check the verdicts of npt-diff on histograms with known differences
+#
+
+NPT_DIFF=${NPT_DIFF:-../npt-diff}
+dir=$(mktemp -d /tmp/npt-diff-XXXXXX) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+# Write an output file of npt with a geometric tail starting at $1 us
+histogram() {
+	awk -v start="$1" -v overruns="${2:-0}" 'BEGIN {
+		print "# Data generated by NPT for 10000000 loops"
+		print "# The time values are expressed in us."
+		print "#	max:		1000.000000"
+		n = 8000000
+		for (i = start; n >= 1; i++) {
+			printf "	%d	%d\n", i, n
+			n = int(n / 4)
+		}
+		print "#	------------------"
+		printf "# Overruns (1000000+): %d\n", overruns
+	}'
+}
+
+check() {
+	expected=$1
+	shift
+	"$NPT_DIFF" -b 500 "$@" > "$dir/report" 2>&1
+	status=$?
+	if [ $status -ne $expected ]; then
+		echo "FAIL: npt-diff $* returned $status instead of $expected"
+		cat "$dir/report"
+		failures=$((failures + 1))
+	fi
+}
+
+histogram 3 > "$dir/base.txt"
+histogram 3 > "$dir/same.txt"
+histogram 6 > "$dir/slower.txt"
+histogram 3 100000 > "$dir/overruns.txt"
+
+check 0 "$dir/base.txt" "$dir/same.txt"
+check 1 "$dir/base.txt" "$dir/slower.txt"
+check 1 "$dir/base.txt" "$dir/same.txt" "$dir/overruns.txt"
+check 0 -t 10000000 "$dir/base.txt" "$dir/slower.txt"
+check 2 "$dir/base.txt" "$dir/missing.txt"
+check 2 "$dir/base.txt"
+
+[ $failures -eq 0 ] && echo "All npt-diff checks passed"
+exit $failures
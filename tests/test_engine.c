@@ -0,0 +1,1339 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+
+#include <errno.h>	// errno, ENOMEM
+#include <fcntl.h>	// O_RDONLY
+#include <getopt.h>	// getopt_long
+#include <inttypes.h>	// PRIu64
+#include <math.h>	// fabs
+#include <pthread.h>	// pthread_t, pthread_getaffinity_np
+#include <stdbool.h>	// bool, true, false
+#include <stddef.h>	// offsetof
+#include <stdint.h>	// uint64_t, UINT64_MAX
+#include <stdio.h>
+#include <stdlib.h>	// mkdtemp, system
+#include <string.h>	// memcpy, strcmp
+#include <sys/mman.h>	// shm_open, mmap, mincore
+#include <unistd.h>	// close, unlink, sysconf
+
+#include <npt/npt.h>
+#include <npt/chase.h>
+#include <npt/converge.h>
+#include <npt/housekeeping.h>
+#include <npt/inject.h>
+#include <npt/irqdiff.h>
+#include <npt/load.h>
+#include <npt/metrics.h>
+#include <npt/msr.h>
+#include <npt/numa.h>
+#include <npt/replay.h>
+#include <npt/scenario.h>
+#include <npt/sched.h>
+#include <npt/schedtrace.h>
+#include <npt/shm.h>
+#include <npt/signals.h>
+#include <npt/soak.h>
+#include <npt/spikes.h>
+#include <npt/stolen.h>
+#include <npt/tsc.h>
+#include <npt/wait.h>
+#include <npt/workload.h>
+
+#include "synthetic.h"
+
+/** The options, normally defined by npt.c */
+struct globalArgs_t globalArgs;
+
+/** Number of failed checks */
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+			failures++; \
+		} \
+	} while (0)
+
+/** The expected histogram */
+static uint64_t expected[NPT_HISTOGRAM_SIZE];
+
+/**
+ * Set options so that one tick is one microsecond
+ */
+static void _setup(uint64_t loops, uint64_t duration) {
+	memset(&globalArgs, 0, sizeof(globalArgs));
+	globalArgs.loops = loops;
+	globalArgs.duration = duration;
+	globalArgs.nocountloop = NPT_NOCOUNTLOOP;
+	globalArgs.cpuHz = 1000000;
+	multi = 1.0e6;
+	globalArgs.cpuPeriod = multi / (double)globalArgs.cpuHz;
+	reset_statistics();
+}
+
+/**
+ * Replay the synthetic source and compare the results of the loop with
+ * the ones computed in the simplest possible way
+ */
+static void _check_results(const char *name) {
+	uint64_t i, delta, n = 0, sum = 0, overruns = 0;
+	uint64_t min = UINT64_MAX, max = 0;
+	long double mean, m2 = 0.0;
+
+	memset(expected, 0, sizeof(expected));
+	npt_synthetic_reset();
+
+	// The first loops are not counted
+	for (i = 0; i < NPT_NOCOUNTLOOP; i++)
+		npt_synthetic_next_delta();
+
+	while ((globalArgs.duration > 0) ? (sum < globalArgs.duration) : (n < globalArgs.loops)) {
+		delta = npt_synthetic_next_delta();
+		n++;
+		sum += delta;
+		if (delta < min) min = delta;
+		if (delta > max) max = delta;
+		if (delta < NPT_HISTOGRAM_SIZE) expected[delta]++;
+		else overruns++;
+	}
+
+	mean = (long double)sum / (long double)n;
+	npt_synthetic_reset();
+	for (i = 0; i < NPT_NOCOUNTLOOP; i++)
+		npt_synthetic_next_delta();
+	for (i = 0; i < n; i++) {
+		long double d = (long double)npt_synthetic_next_delta() - mean;
+		m2 += d * d;
+	}
+
+	CHECK(counter == n, "%s: %" PRIu64 " loops instead of %" PRIu64, name, counter, n);
+	CHECK(sumTicks == sum, "%s: sum of %" PRIu64 " ticks instead of %" PRIu64, name, sumTicks, sum);
+	CHECK(minDuration == (double)min, "%s: min %f instead of %" PRIu64, name, minDuration, min);
+	CHECK(maxDuration == (double)max, "%s: max %f instead of %" PRIu64, name, maxDuration, max);
+	CHECK(fabs(meanDuration - (double)mean) <= 1e-9 * (double)mean,
+			"%s: mean %.12f instead of %.12Lf", name, meanDuration, mean);
+	CHECK(fabs(variance_n - (double)(m2 / n)) <= 1e-6 * (double)(m2 / n) + 1e-12,
+			"%s: variance %.12f instead of %.12Lf", name, variance_n, m2 / n);
+	CHECK(histogramOverruns == overruns, "%s: %" PRIu64 " overruns instead of %" PRIu64,
+			name, histogramOverruns, overruns);
+	for (i = 0; i < NPT_HISTOGRAM_SIZE; i++) {
+		if (histogram[i] != expected[i]) {
+			CHECK(false, "%s: %" PRIu64 " loops of %" PRIu64 " us instead of %" PRIu64,
+					name, histogram[i], i, expected[i]);
+			break;
+		}
+	}
+}
+
+/**
+ * Run the loop on a synthetic source and check its results
+ */
+static void _run(const char *name, struct npt_synthetic *source,
+		uint64_t loops, uint64_t duration) {
+	_setup(loops, duration);
+	npt_synthetic_set(source);
+	cycle();
+	_check_results(name);
+}
+
+static void test_constant() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_CONSTANT,
+		.start = 1000,
+		.base = 7,
+	};
+	_run("constant", &source, 100000, 0);
+	CHECK(variance_n == 0.0, "constant: variance %f instead of 0", variance_n);
+}
+
+static void test_pattern() {
+	static const uint64_t pattern[] = { 10, 10, 10, 50, 3, 999999, 1000000, 2500000 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	_run("pattern", &source, 80000, 0);
+	CHECK(histogramOverruns == 20000, "pattern: %" PRIu64 " overruns instead of 20000",
+			histogramOverruns);
+}
+
+static void test_uniform() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = 42,
+		.base = 1,
+		.spread = 5000,
+		.seed = 1234,
+	};
+	_run("uniform", &source, 1000000, 0);
+}
+
+static void test_duration() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_SPIKES,
+		.start = 0,
+		.base = 3,
+		.spread = 1000,
+		.every = 100,
+	};
+	_run("duration", &source, 0, 600ULL * 1000000ULL);
+	CHECK(sumTicks >= 600ULL * 1000000ULL && sumTicks < 600ULL * 1000000ULL + 1003,
+			"duration: sum of %" PRIu64 " ticks", sumTicks);
+}
+
+static void test_wrap() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = UINT64_MAX - 100000,
+		.base = 1,
+		.spread = 20,
+		.seed = 99,
+	};
+	_run("wrap", &source, 50000, 0);
+}
+
+/**
+ * Run in soak mode with checkpoints, and check that resuming from the
+ * checkpoints gives back exactly the same statistics
+ */
+static void test_soak_resume() {
+	char dir[] = "/tmp/npt-test-XXXXXX";
+	char *cmd;
+	uint64_t savedCounter, savedSumTicks, savedOverruns;
+	double savedMin, savedMax, savedMean;
+	uint64_t *saved;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = 0,
+		.base = 1,
+		.spread = 300,
+		.seed = 7,
+	};
+
+	if (mkdtemp(dir) == NULL) {
+		CHECK(false, "soak: unable to create a temporary directory");
+		return;
+	}
+
+	_setup(0, 10ULL * 1000000ULL);
+	globalArgs.soak_period = 1;
+	globalArgs.checkpoint = dir;
+	npt_synthetic_set(&source);
+	CHECK(npt_soak_init() == EXIT_SUCCESS, "soak: unable to start");
+	cycle();
+	npt_soak_stop();
+	_check_results("soak");
+
+	saved = malloc(sizeof(uint64_t) * NPT_HISTOGRAM_SIZE);
+	memcpy(saved, histogram, sizeof(uint64_t) * NPT_HISTOGRAM_SIZE);
+	savedCounter = counter;
+	savedSumTicks = sumTicks;
+	savedOverruns = histogramOverruns;
+	savedMin = minDuration;
+	savedMax = maxDuration;
+	savedMean = meanDuration;
+
+	reset_statistics();
+	globalArgs.resume = true;
+	CHECK(npt_soak_init() == EXIT_SUCCESS, "soak: unable to resume");
+	npt_soak_stop();
+
+	CHECK(counter == savedCounter, "soak: resumed %" PRIu64 " loops instead of %" PRIu64,
+			counter, savedCounter);
+	CHECK(sumTicks == savedSumTicks, "soak: resumed %" PRIu64 " ticks instead of %" PRIu64,
+			sumTicks, savedSumTicks);
+	CHECK(histogramOverruns == savedOverruns, "soak: resumed overruns differ");
+	CHECK(minDuration == savedMin && maxDuration == savedMax && meanDuration == savedMean,
+			"soak: resumed min/max/mean differ");
+	CHECK(memcmp(saved, histogram, sizeof(uint64_t) * NPT_HISTOGRAM_SIZE) == 0,
+			"soak: resumed histogram differs");
+	free(saved);
+
+	if (asprintf(&cmd, "rm -rf '%s'", dir) > 0) {
+		if (system(cmd) != 0) fprintf(stderr, "unable to remove %s\n", dir);
+		free(cmd);
+	}
+}
+
+/**
+ * Record a raw dump of the loop, replay it through the batch
+ * accounting and check that the results are the same
+ */
+static void test_replay() {
+	char filename[] = "/tmp/npt-test-XXXXXX";
+	uint64_t savedCounter, savedSumTicks, savedOverruns;
+	double savedMin, savedMax, savedMean, savedVariance;
+	uint64_t *saved;
+	int fd;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = 5,
+		.base = 1,
+		.spread = 1500000,
+		.seed = 2013,
+	};
+
+	fd = mkstemp(filename);
+	if (fd < 0) {
+		CHECK(false, "replay: unable to create a temporary file");
+		return;
+	}
+	close(fd);
+
+	_setup(100000, 0);
+	globalArgs.raw_dump = filename;
+	npt_synthetic_set(&source);
+	CHECK(npt_raw_dump_init() == EXIT_SUCCESS, "replay: unable to prepare the raw dump");
+	cycle();
+	CHECK(npt_raw_dump_write() == EXIT_SUCCESS, "replay: unable to write the raw dump");
+
+	saved = malloc(sizeof(uint64_t) * NPT_HISTOGRAM_SIZE);
+	memcpy(saved, histogram, sizeof(uint64_t) * NPT_HISTOGRAM_SIZE);
+	savedCounter = counter;
+	savedSumTicks = sumTicks;
+	savedOverruns = histogramOverruns;
+	savedMin = minDuration;
+	savedMax = maxDuration;
+	savedMean = meanDuration;
+	savedVariance = variance_n;
+
+	_setup(0, 0);
+	CHECK(npt_replay(filename) == EXIT_SUCCESS, "replay: unable to replay");
+	CHECK(counter == savedCounter, "replay: %" PRIu64 " loops instead of %" PRIu64,
+			counter, savedCounter);
+	CHECK(sumTicks == savedSumTicks, "replay: %" PRIu64 " ticks instead of %" PRIu64,
+			sumTicks, savedSumTicks);
+	CHECK(histogramOverruns == savedOverruns, "replay: overruns differ");
+	CHECK(minDuration == savedMin && maxDuration == savedMax, "replay: min/max differ");
+	CHECK(fabs(meanDuration - savedMean) <= 1e-9 * savedMean,
+			"replay: mean %.12f instead of %.12f", meanDuration, savedMean);
+	CHECK(fabs(variance_n - savedVariance) <= 1e-9 * savedVariance,
+			"replay: variance %.12f instead of %.12f", variance_n, savedVariance);
+	CHECK(memcmp(saved, histogram, sizeof(uint64_t) * NPT_HISTOGRAM_SIZE) == 0,
+			"replay: histogram differs");
+
+	free(saved);
+	unlink(filename);
+}
+
+/**
+ * Spikes of a known period must be found by the periodicity analysis
+ */
+static void test_periodicity() {
+	char *report = NULL, *line;
+	size_t size = 0;
+	double period = 0.0;
+	FILE *fd;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_SPIKES,
+		.start = 0,
+		.base = 10,
+		.spread = 500,
+		.every = 100,
+	};
+
+	_setup(1000000, 0);
+	globalArgs.threshold = 100;
+	globalArgs.spike_bin = 10;
+	globalArgs.max_spikes = NPT_DEFAULT_MAX_SPIKES;
+	npt_synthetic_set(&source);
+	CHECK(npt_spikes_init() == EXIT_SUCCESS, "periodicity: unable to prepare the spikes");
+	cycle();
+	CHECK(spikesCount == 10000, "periodicity: %" PRIu64 " spikes instead of 10000", spikesCount);
+
+	fd = open_memstream(&report, &size);
+	npt_periodicity_print(fd, "");
+	fclose(fd);
+
+	// The first period is the strongest one
+	line = strstr(report, "phase");
+	if (line != NULL) line = strchr(line, '\n');
+	if (line == NULL || sscanf(line, "%lf", &period) != 1)
+		CHECK(false, "periodicity: no period found in:\n%s", report);
+	else
+		CHECK(fabs(period - 1500.0) < 1.0, "periodicity: period of %f instead of 1500", period);
+
+	free(report);
+	npt_spikes_free();
+}
+
+/**
+ * Check the buckets, the quantiles and the counters exported in the
+ * OpenMetrics format
+ */
+static void test_metrics() {
+	static const uint64_t pattern[] = { 10, 10, 10, 50, 3, 999999, 1000000, 2500000 };
+	char *text = NULL;
+	size_t size = 0;
+	FILE *fd;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+
+	_run("metrics", &source, 80000, 0);
+
+	fd = open_memstream(&text, &size);
+	npt_metrics_render(fd);
+	fclose(fd);
+
+	CHECK(strstr(text, "npt_loop_duration_seconds_bucket{cpu=\"0\",le=\"1e-05\"} 10000\n") != NULL,
+			"metrics: wrong 10us bucket in:\n%s", text);
+	CHECK(strstr(text, "npt_loop_duration_seconds_bucket{cpu=\"0\",le=\"5e-05\"} 40000\n") != NULL,
+			"metrics: wrong 50us bucket in:\n%s", text);
+	CHECK(strstr(text, "npt_loop_duration_seconds_bucket{cpu=\"0\",le=\"+Inf\"} 80000\n") != NULL,
+			"metrics: wrong +Inf bucket in:\n%s", text);
+	CHECK(strstr(text, "npt_loop_duration_quantile_seconds{cpu=\"0\",quantile=\"0.5\"} 1e-05\n") != NULL,
+			"metrics: wrong median in:\n%s", text);
+	CHECK(strstr(text, "npt_histogram_overruns_total{cpu=\"0\"} 20000\n") != NULL,
+			"metrics: wrong overruns in:\n%s", text);
+	CHECK(size > 6 && strcmp(text + size - 6, "# EOF\n") == 0,
+			"metrics: missing end marker");
+
+	free(text);
+}
+
+/**
+ * A snapshot request does not disturb the run, a stop request ends it
+ * at the next counted loop
+ */
+static void test_signals() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_CONSTANT,
+		.start = 0,
+		.base = 7,
+	};
+
+	signalPending = NPT_SIGNAL_SNAPSHOT;
+	_run("snapshot", &source, 10000, 0);
+	CHECK(signalPending == 0, "snapshot: request not handled");
+
+	_setup(10000, 0);
+	npt_synthetic_set(&source);
+	signalPending = NPT_SIGNAL_STOP;
+	cycle();
+	CHECK(counter == 1, "stop: %" PRIu64 " loops instead of 1", counter);
+	CHECK(signalPending == 0, "stop: request not handled");
+}
+
+/** Stop request of the housekeeping thread of the checks */
+static int housekeepingStopping;
+
+static void *_housekeeping_thread(void *arg) {
+	(void)arg;
+	while (!__atomic_load_n(&housekeepingStopping, __ATOMIC_ACQUIRE))
+		npt_housekeeping_sleep(1);
+	return NULL;
+}
+
+/**
+ * The housekeeping threads follow the measured CPU when it changes, and
+ * are forgotten once joined
+ */
+static void test_housekeeping() {
+	long nbcpus = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int measured;
+	pthread_t thread;
+	cpu_set_t mask;
+	int i;
+
+	for (measured = 0; measured < 2 && measured < nbcpus; measured++) {
+		globalArgs.affinity = 0;
+		housekeepingStopping = 0;
+		CHECK(npt_housekeeping_start(&thread, "npt-check", _housekeeping_thread, NULL)
+				== EXIT_SUCCESS, "housekeeping: thread not started");
+
+		globalArgs.affinity = measured;
+		npt_housekeeping_repin();
+		CHECK(pthread_getaffinity_np(thread, sizeof(mask), &mask) == 0
+				&& (nbcpus == 1 || !CPU_ISSET(measured, &mask)),
+				"housekeeping: thread left on the measured CPU %u", measured);
+
+		__atomic_store_n(&housekeepingStopping, 1, __ATOMIC_RELEASE);
+		npt_housekeeping_join(thread);
+	}
+
+	// Joined threads release their slot
+	for (i = 0; i < 64; i++) {
+		housekeepingStopping = 1;
+		CHECK(npt_housekeeping_start(&thread, "npt-check", _housekeeping_thread, NULL)
+				== EXIT_SUCCESS, "housekeeping: thread %d not started", i);
+		npt_housekeeping_join(thread);
+	}
+	npt_housekeeping_repin();
+	globalArgs.affinity = 0;
+}
+
+/**
+ * Parse the CPU lists of sysfs
+ */
+static void test_cpu_list() {
+	cpu_set_t set;
+
+	CHECK(npt_parse_cpu_list("0-3,8,10-11\n", &set) == EXIT_SUCCESS
+			&& CPU_COUNT(&set) == 7 && CPU_ISSET(3, &set) && CPU_ISSET(8, &set)
+			&& !CPU_ISSET(9, &set) && CPU_ISSET(11, &set),
+			"cpu list: wrong parsing of 0-3,8,10-11");
+	CHECK(npt_parse_cpu_list("5", &set) == EXIT_SUCCESS && CPU_COUNT(&set) == 1
+			&& CPU_ISSET(5, &set), "cpu list: wrong parsing of 5");
+	CHECK(npt_parse_cpu_list("3-1", &set) != EXIT_SUCCESS, "cpu list: 3-1 accepted");
+	CHECK(npt_parse_cpu_list("1;2", &set) != EXIT_SUCCESS, "cpu list: 1;2 accepted");
+}
+
+/**
+ * Parse the stressor profiles into one run each, on the CPUs given but
+ * the measured one
+ */
+static void test_stress_profiles() {
+	_setup(1000, 0);
+	globalArgs.affinity = 0;
+	globalArgs.stress_cpus = "0-2";
+
+	globalArgs.stress = "int,timer";
+	CHECK(npt_load_init() == EXIT_SUCCESS && npt_load_runs() == 2
+			&& strcmp(npt_load_name(0), "int") == 0 && strcmp(npt_load_name(1), "timer") == 0,
+			"stress: wrong runs for int,timer");
+	globalArgs.stress = "all";
+	CHECK(npt_load_init() == EXIT_SUCCESS && npt_load_runs() == 8
+			&& strcmp(npt_load_name(0), "idle") == 0, "stress: wrong runs for all");
+	globalArgs.stress = "int,bogus";
+	CHECK(npt_load_init() != EXIT_SUCCESS, "stress: unknown profile accepted");
+	globalArgs.stress = "int";
+	globalArgs.stress_cpus = "0";
+	CHECK(npt_load_init() != EXIT_SUCCESS, "stress: no CPU left for the stressors accepted");
+	globalArgs.stress_cpus = "1-";
+	CHECK(npt_load_init() != EXIT_SUCCESS, "stress: invalid CPU list accepted");
+
+	globalArgs.stress = NULL;
+	globalArgs.stress_cpus = NULL;
+	npt_load_init();
+}
+
+/**
+ * Parse the policies, priorities and CPUs of the sweep mode into one run
+ * per combination
+ */
+static void test_sweep() {
+	_setup(1000, 0);
+	globalArgs.affinity = 0;
+	globalArgs.priority = 80;
+
+	CHECK(npt_sched_parse_policy("fifo") == SCHED_FIFO
+			&& npt_sched_parse_policy("deadline") == SCHED_DEADLINE
+			&& npt_sched_parse_policy("other") == SCHED_OTHER,
+			"sweep: wrong policies");
+	CHECK(npt_sched_parse_policy("FIFO") < 0 && npt_sched_parse_policy("batch") < 0,
+			"sweep: unknown policy accepted");
+
+	globalArgs.sweep = "rr,other";
+	CHECK(npt_sched_init() == EXIT_SUCCESS && npt_sched_runs() == 2
+			&& strcmp(npt_sched_name(0), "rr-80-cpu0") == 0
+			&& strcmp(npt_sched_name(1), "other-cpu0") == 0,
+			"sweep: wrong runs for rr,other");
+
+	globalArgs.sweep = "fifo,other";
+	globalArgs.sweep_prios = "50,99";
+	globalArgs.sweep_cpus = "0-1";
+	CHECK(npt_sched_init() == EXIT_SUCCESS && npt_sched_runs() == 6
+			&& strcmp(npt_sched_name(1), "fifo-99-cpu0") == 0
+			&& strcmp(npt_sched_name(2), "other-cpu0") == 0
+			&& strcmp(npt_sched_name(3), "fifo-50-cpu1") == 0,
+			"sweep: wrong runs for fifo,other on 0-1");
+
+	globalArgs.sweep_prios = "50,100";
+	CHECK(npt_sched_init() != EXIT_SUCCESS, "sweep: priority 100 accepted");
+	globalArgs.sweep_prios = "50x";
+	CHECK(npt_sched_init() != EXIT_SUCCESS, "sweep: priority 50x accepted");
+	globalArgs.sweep_prios = NULL;
+	globalArgs.sweep_cpus = "1-0";
+	CHECK(npt_sched_init() != EXIT_SUCCESS, "sweep: CPU list 1-0 accepted");
+	globalArgs.sweep_cpus = NULL;
+	globalArgs.sweep = "fifo,batch";
+	CHECK(npt_sched_init() != EXIT_SUCCESS, "sweep: unknown policy accepted");
+
+	globalArgs.sweep = NULL;
+	CHECK(npt_sched_init() == EXIT_SUCCESS && npt_sched_runs() == 0,
+			"sweep: runs left without --sweep");
+	globalArgs.priority = 0;
+}
+
+/**
+ * The pointer chain goes through every line of the working set before
+ * coming back, and does not change the results of the loop
+ */
+static void test_chase() {
+	struct npt_chase_line *start, *p;
+	uint64_t n = 0;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = 0,
+		.base = 1,
+		.spread = 100,
+		.seed = 7,
+	};
+
+	_setup(100000, 0);
+	globalArgs.pointer_chase = 1 << 20;
+	globalArgs.chase_hops = 3;
+	CHECK(npt_chase_init() == EXIT_SUCCESS, "chase: unable to build the chain");
+
+	start = chaseCursor;
+	p = start;
+	do {
+		p = p->next;
+		n++;
+	} while (p != start && n <= (1 << 20) / NPT_CHASE_LINE);
+	CHECK(n == (1 << 20) / NPT_CHASE_LINE, "chase: cycle of %" PRIu64 " lines instead of %d",
+			n, (1 << 20) / NPT_CHASE_LINE);
+
+	npt_synthetic_set(&source);
+	cycle();
+	_check_results("chase");
+	CHECK(chaseCursor != start, "chase: the chain was not walked");
+
+	npt_chase_free();
+}
+
+/**
+ * The plugin function is called once per loop, and only its calls are
+ * timed: each one lasts exactly one synthetic step, and each loop two,
+ * which are the elapsed ticks
+ */
+static void test_plugin() {
+	struct { int init, warmup, teardown; unsigned long calls; } *state;
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_CONSTANT,
+		.start = 0,
+		.base = 5,
+	};
+
+	_setup(10000, 0);
+	globalArgs.workload = "./test_plugin.so:npt_test_workload";
+	if (npt_workload_init() != EXIT_SUCCESS) {
+		CHECK(false, "plugin: unable to load the test plugin");
+		return;
+	}
+	state = workloadContext;
+	CHECK(state->init == 1, "plugin: init hook called %d times", state->init);
+
+	npt_synthetic_set(&source);
+	cycle();
+	CHECK(state->warmup == 1, "plugin: warmup hook called %d times", state->warmup);
+	CHECK(state->calls == 10000 + NPT_NOCOUNTLOOP, "plugin: %lu calls instead of %d",
+			state->calls, 10000 + NPT_NOCOUNTLOOP);
+	CHECK(counter == 10000 && histogram[5] == 10000 && maxDuration == 5.0,
+			"plugin: the calls were not timed alone");
+	CHECK(sumTicks == 50000 && wallTicks == 100000 && npt_elapsed_ticks() == 100000,
+			"plugin: %" PRIu64 " ticks timed, %" PRIu64 " elapsed instead of 50000 and 100000",
+			sumTicks, wallTicks);
+
+	npt_workload_free();
+	CHECK(state->teardown == 1, "plugin: teardown hook called %d times", state->teardown);
+	CHECK(workloadFunction == NULL, "plugin: not unloaded");
+	free(state);
+}
+
+/**
+ * The local buffers are zeroed, and reported with the node of their pages
+ */
+static void test_numa() {
+	void *buffers[NPT_NUMA_MAX_BUFFERS + 8];
+	size_t page = sysconf(_SC_PAGESIZE);
+	unsigned char pages[4];
+	uint64_t *buffer;
+	char *report = NULL, name[32];
+	size_t size = 0, i;
+	bool zeroed = true;
+	FILE *fd;
+
+	npt_numa_start();
+	buffer = npt_alloc_local(1 << 20, "test buffer");
+	CHECK(buffer != NULL, "numa: allocation failed");
+	if (buffer == NULL) return;
+	for (i = 0; i < (1 << 20) / sizeof(uint64_t); i++)
+		if (buffer[i] != 0) zeroed = false;
+	CHECK(zeroed, "numa: buffer not zeroed");
+	npt_free_local(buffer);
+	npt_numa_stop();
+
+	fd = open_memstream(&report, &size);
+	npt_numa_print(fd, "#");
+	fclose(fd);
+	CHECK(strstr(report, "#	test buffer") != NULL && strstr(report, "histogram") != NULL,
+			"numa: buffers missing in:\n%s", report);
+	CHECK(strstr(report, "node ") != NULL || strstr(report, "unknown") != NULL,
+			"numa: placement missing in:\n%s", report);
+	free(report);
+
+	// A buffer moved to the node of another CPU keeps its content
+	buffer = npt_alloc_local(1 << 20, "test moved buffer");
+	CHECK(buffer != NULL, "numa: allocation failed");
+	if (buffer != NULL) {
+		for (i = 0; i < (1 << 20) / sizeof(uint64_t); i++) buffer[i] = i;
+		npt_move_local(buffer);
+		for (i = 0; i < (1 << 20) / sizeof(uint64_t) && buffer[i] == i; i++);
+		CHECK(i == (1 << 20) / sizeof(uint64_t), "numa: moved buffer changed at %zu", i);
+		npt_free_local(buffer);
+	}
+
+	// The buffers beyond the report are unmapped too
+	for (i = 0; i < NPT_NUMA_MAX_BUFFERS + 8; i++) {
+		snprintf(name, sizeof(name), "test buffer %zu", i);
+		buffers[i] = npt_alloc_local(3 * page + 1, name);
+		CHECK(buffers[i] != NULL && ((uintptr_t)buffers[i] & (page - 1)) == 0,
+				"numa: allocation %zu failed or not aligned", i);
+	}
+	for (i = 0; i < NPT_NUMA_MAX_BUFFERS + 8; i++) {
+		if (buffers[i] == NULL) continue;
+		npt_free_local(buffers[i]);
+		CHECK(mincore(buffers[i], 4 * page, pages) != 0 && errno == ENOMEM,
+				"numa: buffer %zu still mapped after its free", i);
+	}
+}
+
+/**
+ * The adaptive warm-up ends once its windows settle, and the run once
+ * the confidence interval of the percentile is tight enough, which it is
+ * not when a bin of the histogram is already wider
+ */
+static void test_converge() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_UNIFORM,
+		.start = 0,
+		.base = 100,
+		.spread = 100,
+		.seed = 42,
+	};
+	uint64_t low = 0, value = 0, high = 0;
+	char *report = NULL;
+	size_t size = 0;
+	FILE *fd;
+
+	_setup(100000000, 0);
+	globalArgs.nocountloop = NPT_NOCOUNTLOOP_AUTO;
+	globalArgs.converge = 99;
+	globalArgs.converge_precision = 1;
+	npt_synthetic_set(&source);
+	CHECK(npt_converge_init() == EXIT_SUCCESS, "converge: unable to allocate the warm-up");
+	cycle();
+
+	CHECK(counter < globalArgs.loops, "converge: no early stop after %" PRIu64 " loops", counter);
+	CHECK(npt_converge_interval(99, &low, &value, &high) == EXIT_SUCCESS
+			&& value >= 197 && value <= 199 && (high - low) * 100 <= 2 * value,
+			"converge: p99 at %" PRIu64 " in [%" PRIu64 ", %" PRIu64 "]", value, low, high);
+
+	fd = open_memstream(&report, &size);
+	npt_converge_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "Warm-up:	40000 loops, settled") != NULL,
+			"converge: wrong warm-up in:\n%s", report);
+	CHECK(strstr(report, "reached within 1%") != NULL,
+			"converge: not reached in:\n%s", report);
+	free(report);
+	npt_converge_free();
+
+	// A bin of the histogram is 20% of a p99 of 5us: never within 1%
+	source.distribution = NPT_SYNTHETIC_CONSTANT;
+	source.base = 5;
+	_setup(30000000, 0);
+	globalArgs.converge = 99;
+	globalArgs.converge_precision = 1;
+	npt_synthetic_set(&source);
+	cycle();
+
+	CHECK(counter == globalArgs.loops, "converge: early stop below the resolution");
+	fd = open_memstream(&report, &size);
+	npt_converge_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "p99 at 5 us, 95% CI [5, 5], 1% below the resolution of the histogram"
+				" (see --nanoseconds)\n") != NULL,
+			"converge: resolution not reported in:\n%s", report);
+	free(report);
+}
+
+/**
+ * Check the stolen time and the bursts of slow loops, each 10 loops of
+ * the pattern having a burst of 2 slow loops of 40us over the baseline
+ */
+static void test_stolen() {
+	static const uint64_t pattern[] = { 10, 10, 10, 50, 50, 10, 10, 10, 10, 10 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	char *report = NULL;
+	size_t size = 0;
+	FILE *fd;
+
+	_setup(100000, 0);
+	globalArgs.stolen_interval = 1000;
+	npt_synthetic_set(&source);
+	cycle();
+
+	fd = open_memstream(&report, &size);
+	npt_stolen_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "total:		800000.000 us (44.4444% of the run) in 20000 slow loop(s)") != NULL,
+			"stolen: wrong total in:\n%s", report);
+	CHECK(strstr(report, "bursts:		10000, mean 2.0 loops / 80.000 us, max 2 loops / 80.000 us") != NULL,
+			"stolen: wrong bursts in:\n%s", report);
+	CHECK(strstr(report, "burst loops:	2-3: 10000 \n") != NULL,
+			"stolen: wrong burst lengths in:\n%s", report);
+	CHECK(strstr(report, "per interval:	mean 44.4") != NULL,
+			"stolen: wrong intervals in:\n%s", report);
+	free(report);
+}
+
+/**
+ * The drift of the TSC is measured from its calibrated frequency, not
+ * the nominal one, and the ticks of the drifting intervals are converted
+ * with the frequency measured in them
+ */
+static void test_tsc() {
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_CONSTANT,
+		.start = 0,
+		.base = 10,
+	};
+	struct npt_tsc_sample sample = { 0, 0, 0 };
+	char *report = NULL;
+	size_t size = 0;
+	FILE *fd;
+	int i;
+
+	_run("tsc", &source, 60000, 0);
+
+	// A steady TSC at 1 MHz over the 6 intervals of 10000 loops, 100 ppm
+	// faster in the fourth one, whose ticks are then converted to 0.9999
+	globalArgs.tsc_tolerance = NPT_DEFAULT_TSC_TOLERANCE;
+	tscHz = 1.0e6;
+	CHECK(npt_tsc_start() == EXIT_SUCCESS, "tsc: not started");
+	for (i = 0; i <= 6; i++) {
+		sample.loops = 1 + i * 10000;
+		sample.ticks = i * 100000ULL;
+		sample.ns += (i == 4) ? 99990000ULL : (i > 0) ? 100000000ULL : 0;
+		npt_tsc_record(&sample);
+	}
+	npt_tsc_stop();
+
+	CHECK(fabs(sumDuration - 599990.0) < 1e-6 && fabs(meanDuration - 599990.0 / 60000) < 1e-9
+			&& fabs(maxDuration - 599990.0 / 60000) < 1e-9,
+			"tsc: durations not rescaled, sum %f, mean %f, max %f",
+			sumDuration, meanDuration, maxDuration);
+	CHECK(npt_tsc_scale(150000) == 1.0 && fabs(npt_tsc_scale(350000) - 0.9999) < 1e-12
+			&& npt_tsc_scale(400000) != 1.0 && npt_tsc_scale(400001) == 1.0,
+			"tsc: spikes rescaled with the wrong intervals");
+
+	fd = open_memstream(&report, &size);
+	npt_tsc_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "calibrated 1.000 MHz (nominal 1.000 MHz)") != NULL
+			&& strstr(report, "over 6 interval(s)") != NULL
+			&& strstr(report, "max drift +100.0 ppm") != NULL,
+			"tsc: wrong frequencies in:\n%s", report);
+	CHECK(strstr(report, "TSC drift:	1 interval(s) beyond 50 ppm, durations and spikes rescaled"
+				" by 0.999983333 overall, the percentiles are not (error within 100.0 ppm)") != NULL,
+			"tsc: wrong drifts in:\n%s", report);
+	free(report);
+
+	npt_tsc_free();
+	tscHz = 0.0;
+}
+
+/**
+ * Fill a synthetic record of a tracepoint
+ */
+static void _trace(struct npt_schedtrace_record *r, int event, uint64_t time,
+		int32_t field0, int32_t field1, const char *name) {
+	memset(r, 0, sizeof(*r));
+	r->type = event + 1;
+	r->time = time;
+	r->fields[0] = field0;
+	r->fields[1] = field1;
+	if (event == NPT_TRACE_SWITCH) {
+		snprintf(r->comm, sizeof(r->comm), "%s", name);
+	} else if (event == NPT_TRACE_IRQ_ENTRY) {
+		snprintf(r->data, sizeof(r->data), "%s", name);
+		r->fields[1] = (sizeof(r->data) << 16) | offsetof(struct npt_schedtrace_record, data);
+	}
+}
+
+/**
+ * The slices taken from the loop by the tasks and the interrupts are
+ * matched with the spikes they overlap
+ */
+static void test_schedtrace() {
+	static const uint64_t pattern[] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 50 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	struct npt_schedtrace_record records[8];
+	uint64_t t0, t1;
+	char *report = NULL;
+	size_t size = 0;
+	FILE *fd;
+
+	_setup(100, 0);
+	globalArgs.threshold = 20;
+	globalArgs.max_spikes = NPT_DEFAULT_MAX_SPIKES;
+	globalArgs.sched_trace = true;
+	multi = 1.0e9;
+	CHECK(npt_spikes_init() == EXIT_SUCCESS, "schedtrace: unable to prepare the spikes");
+	npt_synthetic_set(&source);
+	cycle();
+	CHECK(spikesCount == 10, "schedtrace: %" PRIu64 " spikes instead of 10", spikesCount);
+	t0 = spikes[0].tsc;
+	t1 = spikes[1].tsc;
+
+	// A task runs in the first spike, two interrupts in the second one,
+	// and another interrupt right after it
+	_trace(&records[0], NPT_TRACE_SWITCH, t0 - 40, 1000, 2000, "kworker/0:1");
+	_trace(&records[1], NPT_TRACE_SWITCH, t0 - 20, 2000, 1000, "npt");
+	_trace(&records[2], NPT_TRACE_IRQ_ENTRY, t1 - 30, 24, 0, "eth0");
+	_trace(&records[3], NPT_TRACE_IRQ_EXIT, t1 - 25, 24, 0, NULL);
+	_trace(&records[4], NPT_TRACE_SOFTIRQ_ENTRY, t1 - 20, 1, 0, NULL);
+	_trace(&records[5], NPT_TRACE_SOFTIRQ_EXIT, t1 - 10, 1, 0, NULL);
+	_trace(&records[6], NPT_TRACE_IRQ_ENTRY, t1 + 2, 30, 0, "nvme0q1");
+	_trace(&records[7], NPT_TRACE_IRQ_EXIT, t1 + 4, 30, 0, NULL);
+	CHECK(npt_schedtrace_replay(1000, records, 8) == EXIT_SUCCESS,
+			"schedtrace: unable to replay the records");
+
+	fd = open_memstream(&report, &size);
+	npt_schedtrace_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "10 spike(s) matched, 2 with a culprit") != NULL,
+			"schedtrace: wrong spikes in:\n%s", report);
+	CHECK(strstr(report, "kworker/0:1                     	1	20.000	20.000") != NULL
+			&& strstr(report, "softirq TIMER                   	1	10.000	10.000") != NULL
+			&& strstr(report, "irq/24 eth0                     	1	5.000	5.000") != NULL,
+			"schedtrace: wrong culprits in:\n%s", report);
+	CHECK(strstr(report, "nvme0q1") == NULL, "schedtrace: interrupt out of the spikes in:\n%s",
+			report);
+	free(report);
+
+	globalArgs.sched_trace = false;
+	globalArgs.threshold = 0;
+	npt_spikes_init();
+}
+
+/**
+ * Parse the sizes of the disturbances, and detect the disturbances in
+ * the spikes that contain them
+ */
+static void test_inject() {
+	static const uint64_t pattern[] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 50 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	char *report = NULL;
+	size_t size = 0;
+	uint64_t t0, t1;
+	FILE *fd;
+
+	CHECK(npt_inject_parse("5,20.5") == EXIT_SUCCESS, "inject: 5,20.5 refused");
+	CHECK(npt_inject_parse("5,,20") != EXIT_SUCCESS, "inject: 5,,20 accepted");
+	CHECK(npt_inject_parse("0") != EXIT_SUCCESS, "inject: 0 accepted");
+	CHECK(npt_inject_parse("-5") != EXIT_SUCCESS, "inject: -5 accepted");
+	CHECK(npt_inject_parse("5us") != EXIT_SUCCESS, "inject: 5us accepted");
+	CHECK(npt_inject_parse("1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17") != EXIT_SUCCESS,
+			"inject: 17 sizes accepted");
+
+	_setup(100, 0);
+	globalArgs.threshold = 20;
+	globalArgs.max_spikes = NPT_DEFAULT_MAX_SPIKES;
+	globalArgs.inject_rate = NPT_DEFAULT_INJECT_RATE;
+	CHECK(npt_inject_parse("5,20") == EXIT_SUCCESS && npt_inject_init() == EXIT_SUCCESS
+			&& npt_inject_start() == EXIT_SUCCESS, "inject: unable to prepare the records");
+	CHECK(npt_spikes_init() == EXIT_SUCCESS, "inject: unable to prepare the spikes");
+	npt_synthetic_set(&source);
+	cycle();
+	t0 = spikes[0].tsc;
+	t1 = spikes[1].tsc;
+
+	// One disturbance of each size in a spike, and one between two
+	npt_inject_record(t0 - 40, t0 - 35, 0);
+	npt_inject_record(t1 - 30, t1 - 10, 1);
+	npt_inject_record(t1 + 2, t1 + 8, 1);
+
+	globalArgs.inject = "5,20";
+	fd = open_memstream(&report, &size);
+	npt_inject_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "	5		0	1		1 (100.0%)	45.000 / 45.000 / 45.000\n") != NULL,
+			"inject: wrong detection of 5 us in:\n%s", report);
+	CHECK(strstr(report, "	20		0	2		1 (50.0%)	30.000 / 30.000 / 30.000\n") != NULL,
+			"inject: wrong detection of 20 us in:\n%s", report);
+	free(report);
+
+	globalArgs.inject = NULL;
+	npt_inject_free();
+	globalArgs.threshold = 0;
+	npt_spikes_init();
+}
+
+/**
+ * The effective frequency of each interval is the one of the calibrated
+ * TSC scaled by APERF / MPERF, and the slow intervals are marked when
+ * the frequency dipped or the CPU was throttled
+ */
+static void test_msr() {
+	// The thermal log bit, set since before the run, is not a throttling
+	static const uint64_t logged = 1ULL << 1;
+	static const struct npt_msr_sample samples[] = {
+		{ 0,	0,	0,		0,		0,		logged,				0 },
+		{ 1000,	10000,	1000000000,	1000000000,	1000000000,	logged,				0 },
+		// Slow, at 800 MHz, then the core is throttled
+		{ 2000,	22000,	2000000000,	1800000000,	2000000000,	logged | NPT_MSR_THERMAL,	0 },
+		// Slow, throttled when it started
+		{ 3000,	34000,	3000000000,	2800000000,	3000000000,	logged,				0 },
+		// Slow, unexplained
+		{ 4000,	46000,	4000000000,	3800000000,	4000000000,	logged,				0 },
+		// Half of the time in C0, throttled by the package power limit
+		{ 5000,	56000,	5000000000,	4300000000,	4500000000,	logged,				NPT_MSR_POWER },
+	};
+	char *report = NULL;
+	size_t size = 0, i;
+	FILE *fd;
+
+	_setup(1000, 0);
+	tscHz = 1.0e9;
+	CHECK(npt_msr_start() == EXIT_SUCCESS, "msr: not started");
+	for (i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+		npt_msr_record(&samples[i]);
+	npt_msr_stop();
+
+	globalArgs.msr_interval = 1000000;
+	fd = open_memstream(&report, &size);
+	npt_msr_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "effective frequency 960.000 MHz over 5 interval(s) of 1s"
+				" (min 800.000, max 1000.000)") != NULL,
+			"msr: wrong frequencies in:\n%s", report);
+	CHECK(strstr(report, "	0.000		1000	10.000000	1000.000	100.0%	-		-	\n") != NULL
+			&& strstr(report, "	1.000		1000	12.000000	800.000	100.0%	core-thermal		-	slow dip <-\n") != NULL
+			&& strstr(report, "	2.000		1000	12.000000	1000.000	100.0%	core-thermal		-	slow <-\n") != NULL
+			&& strstr(report, "	3.000		1000	12.000000	1000.000	100.0%	-		-	slow\n") != NULL
+			&& strstr(report, "	4.000		1000	10.000000	1000.000	50.0%	pkg-power		-	\n") != NULL,
+			"msr: wrong intervals in:\n%s", report);
+	CHECK(strstr(report, "3 slow interval(s) (mean over 5% above the fastest), 2 of them (<-)") != NULL
+			&& strstr(report, "; 1 dip(s), 3 throttled interval(s)") != NULL,
+			"msr: wrong summary in:\n%s", report);
+	free(report);
+
+	npt_msr_free();
+	globalArgs.msr_interval = 0;
+	tscHz = 0.0;
+}
+
+static void test_irqdiff() {
+	static const uint64_t pattern[] = { 10, 10, 10, 10, 10, 10, 10, 10, 10, 50 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	char *report = NULL, *line;
+	double rate = -1.0, fraction = -1.0;
+	size_t size = 0;
+	FILE *fd;
+
+	_setup(100000, 0);
+	globalArgs.threshold = 20;
+	globalArgs.max_spikes = NPT_DEFAULT_MAX_SPIKES;
+	globalArgs.irq_diff = 2;
+	npt_synthetic_set(&source);
+	CHECK(npt_spikes_init() == EXIT_SUCCESS, "irqdiff: unable to prepare the spikes");
+	npt_irqdiff_cycle();
+	CHECK(counter == 100000 && globalArgs.loops == 100000,
+			"irqdiff: %" PRIu64 " loops instead of 100000", counter);
+
+	fd = open_memstream(&report, &size);
+	npt_irqdiff_print(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "(4 phases, on/off/off/on order, gaps over 20.000 us)") != NULL,
+			"irqdiff: wrong phases in:\n%s", report);
+	CHECK(strstr(report, "	on	50000	") != NULL && strstr(report, "	off	50000	") != NULL,
+			"irqdiff: wrong states in:\n%s", report);
+
+	// The phases skip a few loops of the pattern, which moves the gaps
+	// by a fraction of a loop at most
+	line = strstr(report, "IRQ-attributable:");
+	if (line != NULL) sscanf(line, "IRQ-attributable: %lf gaps/s, %lf", &rate, &fraction);
+	CHECK(fabs(rate) < 1.0 && fabs(fraction) < 0.01,
+			"irqdiff: wrong differential in:\n%s", report);
+	line = strstr(report, "non-maskable:");
+	if (line != NULL) sscanf(line, "non-maskable: %lf gaps/s, %lf", &rate, &fraction);
+	CHECK(fabs(rate - 7142.9) < 2.0 && fabs(fraction - 28.5714) < 0.01,
+			"irqdiff: wrong non-maskable part in:\n%s", report);
+	free(report);
+	globalArgs.irq_diff = 0;
+	npt_irqdiff_cycle();
+	npt_spikes_free();
+}
+
+/**
+ * Publish the statistics of a run in shared memory, and read them back
+ * as npt-top does
+ */
+static void test_shm() {
+	static const uint64_t pattern[] = { 10, 10, 10, 50 };
+	struct npt_synthetic source = {
+		.distribution = NPT_SYNTHETIC_PATTERN,
+		.start = 0,
+		.pattern = pattern,
+		.patternSize = sizeof(pattern) / sizeof(pattern[0]),
+	};
+	struct npt_shm *shm, copy;
+	char name[32];
+	int fd;
+
+	_setup(1000000, 0);
+	globalArgs.shm = true;
+	CHECK(npt_shm_start() == EXIT_SUCCESS, "shm: unable to create the segment");
+	npt_synthetic_set(&source);
+	cycle();
+
+	snprintf(name, sizeof(name), "/" NPT_SHM_PREFIX "%d", (int)getpid());
+	fd = shm_open(name, O_RDONLY, 0);
+	CHECK(fd >= 0, "shm: no segment %s", name);
+	if (fd >= 0) {
+		shm = mmap(NULL, sizeof(struct npt_shm), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		CHECK(shm != MAP_FAILED && npt_shm_snapshot(shm, &copy) == 0,
+				"shm: unable to read the segment");
+		CHECK(copy.pid == getpid() && copy.state == NPT_SHM_IDLE && copy.loops == 1000000
+			&& copy.ticks == 20000000 && copy.maxTicks == 50,
+				"shm: pid %d, state %u, %" PRIu64 " loops, %" PRIu64 " ticks, max %" PRIu64,
+				copy.pid, copy.state, copy.loops, copy.ticks, copy.maxTicks);
+		CHECK(copy.buckets[npt_shm_index(10)] == 750000 && copy.buckets[npt_shm_index(50)] == 250000,
+				"shm: wrong live histogram");
+		CHECK(npt_shm_bound(npt_shm_index(50)) >= 50 && npt_shm_bound(npt_shm_index(50)) < 56
+			&& npt_shm_bound(npt_shm_index(10)) >= 10 && npt_shm_bound(npt_shm_index(7)) == 7,
+				"shm: wrong bucket bounds");
+		if (shm != MAP_FAILED) munmap(shm, sizeof(struct npt_shm));
+	}
+
+	npt_shm_stop();
+	fd = shm_open(name, O_RDONLY, 0);
+	CHECK(fd < 0, "shm: segment %s not removed", name);
+	if (fd >= 0) close(fd);
+}
+
+/**
+ * Wait for a periodic event with each strategy, and compare the CPU
+ * they use to wait
+ */
+static void test_wait() {
+	const struct npt_wait_run *r, *busy, *sleep;
+	int i, j;
+
+	_setup(50, 0);
+	globalArgs.wait = "busy,spin,sleep,timerfd,epoll";
+	globalArgs.wait_period = 1000;
+	globalArgs.wait_spin = 200;
+	CHECK(npt_wait_init() == EXIT_SUCCESS && npt_wait_runs() == 5, "wait: unable to parse the strategies");
+	CHECK(npt_wait_cycle() == EXIT_SUCCESS, "wait: unable to run the strategies");
+
+	for (i = 0; i < npt_wait_runs(); i++) {
+		r = npt_wait_result(i);
+		CHECK(r->done && !r->error && r->events + r->missed == 50,
+				"wait %s: %" PRIu64 " events, %" PRIu64 " missed",
+				npt_wait_name(r->strategy), r->events, r->missed);
+		for (j = 1; j < NPT_WAIT_QUANTILES; j++)
+			CHECK(r->quantiles[j] >= r->quantiles[j - 1],
+					"wait %s: quantiles not sorted", npt_wait_name(r->strategy));
+		CHECK(r->quantiles[NPT_WAIT_QUANTILES - 1] <= r->max,
+				"wait %s: quantile %.0f over the max %.0f", npt_wait_name(r->strategy),
+				r->quantiles[NPT_WAIT_QUANTILES - 1], r->max);
+	}
+
+	busy = npt_wait_result(0);
+	sleep = npt_wait_result(2);
+	CHECK(busy->cpu > sleep->cpu && sleep->wakeups > 0,
+			"wait: busy uses %.1f%% of the CPU and sleep %.1f%% with %" PRIu64 " wakeups",
+			busy->cpu * 100.0, sleep->cpu * 100.0, sleep->wakeups);
+
+	globalArgs.wait = "busy,poll";
+	CHECK(npt_wait_init() != EXIT_SUCCESS, "wait: unknown strategy accepted");
+	globalArgs.wait = NULL;
+	npt_wait_init();
+}
+
+/**
+ * A subset of the npt options, to parse the runs of a scenario
+ */
+static int _parse_options(int argc, char **argv) {
+	static struct option options[] = {
+		{"loops",	required_argument,	0,	'l'},
+		{"output",	required_argument,	0,	'o'},
+		{"replay",	required_argument,	0,	6},
+		{"eval-cpu-speed",	no_argument,	0,	'e'},
+		{"nanoseconds",	no_argument, &globalArgs.nanoseconds, true},
+		{0, 0, 0, 0}
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "el:o:", options, NULL)) != -1) {
+		switch (c) {
+			case 0: break;
+			case 'l': globalArgs.loops = strtoull(optarg, NULL, 10); break;
+			case 'o': globalArgs.output = strdup(optarg); break;
+			case 6: globalArgs.replay = strdup(optarg); break;
+			case 'e': globalArgs.evaluateSpeed = true; break;
+			default: return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Write a scenario and parse it on top of the options
+ */
+static int _scenario(char *filename, const char *text) {
+	FILE *fd;
+
+	fd = fopen(filename, "w");
+	if (fd == NULL) return EXIT_FAILURE;
+	fputs(text, fd);
+	fclose(fd);
+
+	_setup(1000, 0);
+	globalArgs.scenario = filename;
+	globalArgs.output = "/tmp/npt-scenario";
+	return npt_scenario_init(_parse_options);
+}
+
+static void test_scenario() {
+	char filename[] = "/tmp/npt-test-XXXXXX";
+	char *report = NULL;
+	size_t size = 0;
+	FILE *fd;
+	int run, ret;
+
+	fd = fdopen(mkstemp(filename), "w");
+	if (fd == NULL) {
+		CHECK(false, "scenario: unable to create a temporary file");
+		return;
+	}
+	fclose(fd);
+
+	ret = _scenario(filename, "# Host qualification\n"
+			"\n"
+			"base\n"
+			"fast	-l 2000 --nanoseconds	# comment\n"
+			"  long -l 5000 --output=/tmp/other\n");
+	CHECK(ret == EXIT_SUCCESS && npt_scenario_runs() == 3,
+			"scenario: %d runs instead of 3", npt_scenario_runs());
+	CHECK(ret == EXIT_SUCCESS && strcmp(npt_scenario_name(1), "fast") == 0,
+			"scenario: wrong name of the second run");
+	CHECK(globalArgs.loops == 1000 && !globalArgs.nanoseconds,
+			"scenario: the command line options were changed");
+	for (run = 0; run < npt_scenario_runs() - 1; run++) npt_scenario_stop(run);
+	npt_scenario_fail(run);
+
+	fd = open_memstream(&report, &size);
+	npt_scenario_print_comparison(fd, "");
+	fclose(fd);
+	CHECK(strstr(report, "	base           	us	") != NULL
+		&& strstr(report, "	fast           	ns	") != NULL
+		&& strstr(report, "	long           	us	failed\n") != NULL,
+			"scenario: wrong comparison in:\n%s", report);
+	free(report);
+	npt_scenario_free();
+	CHECK(globalArgs.scenario == filename && npt_scenario_runs() == 0,
+			"scenario: the command line options were not restored");
+
+	CHECK(_scenario(filename, "a -l 10\nb --replay=dump\n") != EXIT_SUCCESS,
+			"scenario: a run changed --replay");
+	npt_scenario_free();
+	CHECK(_scenario(filename, "a -l 10\nb -e\n") != EXIT_SUCCESS,
+			"scenario: a run changed the evaluation of the CPU frequency");
+	npt_scenario_free();
+	CHECK(_scenario(filename, "a -l 10\na -l 20\n") != EXIT_SUCCESS,
+			"scenario: two runs with the same name");
+	npt_scenario_free();
+	CHECK(_scenario(filename, "a/b -l 10\n") != EXIT_SUCCESS,
+			"scenario: a run name with a slash");
+	npt_scenario_free();
+	CHECK(_scenario(filename, "a -l 10 extra\n") != EXIT_SUCCESS,
+			"scenario: an argument which is not an option");
+	npt_scenario_free();
+	CHECK(_scenario(filename, "# no run\n") != EXIT_SUCCESS,
+			"scenario: no run accepted");
+	npt_scenario_free();
+
+	unlink(filename);
+}
+
+int main() {
+	// The histogram is allocated once, as by npt once pinned
+	if (npt_histogram_init() != EXIT_SUCCESS) return EXIT_FAILURE;
+
+	test_constant();
+	test_pattern();
+	test_uniform();
+	test_duration();
+	test_wrap();
+	test_soak_resume();
+	test_replay();
+	test_periodicity();
+	test_metrics();
+	test_signals();
+	test_housekeeping();
+	test_cpu_list();
+	test_stress_profiles();
+	test_sweep();
+	test_chase();
+	test_plugin();
+	test_numa();
+	test_converge();
+	test_stolen();
+	test_tsc();
+	test_schedtrace();
+	test_inject();
+	test_msr();
+	test_irqdiff();
+	test_shm();
+	test_wait();
+	test_scenario();
+
+	npt_histogram_free();
+	if (failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("All engine checks passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+/**
+ * Non-Preempt Test (npt) tool
+ * Copyright 2012-2013  Raphaël Beamonte <raphael.beamonte@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License Version
+ * 2 as published by the Free Software Foundation.
+ *
+ * npt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ * or see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * Workload plugin used by the engine checks: counts its calls and hooks
+ * in a context which outlives the plugin, so that the teardown can be
+ * checked
+ */
+#include <stdlib.h>	// calloc
+
+#include <npt/plugin.h>
+
+struct npt_test_plugin {
+	int init, warmup, teardown;
+	unsigned long calls;
+};
+
+int npt_test_workload_init(void **ctx) {
+	struct npt_test_plugin *state = calloc(1, sizeof(*state));
+	if (state == NULL) return 1;
+	state->init++;
+	*ctx = state;
+	return 0;
+}
+
+void npt_test_workload_warmup(void *ctx) {
+	((struct npt_test_plugin *)ctx)->warmup++;
+}
+
+void npt_test_workload(void *ctx) {
+	((struct npt_test_plugin *)ctx)->calls++;
+}
+
+void npt_test_workload_teardown(void *ctx) {
+	((struct npt_test_plugin *)ctx)->teardown++;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Check that the merged sketches of replayed runs give the percentiles
+# of all their loops within the relative error of the sketch
+#
+
+NPT=${NPT:-../npt}
+NPT_SKETCH_MERGE=${NPT_SKETCH_MERGE:-../npt-sketch-merge}
+dir=$(mktemp -d /tmp/npt-sketch-XXXXXX) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+fail() {
+	echo "FAIL: $*"
+	cat "$dir/report"
+	failures=$((failures + 1))
+}
+
+# Check that the percentile $1 of the report is $2 us within the error
+check_percentile() {
+	awk -v p="$1%:" -v exact="$2" '$1 == p {
+		found = 1
+		error = ($2 - exact) / exact
+		if (error < 0) error = -error
+		exit !(error <= 1 / 257)
+	} END { if (!found) exit 1 }' "$dir/report" || fail "percentile $1 is not $2 us"
+}
+
+# Three runs of 10000 loops each, of 1 to 30000 us all together
+mkdir "$dir/fleet"
+for i in 0 1 2; do
+	seq $((i * 10000 + 1)) $((i * 10000 + 10000)) > "$dir/run$i.txt"
+	"$NPT" --replay="$dir/run$i.txt" --sketch="$dir/fleet/run$i.sketch" > "$dir/report" 2>&1 \
+		|| fail "npt did not write the sketch of run $i"
+done
+
+"$NPT_SKETCH_MERGE" -o "$dir/merged.sketch" "$dir/fleet" > "$dir/report" 2>&1 \
+	|| fail "npt-sketch-merge did not merge the sketches"
+grep -q "^3 sketch(es), 30000 loops merged" "$dir/report" || fail "not all the loops were merged"
+check_percentile 50 15000
+check_percentile 90 27000
+check_percentile 99 29700
+check_percentile 99.9 29970
+
+# A merged sketch is merged again as any other
+"$NPT_SKETCH_MERGE" -p 1,50 "$dir/merged.sketch" > "$dir/report" 2>&1 \
+	|| fail "npt-sketch-merge did not read a merged sketch"
+check_percentile 1 300
+check_percentile 50 15000
+
+# A corrupted sketch is rejected
+head -c 100 "$dir/fleet/run0.sketch" > "$dir/truncated.sketch"
+"$NPT_SKETCH_MERGE" "$dir/truncated.sketch" > "$dir/report" 2>&1 \
+	&& fail "npt-sketch-merge accepted a truncated sketch"
+
+[ $failures -eq 0 ] && echo "All npt-sketch-merge checks passed"
+exit $failures